@@ -38,6 +38,22 @@
 #include "NamedObject.h"
 #include "Obstacle.h"
 
+// Field of view half-angle [radians], and its squared cosine for
+// dot product tests.
+#define FIELD_OF_VIEW         1.0471967
+#define FIELD_OF_VIEW_COS2    0.25000073715823950
+
+struct BoidNeighbor
+{
+   Vector position;
+   Vector velocity;
+   int    boidType;
+   int    boidNumber;
+};
+// Read-only view of a neighboring boid: the state the steering
+// functions use, without the SimObject base and name of a full Boid.
+// Neighbors are passed to aim() as a contiguous array.
+
 class Boid : public SimObject
 {
 public:
@@ -62,7 +78,7 @@ public:
 
    // Clone boid.
 
-   virtual void aim(Boid *boidList);
+   virtual void aim(const BoidNeighbor *neighbors, int numNeighbors);
 
    // Updates velocity and acceleration and determines the new position of
    // the object based on the previous acceleration and velocity.
@@ -128,6 +144,9 @@ public:
    int getBoidNumber() { return(boidNumber); }
    // Returns the number of this boid.
 
+   void getNeighbor(BoidNeighbor *neighbor);
+   // Fills in a neighbor view of this boid.
+
 protected:
 
    virtual double getGravAcceleration(void) const;
@@ -165,6 +184,7 @@ protected:
    // circumstances.
 
    virtual bool visibleToSelf(Boid *b);
+   virtual bool visibleToSelf(const BoidNeighbor *b);
 
    // Returns true if this boid can see boid b.
 
@@ -189,24 +209,24 @@ protected:
    // with a specific obstacle, and returns an acceleration vector indicating
    // how the boid should accelerate to achieve this end.
 
-   virtual Vector maintainingCruisingDistance(Boid *boidList);
+   virtual Vector maintainingCruisingDistance(const BoidNeighbor *neighbors, int numNeighbors);
 
    // Returns a vector which indicates how the boid would like to accelerate
    // in order to maintain a distance of cruiseDistance from the nearest
    // visible boid.
 
-   virtual Vector velocityMatching(Boid *boidList);
+   virtual Vector velocityMatching(const BoidNeighbor *neighbors, int numNeighbors);
 
    // Returns a vector which indicates how the boid would like to accelerate
    // in order to fly at approximately the same speed and direction as the
    // nearby boids.
 
-   virtual Vector flockCentering(Boid *boidList);
+   virtual Vector flockCentering(const BoidNeighbor *neighbors, int numNeighbors);
 
    // Returns a vector which indicates how the boid would like to accelerate
    // in order to be near the center of the flock.
 
-   virtual Vector navigator(Boid *boidList);
+   virtual Vector navigator(const BoidNeighbor *neighbors, int numNeighbors);
 
    // This method prioritizes and resolves the acceleration vectors from
    // CollisionAvoidance(), FlockCentering(), MaintainingCruisingDistance(),
@@ -214,6 +234,26 @@ protected:
    // acceleration vector that the boid will apply to its flight in the
    // current time step. It is supplied a list of visible boids.
 
+   typedef struct
+   {
+      Vector             center;                  // center of visible flockmates
+      int                count;                   // number of visible flockmates
+      const BoidNeighbor *closest;                // closest visible flockmate, or NULL
+      double             closestDistance;         // [m] distance to closest
+   } NEIGHBORHOOD;
+
+   virtual void surveyNeighbors(const BoidNeighbor *neighbors, int numNeighbors);
+
+   // Visits each neighbor once, and records the flock center and the
+   // closest visible flockmate in neighborhood. Visibility is a dot
+   // product test against the field of view cosine, and distances are
+   // compared squared. navigator() surveys once for all the flocking
+   // rules; a rule called on its own surveys for itself.
+
+   NEIGHBORHOOD neighborhood;
+   bool         surveyed;
+   // Survey of the neighbors passed to the current navigator() call.
+
    double bodyLength;
    // [m] Length of the boid. By default this value is equal to the z
    // component of the bDimensions passed to the constructor.
@@ -258,6 +298,43 @@ private:
    // Has the boid been updated at least once?
 };
 
+class NeighborBuffer
+{
+public:
+
+   NeighborBuffer(void) { neighbors = NULL; size = capacity = 0; }
+
+   ~NeighborBuffer(void) { delete [] neighbors; }
+
+   void clear(void) { size = 0; }
+
+   // Empties the buffer, keeping its storage.
+
+   BoidNeighbor *append(void)
+   {
+      if (size == capacity)
+      {
+         grow();
+      }
+      return(&neighbors[size++]);
+   }
+
+   // Returns a new neighbor slot at the end of the buffer.
+
+   void append(Boid *boid) { boid->getNeighbor(append()); }
+
+   // Appends a view of boid.
+
+   void grow(void);
+
+   // Doubles the storage.
+
+   BoidNeighbor *neighbors;
+   int          size;
+   int          capacity;
+};
+// Reusable contiguous storage for neighbor views.
+
 // ------------------------------------------------ inline methods ------------------------------------------------
 
 inline double
@@ -294,6 +371,38 @@ Boid::visibleToSelf(Boid *b)
 }
 
 
+inline bool
+Boid::visibleToSelf(const BoidNeighbor *b)
+{
+   // find out if the boid b is within our field of view
+   Vector vectorToObject = b->position - position;
+
+   // Same as AngleBetween(velocity, vectorToObject) <= FIELD_OF_VIEW,
+   // without the acos and square roots.
+   double dot = velocity * vectorToObject;
+
+   if ((dot > 0) && ((dot * dot) >= FIELD_OF_VIEW_COS2 *
+                     (velocity * velocity) * (vectorToObject * vectorToObject)))
+   {
+      return(true);
+   }
+   else
+   {
+      return(false);
+   }
+}
+
+
+inline void
+Boid::getNeighbor(BoidNeighbor *neighbor)
+{
+   neighbor->position   = position;
+   neighbor->velocity   = velocity;
+   neighbor->boidType   = boidType;
+   neighbor->boidNumber = boidNumber;
+}
+
+
 inline float
 Boid::getProbeLength(void)
 {
@@ -32,6 +32,14 @@
 
 //---------------- CLASS OBSTACLE ------------------------------
 
+void
+Obstacle::Bounds(Vector& lower, Vector& upper) const
+{
+   lower.Set(-DBL_MAX, -DBL_MAX, -DBL_MAX);
+   upper.Set(DBL_MAX, DBL_MAX, DBL_MAX);
+}
+
+
 //---------------- CLASS POLYGON ------------------------------
 
 int
@@ -251,8 +259,43 @@ Polygon::Disp(ostream& strm) const
 }
 
 
+void
+Polygon::Bounds(Vector& lower, Vector& upper) const
+{
+   lower = upper = vertex[0];
+   for (int i = 1; i < numvertices; i++)
+   {
+      if (vertex[i].x < lower.x) { lower.x = vertex[i].x; }
+      if (vertex[i].y < lower.y) { lower.y = vertex[i].y; }
+      if (vertex[i].z < lower.z) { lower.z = vertex[i].z; }
+      if (vertex[i].x > upper.x) { upper.x = vertex[i].x; }
+      if (vertex[i].y > upper.y) { upper.y = vertex[i].y; }
+      if (vertex[i].z > upper.z) { upper.z = vertex[i].z; }
+   }
+}
+
+
 //---------------- CLASS BOX------------------------------
 
+void
+Box::Bounds(Vector& lower, Vector& upper) const
+{
+   Vector l, u;
+
+   side[0]->Bounds(lower, upper);
+   for (int i = 1; i < 6; i++)
+   {
+      side[i]->Bounds(l, u);
+      if (l.x < lower.x) { lower.x = l.x; }
+      if (l.y < lower.y) { lower.y = l.y; }
+      if (l.z < lower.z) { lower.z = l.z; }
+      if (u.x > upper.x) { upper.x = u.x; }
+      if (u.y > upper.y) { upper.y = u.y; }
+      if (u.z > upper.z) { upper.z = u.z; }
+   }
+}
+
+
 Box::Box(const Box& b)
 {
    for (int i = 0; i < 6; i++)
@@ -417,6 +460,22 @@ Box::IntersectionWithRay(const Vector& raydirection,
 
 //---------------- CLASS SPHERE------------------------------
 
+void
+Sphere::Bounds(Vector& lower, Vector& upper) const
+{
+   // A ray starting at the center reports a point radius from the
+   // world origin, so include that too.
+   lower = origin - Vector(radius, radius, radius);
+   upper = origin + Vector(radius, radius, radius);
+   if (-radius < lower.x) { lower.x = -radius; }
+   if (-radius < lower.y) { lower.y = -radius; }
+   if (-radius < lower.z) { lower.z = -radius; }
+   if (radius > upper.x) { upper.x = radius; }
+   if (radius > upper.y) { upper.y = radius; }
+   if (radius > upper.z) { upper.z = radius; }
+}
+
+
 ISectData
 Sphere::IntersectionWithRay(const Vector& raydirection,
                             const Vector& rayorigin) const
@@ -510,6 +569,7 @@ ObstacleList::Add(const Obstacle& o)
    n->obj  = o.Clone();                           // tell object to make a copy of itself
    n->next = head;
    head    = n;                                   // link in new obnode
+   Index();
    return(n->obj);
 }
 
@@ -538,6 +598,7 @@ ObstacleList::Delete(Obstacle *o)
    if (n)
    {
       delete n;
+      Index();
       return(o);
    }
    else
@@ -545,3 +606,260 @@ ObstacleList::Delete(Obstacle *o)
       return(NULL);                               // failure
    }
 }
+
+
+// Does the line segment origin + t * direction, -range <= t <= range,
+// cross the box [lower, upper]?
+static int
+SegmentCrossesBounds(const Vector& lower, const Vector& upper,
+                     const Vector& origin, const Vector& direction, double range)
+{
+   double o[3], d[3], l[3], u[3];
+   double tmin = -range, tmax = range, t1, t2, t;
+
+   o[0] = origin.x;
+   o[1] = origin.y;
+   o[2] = origin.z;
+   d[0] = direction.x;
+   d[1] = direction.y;
+   d[2] = direction.z;
+   l[0] = lower.x;
+   l[1] = lower.y;
+   l[2] = lower.z;
+   u[0] = upper.x;
+   u[1] = upper.y;
+   u[2] = upper.z;
+   for (int i = 0; i < 3; i++)
+   {
+      if (d[i] == 0)
+      {
+         // Parallel to this slab.
+         if ((o[i] < l[i]) || (o[i] > u[i]))
+         {
+            return(0);
+         }
+         continue;
+      }
+      t1 = (l[i] - o[i]) / d[i];
+      t2 = (u[i] - o[i]) / d[i];
+      if (t1 > t2)
+      {
+         t  = t1;
+         t1 = t2;
+         t2 = t;
+      }
+      if (t1 > tmin) { tmin = t1; }
+      if (t2 < tmax) { tmax = t2; }
+      if (tmin > tmax)
+      {
+         return(0);
+      }
+   }
+   return(1);
+}
+
+
+ISectData
+ObstacleList::IntersectRay(const Vector& raydirection, const Vector& rayorigin,
+                           double range) const
+{
+   // Spheres can report intersections behind the ray origin, so the probe
+   // is a segment centered on the origin rather than a half-line. Every
+   // reported point lies in its obstacle's bounds, so no obstacle with an
+   // intersection within range is skipped.
+
+   ISectData    closest, data;
+   double       distance;
+   int          stack[BVH_DEPTH];
+   int          top, i;
+   const bvnode *node;
+
+   Vector rdirection = Direction(raydirection);
+
+   closest.intersectionflag = 0;
+   if (numNodes == 0)
+   {
+      return(closest);
+   }
+   top          = 0;
+   stack[top++] = 0;
+   while (top > 0)
+   {
+      node = &nodes[stack[--top]];
+      if (!SegmentCrossesBounds(node->lower, node->upper, rayorigin, rdirection, range))
+      {
+         continue;
+      }
+      if (node->count == 0)
+      {
+         stack[top++] = node->right;
+         stack[top++] = (int)(node - nodes) + 1;
+         continue;
+      }
+      for (i = node->first; i < node->first + node->count; i++)
+      {
+         data = leaves[i]->DoesRayIntersect(raydirection, rayorigin);
+         if (data.intersectionflag == 1)
+         {
+            distance = Magnitude(data.point - rayorigin);
+            if (distance <= range)
+            {
+               // found a closer object
+               range   = distance;
+               closest = data;
+            }
+         }
+      }
+   }
+   return(closest);
+}
+
+
+void
+ObstacleList::Index(void)
+{
+   obnode *n;
+   int    count;
+
+   delete [] nodes;
+   delete [] leaves;
+   delete [] lowers;
+   delete [] uppers;
+   nodes    = NULL;
+   leaves   = NULL;
+   lowers   = uppers = NULL;
+   numNodes = 0;
+
+   for (n = head, count = 0; n != NULL; n = n->next)
+   {
+      count++;
+   }
+   if (count == 0)
+   {
+      return;
+   }
+
+   nodes  = new bvnode[2 * count];
+   leaves = new Obstacle *[count];
+   lowers = new Vector[count];
+   uppers = new Vector[count];
+   for (n = head, count = 0; n != NULL; n = n->next, count++)
+   {
+      leaves[count] = n->obj;
+      n->obj->Bounds(lowers[count], uppers[count]);
+
+      // Pad for rounding in the intersection calculations.
+      lowers[count] = lowers[count] - Vector(BVH_PAD, BVH_PAD, BVH_PAD);
+      uppers[count] = uppers[count] + Vector(BVH_PAD, BVH_PAD, BVH_PAD);
+   }
+   IndexNode(0, count);
+}
+
+
+int
+ObstacleList::IndexNode(int first, int count)
+{
+   // Leaves are split at the median center along the longest axis of
+   // their centers, which keeps the depth logarithmic.
+
+   int      index, i, j, k, lo, hi, mid, axis;
+   double   c, pivot, extent[3], lowc[3], highc[3];
+   Obstacle *obs;
+   Vector   v;
+   bvnode   *node;
+
+   index = numNodes++;
+   node  = &nodes[index];
+
+   node->lower = lowers[first];
+   node->upper = uppers[first];
+   lowc[0]     = highc[0] = (lowers[first].x + uppers[first].x) / 2;
+   lowc[1]     = highc[1] = (lowers[first].y + uppers[first].y) / 2;
+   lowc[2]     = highc[2] = (lowers[first].z + uppers[first].z) / 2;
+   for (i = first + 1; i < first + count; i++)
+   {
+      if (lowers[i].x < node->lower.x) { node->lower.x = lowers[i].x; }
+      if (lowers[i].y < node->lower.y) { node->lower.y = lowers[i].y; }
+      if (lowers[i].z < node->lower.z) { node->lower.z = lowers[i].z; }
+      if (uppers[i].x > node->upper.x) { node->upper.x = uppers[i].x; }
+      if (uppers[i].y > node->upper.y) { node->upper.y = uppers[i].y; }
+      if (uppers[i].z > node->upper.z) { node->upper.z = uppers[i].z; }
+      for (k = 0; k < 3; k++)
+      {
+         c = ((k == 0) ? lowers[i].x + uppers[i].x :
+              (k == 1) ? lowers[i].y + uppers[i].y : lowers[i].z + uppers[i].z) / 2;
+         if (c < lowc[k]) { lowc[k] = c; }
+         if (c > highc[k]) { highc[k] = c; }
+      }
+   }
+
+   if (count <= BVH_LEAF_SIZE)
+   {
+      node->first = first;
+      node->count = count;
+      node->right = -1;
+      return(index);
+   }
+
+   // Longest axis of centers.
+   for (k = 0; k < 3; k++)
+   {
+      extent[k] = highc[k] - lowc[k];
+   }
+   axis = 0;
+   if (extent[1] > extent[axis]) { axis = 1; }
+   if (extent[2] > extent[axis]) { axis = 2; }
+
+   // Select median center (Hoare's FIND).
+   mid = first + (count / 2);
+   lo  = first;
+   hi  = first + count - 1;
+   while (lo < hi)
+   {
+      pivot = (axis == 0) ? lowers[mid].x + uppers[mid].x :
+              (axis == 1) ? lowers[mid].y + uppers[mid].y : lowers[mid].z + uppers[mid].z;
+      i = lo;
+      j = hi;
+      do
+      {
+         while (((axis == 0) ? lowers[i].x + uppers[i].x :
+                 (axis == 1) ? lowers[i].y + uppers[i].y : lowers[i].z + uppers[i].z) < pivot)
+         {
+            i++;
+         }
+         while (pivot < ((axis == 0) ? lowers[j].x + uppers[j].x :
+                         (axis == 1) ? lowers[j].y + uppers[j].y : lowers[j].z + uppers[j].z))
+         {
+            j--;
+         }
+         if (i <= j)
+         {
+            obs       = leaves[i];
+            leaves[i] = leaves[j];
+            leaves[j] = obs;
+            v         = lowers[i];
+            lowers[i] = lowers[j];
+            lowers[j] = v;
+            v         = uppers[i];
+            uppers[i] = uppers[j];
+            uppers[j] = v;
+            i++;
+            j--;
+         }
+      } while (i <= j);
+      if (j < mid)
+      {
+         lo = i;
+      }
+      if (mid < i)
+      {
+         hi = j;
+      }
+   }
+
+   node->first = first;
+   node->count = 0;
+   IndexNode(first, mid - first);
+   nodes[index].right = IndexNode(mid, first + count - mid);
+   return(index);
+}
@@ -37,7 +37,16 @@
 #define STATS                13
 #define STATS_RESULT         14
 #define QUIT                 15
+#define SEARCH_BATCH         16
+#define SEARCH_BATCH_RESULT  17
+#define GHOSTS               18
 
-// Maximum items per message.
-#define MAX_MESSAGE_ITEMS    20
+// Maximum records per message frame.
+// A longer result is sent in frames, each giving the total number of
+// records and the number in the frame.
+#define MAX_FRAME_RECORDS    1024
+
+// Record encodings.
+#define FULL_ENCODING        0
+#define COMPACT_ENCODING     1
 #endif
@@ -26,6 +26,7 @@
 
 #include "processorSet.hpp"
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #define PRAND    ((float)(rand() % 1001) / 1000.0f)
@@ -35,7 +36,8 @@ const float ProcessorSet::MAX_BOUNDARY_VELOCITY = 0.1f;
 
 // Constructor.
 ProcessorSet::ProcessorSet(int dimension, float span, int numBoids,
-                           int *ptids, int tid, int randomSeed)
+                           int *ptids, int tid, int randomSeed,
+                           Transport *transport)
 {
    register int   i, j, k, proc;
    float          size;
@@ -62,8 +64,9 @@ ProcessorSet::ProcessorSet(int dimension, float span, int numBoids,
    {
       this->ptids[i] = ptids[i];
    }
-   this->tid = tid;
-   msgSent   = msgRcv = 0;
+   this->tid       = tid;
+   this->transport = transport;
+   msgSent         = msgRcv = 0;
 
    // Randomly assign boids to local octrees.
    srand(randomSeed);
@@ -123,6 +126,27 @@ ProcessorSet::ProcessorSet(int dimension, float span, int numBoids,
    }
    delete assign;
 
+   // Create ghost octrees for remote processors.
+   ghosts = new Octree *[numProcs];
+#ifdef _DEBUG
+   assert(ghosts != NULL);
+#endif
+   for (proc = 0; proc < numProcs; proc++)
+   {
+      if (this->ptids[proc] == tid)
+      {
+         ghosts[proc] = NULL;
+      }
+      else
+      {
+         ghosts[proc] = new Octree(0.0f, 0.0f, 0.0f, span, PRECISION);
+#ifdef _DEBUG
+         assert(ghosts[proc] != NULL);
+#endif
+      }
+   }
+   ghostsReceived = 0;
+
    newBounds = new Octree::BOUNDS[numProcs];
 #ifdef _DEBUG
    assert(newBounds != NULL);
@@ -130,6 +154,122 @@ ProcessorSet::ProcessorSet(int dimension, float span, int numBoids,
 
    // Load-balancing off.
    loadBalance = false;
+
+   // Search remote processors on demand.
+   searchMode = DEMAND_SEARCH;
+
+   // Instrument partitions.
+   tickStats.init(numProcs);
+
+   // Batch neighbor buffers and boid records are allocated on demand.
+   batchNeighbors = NULL;
+   batchCapacity  = 0;
+   records        = NULL;
+   recordCapacity = 0;
+
+   // Full wire records.
+   wireWords    = NULL;
+   wireCapacity = 0;
+   wireError    = 0.0f;
+
+   // Attribute cache is allocated on demand.
+   attributes        = NULL;
+   attributesSent    = NULL;
+   attributeCapacity = 0;
+}
+
+
+// Receive initialization from the master and create a slave's set.
+ProcessorSet *ProcessorSet::create(Transport *transport)
+{
+   int          type, dimension, numProcs, numBoids, count, random;
+   int          searchMode, approximateMedian, backend;
+   float        span, rebuildThreshold, wireError;
+   int          *ptids;
+   ProcessorSet *pset;
+
+   // Get initialization information.
+   transport->receive(transport->parentTid());
+   transport->unpackInt(&type, 1);
+#ifdef _DEBUG
+   assert(type == INIT);
+#endif
+   transport->unpackInt(&dimension, 1);
+   transport->unpackFloat(&span, 1);
+   transport->unpackInt(&numBoids, 1);
+   transport->unpackInt(&count, 1);
+   numProcs = dimension * dimension * dimension;
+   ptids    = new int[numProcs];
+#ifdef _DEBUG
+   assert(ptids != NULL);
+#endif
+   transport->unpackInt(ptids, numProcs);
+   transport->unpackInt(&random, 1);
+   transport->unpackInt(&searchMode, 1);
+   transport->unpackInt(&approximateMedian, 1);
+   transport->unpackInt(&backend, 1);
+   transport->unpackFloat(&rebuildThreshold, 1);
+   transport->unpackFloat(&wireError, 1);
+
+   // Create the processor set.
+   Boid::setBoidCount(count);
+   pset = new ProcessorSet(dimension, span, numBoids, ptids, transport->myTid(),
+                           random, transport);
+#ifdef _DEBUG
+   assert(pset != NULL);
+#endif
+   delete [] ptids;
+   pset->setSearchMode((SEARCHMODE)searchMode);
+   pset->setApproximateMedian(approximateMedian != 0);
+   pset->setOctreeBackend((Octree::BACKEND)backend);
+   pset->setRebuildThreshold(rebuildThreshold);
+   pset->setWireError(wireError);
+   return(pset);
+}
+
+
+// Set approximate median mode for load-balancing.
+void ProcessorSet::setApproximateMedian(bool mode)
+{
+   register int i;
+
+   for (i = 0; i < numProcs; i++)
+   {
+      octrees[i]->setApproximateMedian(mode);
+   }
+}
+
+
+// Set octree spatial index backend.
+// Grid cells are the size of the visibility range, so a neighbor
+// search scans at most 27 cells.
+void ProcessorSet::setOctreeBackend(Octree::BACKEND backend)
+{
+   register int i;
+
+   for (i = 0; i < numProcs; i++)
+   {
+      octrees[i]->setCellSize((float)Boid::visibilityRange);
+      octrees[i]->setBackend(backend);
+      if (ghosts[i] != NULL)
+      {
+         ghosts[i]->setCellSize((float)Boid::visibilityRange);
+         ghosts[i]->setBackend(backend);
+      }
+   }
+}
+
+
+// Set adaptive octree rebuild threshold (0 = always move incrementally).
+// Ghost trees are refilled each update and never moved.
+void ProcessorSet::setRebuildThreshold(float threshold)
+{
+   register int i;
+
+   for (i = 0; i < numProcs; i++)
+   {
+      octrees[i]->setRebuildThreshold(threshold);
+   }
 }
 
 
@@ -138,14 +278,25 @@ ProcessorSet::~ProcessorSet()
 {
    register int i;
 
+   clearGhosts();
    for (i = 0; i < numProcs; i++)
    {
       delete octrees[i];
+      if (ghosts[i] != NULL)
+      {
+         delete ghosts[i];
+      }
    }
    delete octrees;
+   delete ghosts;
    delete migrations;
    delete ptids;
    delete newBounds;
+   delete [] batchNeighbors;
+   delete [] records;
+   delete [] wireWords;
+   delete [] attributes;
+   delete [] attributesSent;
 }
 
 
@@ -175,8 +326,8 @@ void ProcessorSet::makeBoids(int proc, int quantity)
       assert(boid != NULL);
 #endif
       // Insert into octree.
-      object = new OctObject((float)(position.x), (float)(position.y),
-                             (float)(position.z), (void *)boid);
+      object = octrees[proc]->newObject((float)(position.x), (float)(position.y),
+                                        (float)(position.z), (void *)boid);
 #ifdef _DEBUG
       assert(object != NULL);
 #endif
@@ -188,14 +339,15 @@ void ProcessorSet::makeBoids(int proc, int quantity)
 // Run.
 void ProcessorSet::run()
 {
-   int operation, proc;
+   int  operation, proc;
+   TIME start;
 
    // Message loop.
 #ifdef UNIX
    while (true)
    {
-      pvm_recv(-1, 0);
-      pvm_upkint(&operation, 1, 1);
+      transport->receive(-1);
+      transport->unpackInt(&operation, 1);
       switch (operation)
       {
       case AIM:
@@ -212,21 +364,25 @@ void ProcessorSet::run()
 
       case BALANCE:
          // Set load-balanced bounds.
+         start = tickStats.start();
          for (proc = 0; proc < numProcs; proc++)
          {
-            pvm_upkfloat(&(octrees[proc]->bounds.xmin), 1, 1);
-            pvm_upkfloat(&(octrees[proc]->bounds.xmax), 1, 1);
-            pvm_upkfloat(&(octrees[proc]->bounds.ymin), 1, 1);
-            pvm_upkfloat(&(octrees[proc]->bounds.ymax), 1, 1);
-            pvm_upkfloat(&(octrees[proc]->bounds.zmin), 1, 1);
-            pvm_upkfloat(&(octrees[proc]->bounds.zmax), 1, 1);
+            transport->unpackFloat(&(octrees[proc]->bounds.xmin), 1);
+            transport->unpackFloat(&(octrees[proc]->bounds.xmax), 1);
+            transport->unpackFloat(&(octrees[proc]->bounds.ymin), 1);
+            transport->unpackFloat(&(octrees[proc]->bounds.ymax), 1);
+            transport->unpackFloat(&(octrees[proc]->bounds.zmin), 1);
+            transport->unpackFloat(&(octrees[proc]->bounds.zmax), 1);
          }
+         tickStats.stop(TickStats::BALANCE_PHASE, start);
          ready();
          break;
 
       case MIGRATE:
          // Migrate boids.
+         start = tickStats.start();
          migrate();
+         tickStats.stop(TickStats::BALANCE_PHASE, start);
          ready();
          break;
 
@@ -235,8 +391,7 @@ void ProcessorSet::run()
          break;
 
       case QUIT:
-         pvm_exit();
-         exit(0);
+         quit();
 
       default:
          serveClient(operation);
@@ -251,8 +406,18 @@ void ProcessorSet::aim()
 {
    register int       i, proc;
    register OctObject *object;
-   register Boid      *boidList, *boid, *boid2;
+   register Boid      *boid;
    Octree::BOUNDS     bounds;
+   TIME               start;
+
+   start = tickStats.start();
+
+   // Exchange ghosts so that all searches are local.
+   if (searchMode == HALO_SEARCH)
+   {
+      sendGhosts();
+      gatherGhosts();
+   }
 
    for (proc = 0; proc < numProcs; proc++)
    {
@@ -262,10 +427,17 @@ void ProcessorSet::aim()
          continue;
       }
 
+      // Batch remote searches?
+      if (searchMode == BATCH_SEARCH)
+      {
+         aimBatch(proc);
+         continue;
+      }
+
       for (object = octrees[proc]->objects; object != NULL; object = object->next)
       {
          // Do cross-processor search.
-         boidList    = NULL;
+         neighborBuffer.clear();
          bounds.xmin = object->position.m_x - Boid::visibilityRange;
          bounds.xmax = object->position.m_x + Boid::visibilityRange;
          bounds.ymin = object->position.m_y - Boid::visibilityRange;
@@ -278,356 +450,1424 @@ void ProcessorSet::aim()
             if (intersects(octrees[i]->bounds, bounds))
             {
                // Accumulate search results.
-               boid = search(i, object->position, Boid::visibilityRange);
-               while (boid != NULL)
-               {
-                  boid2      = boid->next;
-                  boid->next = boidList;
-                  boidList   = boid;
-                  boid       = boid2;
-               }
+               search(i, object->position, Boid::visibilityRange, &neighborBuffer, object);
             }
          }
 
          // Update boid based on search results.
          boid = (Boid *)object->client;
-         boid->aim(boidList);
+         boid->aim(neighborBuffer.neighbors, neighborBuffer.size);
+      }
+   }
+
+   // Ghosts are valid for this tick only.
+   if (searchMode == HALO_SEARCH)
+   {
+      clearGhosts();
+   }
+   tickStats.stop(TickStats::AIM_PHASE, start);
+
+   // Report update done to master.
+   ready();
+}
+
+
+// Aim a processor using batched remote searches.
+// All the searches from this processor to a remote processor travel
+// in one message, so each processor pair costs one round trip.
+void ProcessorSet::aimBatch(int proc)
+{
+   register int       i, j, count;
+   register OctObject *object;
+   register Boid      *boid;
+   OctObject          **objects;
+   Octree::BOUNDS     bounds;
+   float              radius;
+
+#ifdef UNIX
+   int        operation, pending, total, header[2], *results;
+   BOIDRECORD *record;
+   TIME       start;
+#endif
+
+   // Snapshot local objects.
+   // Neighbor buffers are kept between ticks to reuse their storage.
+   objects = new OctObject *[octrees[proc]->load + 1];
+#ifdef _DEBUG
+   assert(objects != NULL);
+#endif
+   if (batchCapacity < octrees[proc]->load)
+   {
+      delete [] batchNeighbors;
+      batchCapacity  = octrees[proc]->load * 2;
+      batchNeighbors = new NeighborBuffer[batchCapacity];
+#ifdef _DEBUG
+      assert(batchNeighbors != NULL);
+#endif
+   }
+   for (object = octrees[proc]->objects, count = 0; object != NULL;
+        object = object->next, count++)
+   {
+      objects[count] = object;
+      batchNeighbors[count].clear();
+   }
+   radius = (float)Boid::visibilityRange;
+
+   // Send batched searches to remote processors.
+#ifdef UNIX
+   for (i = pending = 0; i < numProcs; i++)
+   {
+      if (ptids[i] == tid)
+      {
+         continue;
+      }
+      if (searchBatch(proc, i, objects, count, radius))
+      {
+         pending++;
+      }
+   }
+#endif
 
-         // Free search elements.
-         while (boidList != NULL)
+   // Do local searches while remote searches are in progress.
+   for (j = 0; j < count; j++)
+   {
+      object      = objects[j];
+      bounds.xmin = object->position.m_x - radius;
+      bounds.xmax = object->position.m_x + radius;
+      bounds.ymin = object->position.m_y - radius;
+      bounds.ymax = object->position.m_y + radius;
+      bounds.zmin = object->position.m_z - radius;
+      bounds.zmax = object->position.m_z + radius;
+      for (i = 0; i < numProcs; i++)
+      {
+         if ((ptids[i] == tid) && intersects(octrees[i]->bounds, bounds))
          {
-            boid     = boidList;
-            boidList = boidList->next;
-            delete boid;
+            search(i, object->position, radius, &batchNeighbors[j], object);
+         }
+      }
+   }
+
+   // Gather remote search results.
+#ifdef UNIX
+   start = tickStats.start();
+   while (pending > 0)
+   {
+      transport->receive(-1);
+      msgRcv++;
+      transport->unpackInt(&operation, 1);
+      switch (operation)
+      {
+      case SEARCH_BATCH_RESULT:
+         break;
+
+      case QUIT:
+         quit();
+
+      default:
+         // Serve client request.
+         serveClient(operation);
+         continue;
+      }
+
+      // Unpack search results: processor and number of searches,
+      // the object index and result count of each search, then the
+      // results of all searches.
+      transport->unpackInt(header, 2);
+#ifdef _DEBUG
+      assert(header[0] == proc);
+#endif
+      results = new int[(header[1] * 2) + 1];
+#ifdef _DEBUG
+      assert(results != NULL);
+#endif
+      transport->unpackInt(results, header[1] * 2);
+      for (i = total = 0; i < header[1]; i++)
+      {
+         total += results[(i * 2) + 1];
+      }
+      record = unpackRecords(total, proc);
+      for (i = 0; i < header[1]; i++)
+      {
+#ifdef _DEBUG
+         assert(results[i * 2] >= 0 && results[i * 2] < count);
+#endif
+         for (j = results[(i * 2) + 1]; j > 0; j--, record++)
+         {
+            getNeighbor(record, batchNeighbors[results[i * 2]].append());
+         }
+      }
+      delete [] results;
+      pending--;
+   }
+   tickStats.stop(TickStats::SEARCH_PHASE, start);
+#endif
+
+   // Update boids based on search results.
+   for (j = 0; j < count; j++)
+   {
+      boid = (Boid *)objects[j]->client;
+      boid->aim(batchNeighbors[j].neighbors, batchNeighbors[j].size);
+   }
+   delete [] objects;
+}
+
+
+// Move boids.
+void ProcessorSet::move()
+{
+   register int       i, proc;
+   register OctObject *object, *object2;
+   register Boid      *boid;
+   Vector             position;
+   TIME               phaseStart, start;
+
+   phaseStart = tickStats.start();
+   for (proc = 0; proc < numProcs; proc++)
+   {
+      // Update local objects.
+      if (ptids[proc] != tid)
+      {
+         continue;
+      }
+
+      octrees[proc]->beginMoves();
+      for (object = octrees[proc]->objects; object != NULL; object = object2)
+      {
+         object2 = object->next;
+         boid    = (Boid *)object->client;
+         boid->move();
+         position = boid->getPosition();
+         if (!object->move((float)position.x, (float)position.y, (float)position.z))
+         {
+            // Boid migrating processors.
+            octrees[proc]->load--;
+            octrees[proc]->unlink(object);
+            tickStats.count(proc, TickStats::MIGRATIONS_COUNT);
+            for (i = 0; i < numProcs; i++)
+            {
+               if (i == proc)
+               {
+                  continue;
+               }
+               if (object->isInside(octrees[i]))
+               {
+                  start = tickStats.start();
+                  insert(i, boid);
+                  tickStats.stop(TickStats::INSERT_PHASE, start);
+                  break;
+               }
+            }
+#ifdef _DEBUG
+            assert(i < numProcs);
+#endif
+            octrees[proc]->deleteObject(object);
          }
       }
+      endMoves(proc);
+   }
+   tickStats.stop(TickStats::MOVE_PHASE, phaseStart);
+   tickStats.tick();
+
+   // Report update done to master.
+   ready();
+}
+
+
+// End a round of moves of a partition.
+// A bulk rebuild is charged to its own phase.
+void ProcessorSet::endMoves(int proc)
+{
+   Octree *tree = octrees[proc];
+   TIME   start;
+
+   if (tree->rebuilding)
+   {
+      start = tickStats.start();
+      tree->endMoves();
+      tickStats.stop(TickStats::REBUILD_PHASE, start);
+      tickStats.count(proc, TickStats::REBUILDS_COUNT);
+   }
+   else
+   {
+      tree->endMoves();
+   }
+   tickStats.count(proc, TickStats::RELINKS_COUNT, tree->relinks);
+}
+
+
+// Report load.
+void ProcessorSet::report()
+{
+   int  operation, proc;
+   TIME start;
+
+   operation = REPORT_RESULT;
+   for (proc = 0; proc < numProcs; proc++)
+   {
+#ifdef UNIX
+      if (ptids[proc] != tid)
+      {
+         continue;
+      }
+      transport->initSend();
+      transport->packInt(&operation, 1);
+      transport->packInt(&proc, 1);
+      transport->packInt(&(octrees[proc]->load), 1);
+      start = tickStats.start();
+      octrees[proc]->findMedian();
+      tickStats.stop(TickStats::MEDIAN_PHASE, start);
+      transport->packFloat(&(octrees[proc]->median.m_x), 1);
+      transport->packFloat(&(octrees[proc]->median.m_y), 1);
+      transport->packFloat(&(octrees[proc]->median.m_z), 1);
+      transport->send(transport->parentTid());
+#endif
+   }
+}
+
+
+// Report statistics: messages sent and received, and load.
+void ProcessorSet::stats()
+{
+   int proc, values[3];
+
+#ifdef UNIX
+   values[0] = msgSent;
+   values[1] = msgRcv;
+   for (proc = 0, values[2] = 0; proc < numProcs; proc++)
+   {
+      if (ptids[proc] != tid)
+      {
+         continue;
+      }
+      values[2] += octrees[proc]->load;
+   }
+   transport->contribute(values, 3);
+#endif
+   msgSent = msgRcv = 0;
+}
+
+
+// Report readiness of local processors to master.
+void ProcessorSet::ready()
+{
+#ifdef UNIX
+   int proc, count;
+
+   for (proc = count = 0; proc < numProcs; proc++)
+   {
+      if (ptids[proc] == tid)
+      {
+         count++;
+      }
+   }
+   transport->contribute(&count, 1);
+#endif
+}
+
+
+// Write tick statistics and quit.
+void ProcessorSet::quit()
+{
+   char buf[100];
+   FILE *fp;
+   int  done;
+
+   sprintf(buf, TICKSTATS_FILE, tid);
+   if ((fp = fopen(buf, "w")) != NULL)
+   {
+      tickStats.dump(fp);
+      fclose(fp);
    }
+#ifdef UNIX
+   // Tell the master the statistics are written.
+   done = 1;
+   transport->contribute(&done, 1);
+   transport->exit();
+#endif
+   exit(0);
+}
+
+
+// Insert boid into a processor.
+bool ProcessorSet::insert(int proc, Boid *boid)
+{
+   if (ptids[proc] == tid)
+   {
+      // Local insert.
+      Vector    position = boid->getPosition();
+      OctObject *object  = octrees[proc]->newObject((float)(position.x),
+                                                    (float)(position.y), (float)(position.z), (void *)boid);
+      if (!octrees[proc]->insert(object))
+      {
+         octrees[proc]->deleteObject(object);
+         return(false);
+      }
+      tickStats.count(proc, TickStats::ALLOCATIONS_COUNT);
+      return(true);
+   }
+   else
+   {
+      // Send remote insert.
+#ifdef UNIX
+      int        header[2];
+      BOIDRECORD record;
+
+      transport->initSend();
+      header[0] = INSERT;
+      header[1] = proc;
+      transport->packInt(header, 2);
+      getRecord(boid, &record);
+      packRecords(&record, 1, ptids[proc], &(octrees[proc]->bounds));
+      transport->send(ptids[proc]);
+      msgSent++;
+
+      // Boid leaves this slave.
+      forgetAttributes(record.number);
+#endif
+      // Delete boid.
+      delete boid;
+
+      // For speed, assume successful.
+      return(true);
+   }
+}
+
+
+// Search a local processor, or a remote processor's ghosts.
+// Matching objects are left in the search buffer; returns their number.
+int ProcessorSet::searchLocal(int proc, Point3D point, float radius, OctObject *anchor)
+{
+   TIME start;
+
+   start = tickStats.start();
+   searchBuffer.clear();
+   if ((ptids[proc] == tid) && (anchor != NULL))
+   {
+      octrees[proc]->search(anchor, radius, &searchBuffer);
+   }
+   else if (ptids[proc] == tid)
+   {
+      octrees[proc]->search(point, radius, &searchBuffer);
+   }
+   else
+   {
+      ghosts[proc]->search(point, radius, &searchBuffer);
+   }
+   tickStats.stop(TickStats::SEARCH_PHASE, start);
+   tickStats.count(proc, TickStats::QUERIES_COUNT);
+   tickStats.count(proc, TickStats::NEIGHBORS_COUNT, searchBuffer.size);
+   return(searchBuffer.size);
+}
+
+
+// Search a processor.
+// Appends views of matching boids to the neighbor buffer.
+void ProcessorSet::search(int proc, Point3D point, float radius,
+                          NeighborBuffer *neighbors, OctObject *anchor)
+{
+   register int i, size;
+
+   // Local search?
+   if ((ptids[proc] == tid) || (searchMode == HALO_SEARCH))
+   {
+      // Local search, or search of remote processor's ghosts.
+      size = neighbors->capacity;
+      searchLocal(proc, point, radius, anchor);
+      for (i = 0; i < searchBuffer.size; i++)
+      {
+         neighbors->append((Boid *)searchBuffer.objects[i]->client);
+      }
+      if (neighbors->capacity != size)
+      {
+         tickStats.count(proc, TickStats::ALLOCATIONS_COUNT);
+      }
+   }
+   else
+   {
+      // Remote search.
+#ifdef UNIX
+      int        operation, header[3], count, total;
+      float      query[4];
+      BOIDRECORD *record;
+      TIME       start;
+
+      start = tickStats.start();
+      transport->initSend();
+      header[0] = SEARCH;
+      header[1] = tid;
+      header[2] = proc;
+      transport->packInt(header, 3);
+      query[0] = point.m_x;
+      query[1] = point.m_y;
+      query[2] = point.m_z;
+      query[3] = radius;
+      transport->packFloat(query, 4);
+      transport->send(ptids[proc]);
+      msgSent++;
+
+      // Get search results.
+      for (count = 0, total = -1; (total == -1) || (count < total); )
+      {
+         transport->receive(-1);
+         msgRcv++;
+         transport->unpackInt(&operation, 1);
+         switch (operation)
+         {
+         case SEARCH_RESULT:
+            break;
+
+         case QUIT:
+            quit();
+
+         default:
+            // Serve client request.
+            serveClient(operation);
+            continue;
+         }
+
+         // Unpack search result frame.
+         transport->unpackInt(header, 2);
+         total  = header[0];
+         size   = header[1];
+         record = unpackRecords(size, proc);
+         for (i = 0; i < size; i++)
+         {
+            getNeighbor(&record[i], neighbors->append());
+         }
+         count += size;
+      }
+      tickStats.stop(TickStats::SEARCH_PHASE, start);
+#endif
+   }
+}
+
+
+// Send a batch of searches to a remote processor.
+// Returns false if no search intersects the processor.
+bool ProcessorSet::searchBatch(int proc, int remote, OctObject **objects,
+                               int count, float radius)
+{
+#ifdef UNIX
+   register int       i, size;
+   register OctObject *object;
+   Octree::BOUNDS     bounds;
+   bool               *hits;
+   int                header[5];
+   QUERYRECORD        *queries;
+
+   // Select searches intersecting the remote processor.
+   hits = new bool[count + 1];
+#ifdef _DEBUG
+   assert(hits != NULL);
+#endif
+   for (i = size = 0; i < count; i++)
+   {
+      object      = objects[i];
+      bounds.xmin = object->position.m_x - radius;
+      bounds.xmax = object->position.m_x + radius;
+      bounds.ymin = object->position.m_y - radius;
+      bounds.ymax = object->position.m_y + radius;
+      bounds.zmin = object->position.m_z - radius;
+      bounds.zmax = object->position.m_z + radius;
+      hits[i]     = intersects(octrees[remote]->bounds, bounds);
+      if (hits[i])
+      {
+         size++;
+      }
+   }
+   if (size == 0)
+   {
+      delete [] hits;
+      return(false);
+   }
+
+   // Send searches.
+   queries = new QUERYRECORD[size];
+#ifdef _DEBUG
+   assert(queries != NULL);
+#endif
+   for (i = size = 0; i < count; i++)
+   {
+      if (hits[i])
+      {
+         object                    = objects[i];
+         queries[size].index       = i;
+         queries[size].position[0] = object->position.m_x;
+         queries[size].position[1] = object->position.m_y;
+         queries[size].position[2] = object->position.m_z;
+         size++;
+      }
+   }
+   transport->initSend();
+   header[0] = SEARCH_BATCH;
+   header[1] = tid;
+   header[2] = proc;
+   header[3] = remote;
+   header[4] = size;
+   transport->packInt(header, 5);
+   transport->packFloat(&radius, 1);
+   transport->packInt((int *)queries, size * QUERY_RECORD_WORDS);
+   transport->send(ptids[remote]);
+   msgSent++;
+   delete [] queries;
+   delete [] hits;
+   return(true);
+
+#else
+   return(false);
+#endif
+}
+
+
+// Send ghost copies of boids near remote processors.
+// Each local processor sends one message to each remote slave having a
+// processor within visibility range, even if no boids qualify, so that
+// the receiver knows how many messages to expect.
+void ProcessorSet::sendGhosts()
+{
+#ifdef UNIX
+   register int       i, j, proc, count;
+   register OctObject *object;
+   Octree::BOUNDS     bounds;
+   BOIDRECORD         *halo;
+   float              range;
+   int                header[3];
+
+   range     = (float)Boid::visibilityRange;
+   header[0] = GHOSTS;
+   for (proc = 0; proc < numProcs; proc++)
+   {
+      if (ptids[proc] != tid)
+      {
+         continue;
+      }
+      halo = growRecords(octrees[proc]->load);
+      for (i = 0; i < numProcs; i++)
+      {
+         // One message per remote slave.
+         if (ptids[i] == tid)
+         {
+            continue;
+         }
+         for (j = 0; j < i; j++)
+         {
+            if (ptids[j] == ptids[i])
+            {
+               break;
+            }
+         }
+         if (j < i)
+         {
+            continue;
+         }
+         for (j = 0; j < numProcs; j++)
+         {
+            if ((ptids[j] == ptids[i]) && haloIntersects(proc, j))
+            {
+               break;
+            }
+         }
+         if (j == numProcs)
+         {
+            continue;
+         }
+
+         // Collect boids within range of the slave's processors.
+         for (object = octrees[proc]->objects, count = 0;
+              object != NULL; object = object->next)
+         {
+            for (j = 0; j < numProcs; j++)
+            {
+               if (ptids[j] != ptids[i])
+               {
+                  continue;
+               }
+               bounds = octrees[j]->bounds;
+               if ((object->position.m_x >= (bounds.xmin - range)) &&
+                   (object->position.m_x <= (bounds.xmax + range)) &&
+                   (object->position.m_y >= (bounds.ymin - range)) &&
+                   (object->position.m_y <= (bounds.ymax + range)) &&
+                   (object->position.m_z >= (bounds.zmin - range)) &&
+                   (object->position.m_z <= (bounds.zmax + range)))
+               {
+                  getRecord((Boid *)object->client, &halo[count]);
+                  count++;
+                  break;
+               }
+            }
+         }
+
+         // Send ghosts.
+         transport->initSend();
+         header[1] = proc;
+         header[2] = count;
+         transport->packInt(header, 3);
+         packRecords(halo, count, ptids[i]);
+         transport->send(ptids[i]);
+         msgSent++;
+      }
+   }
+#endif
+}
+
+
+// Receive ghosts from remote processors.
+// Ghosts may already have arrived through serveClient.
+void ProcessorSet::gatherGhosts()
+{
+#ifdef UNIX
+   register int i, proc, expected;
+   int          operation;
+
+   for (i = expected = 0; i < numProcs; i++)
+   {
+      if (ptids[i] == tid)
+      {
+         continue;
+      }
+      for (proc = 0; proc < numProcs; proc++)
+      {
+         if ((ptids[proc] == tid) && haloIntersects(i, proc))
+         {
+            expected++;
+            break;
+         }
+      }
+   }
+   while (ghostsReceived < expected)
+   {
+      transport->receive(-1);
+      msgRcv++;
+      transport->unpackInt(&operation, 1);
+      if (operation == QUIT)
+      {
+         quit();
+      }
+      serveClient(operation);
+   }
+#endif
+}
+
+
+// Delete received ghosts.
+void ProcessorSet::clearGhosts()
+{
+   register int       proc;
+   register OctObject *object;
+
+   for (proc = 0; proc < numProcs; proc++)
+   {
+      if (ghosts[proc] == NULL)
+      {
+         continue;
+      }
+      for (object = ghosts[proc]->objects; object != NULL; object = object->next)
+      {
+         delete (Boid *)object->client;
+      }
+      ghosts[proc]->clear();
+   }
+   ghostsReceived = 0;
+}
+
+
+// Processor is within visibility range of another's bounds?
+bool ProcessorSet::haloIntersects(int proc, int proc2)
+{
+   Octree::BOUNDS bounds;
+   float          range;
+
+   range       = (float)Boid::visibilityRange;
+   bounds      = octrees[proc2]->bounds;
+   bounds.xmin = bounds.xmin - range;
+   bounds.xmax = bounds.xmax + range;
+   bounds.ymin = bounds.ymin - range;
+   bounds.ymax = bounds.ymax + range;
+   bounds.zmin = bounds.zmin - range;
+   bounds.zmax = bounds.zmax + range;
+   return(intersects(octrees[proc]->bounds, bounds));
+}
+
+
+// Record boid state.
+void ProcessorSet::getRecord(Boid *boid, BOIDRECORD *record)
+{
+   Vector v;
+
+   v = boid->getPosition();
+   record->position[0] = (float)(v.x);
+   record->position[1] = (float)(v.y);
+   record->position[2] = (float)(v.z);
+   v = boid->getVelocity();
+   record->velocity[0] = (float)(v.x);
+   record->velocity[1] = (float)(v.y);
+   record->velocity[2] = (float)(v.z);
+   v = boid->getDimensions();
+   record->dimensions[0] = (float)(v.x);
+   record->dimensions[1] = (float)(v.y);
+   record->dimensions[2] = (float)(v.z);
+   record->type          = boid->getBoidType();
+   record->number        = boid->getBoidNumber();
+}
+
+
+// New boid from record.
+Boid *ProcessorSet::newBoid(BOIDRECORD *record)
+{
+   Vector pos, vel, dim;
+   Boid   *boid;
+
+   pos.x = (double)record->position[0];
+   pos.y = (double)record->position[1];
+   pos.z = (double)record->position[2];
+   vel.x = (double)record->velocity[0];
+   vel.y = (double)record->velocity[1];
+   vel.z = (double)record->velocity[2];
+   dim.x = (double)record->dimensions[0];
+   dim.y = (double)record->dimensions[1];
+   dim.z = (double)record->dimensions[2];
+   boid  = new Boid(pos, vel, dim, record->type, record->number);
+#ifdef _DEBUG
+   assert(boid != NULL);
+#endif
+   return(boid);
+}
+
+
+// Neighbor view of a boid record.
+// Dimensions are not used by the steering functions and are skipped.
+void ProcessorSet::getNeighbor(BOIDRECORD *record, BoidNeighbor *neighbor)
+{
+   neighbor->position.x = (double)record->position[0];
+   neighbor->position.y = (double)record->position[1];
+   neighbor->position.z = (double)record->position[2];
+   neighbor->velocity.x = (double)record->velocity[0];
+   neighbor->velocity.y = (double)record->velocity[1];
+   neighbor->velocity.z = (double)record->velocity[2];
+   neighbor->boidType   = record->type;
+   neighbor->boidNumber = record->number;
+}
+
+
+// Grow the record buffer, keeping its contents.
+ProcessorSet::BOIDRECORD *ProcessorSet::growRecords(int count)
+{
+   BOIDRECORD *buffer;
+
+   if (count > recordCapacity)
+   {
+      buffer = new BOIDRECORD[count * 2];
+#ifdef _DEBUG
+      assert(buffer != NULL);
+#endif
+      if (records != NULL)
+      {
+         memcpy(buffer, records, recordCapacity * sizeof(BOIDRECORD));
+         delete [] records;
+      }
+      records        = buffer;
+      recordCapacity = count * 2;
+   }
+   return(records);
+}
+
+
+// Pack boid records into send buffer.
+// Encoding and attribute count words lead the records. Compact records
+// follow the quantization bounds, unless known to the receiver, and
+// speed. Then come the attributes the receiver has not been sent,
+// and the boid states.
+// Floats travel as 32-bit words, which PVM's encoding preserves
+// between IEEE hosts.
+void ProcessorSet::packRecords(BOIDRECORD *records, int count, int tid,
+                               Octree::BOUNDS *bounds)
+{
+#ifdef UNIX
+   register int    i;
+   int             header[2], slot, *words, recordWords, identity;
+   int             check[COMPACT_RECORD_WORDS];
+   float           speed, position[3], velocity[3];
+   BOIDRECORD      *record;
+   ATTRIBUTERECORD *attribute;
+   STATERECORD     *state;
+   QUANTIZATION    quantization;
+
+   // Compact records within error bound?
+   header[0] = FULL_ENCODING;
+   if ((wireError > 0.0f) && (count > 0))
+   {
+      for (i = 0; i < count; i++)
+      {
+         record = &records[i];
+         if ((bounds != NULL) && !insideBounds(bounds, record->position))
+         {
+            break;
+         }
+         extendRange(&quantization.bounds, &speed, record->position,
+                     record->velocity, i == 0);
+      }
+      if ((i == count) &&
+          setQuantization(&quantization, (bounds == NULL ? quantization.bounds : *bounds),
+                          speed, wireError))
+      {
+         header[0] = COMPACT_ENCODING;
+      }
+
+      // Decoded positions must stay inside the receiver's bounds,
+      // which exclude their maxima.
+      if ((header[0] == COMPACT_ENCODING) && (bounds != NULL))
+      {
+         for (i = 0; i < count; i++)
+         {
+            encodeCompact(&quantization, records[i].position, records[i].velocity,
+                          records[i].number, check);
+            decodeCompact(&quantization, check, position, velocity, &identity);
+            if (!insideBounds(bounds, position))
+            {
+               header[0] = FULL_ENCODING;
+               break;
+            }
+         }
+      }
+   }
+   recordWords = (header[0] == COMPACT_ENCODING ? COMPACT_RECORD_WORDS : STATE_RECORD_WORDS);
+
+   // Attributes not yet sent to receiver.
+   // A boid may recur in a batch, so the count is known when done.
+   slot      = attributeSlot(tid);
+   words     = growWireWords(count * (ATTRIBUTE_RECORD_WORDS + recordWords));
+   attribute = (ATTRIBUTERECORD *)words;
+   for (i = header[1] = 0; i < count; i++)
+   {
+      record = &records[i];
+      growAttributes(record->number);
+      if (!attributesSent[(record->number * numProcs) + slot])
+      {
+         attributesSent[(record->number * numProcs) + slot] = 1;
+         attribute->number        = record->number;
+         attribute->type          = record->type;
+         attribute->dimensions[0] = record->dimensions[0];
+         attribute->dimensions[1] = record->dimensions[1];
+         attribute->dimensions[2] = record->dimensions[2];
+         attribute++;
+         header[1]++;
+      }
+   }
+
+   // Boid states.
+   words = (int *)attribute;
+   if (header[0] == COMPACT_ENCODING)
+   {
+      for (i = 0; i < count; i++)
+      {
+         encodeCompact(&quantization, records[i].position, records[i].velocity,
+                       records[i].number, &words[i * COMPACT_RECORD_WORDS]);
+      }
+   }
+   else
+   {
+      state = (STATERECORD *)words;
+      for (i = 0; i < count; i++, state++)
+      {
+         record = &records[i];
+         memcpy(state->position, record->position, sizeof(state->position));
+         memcpy(state->velocity, record->velocity, sizeof(state->velocity));
+         state->number = record->number;
+      }
+   }
+
+   transport->packInt(header, 2);
+   if (header[0] == COMPACT_ENCODING)
+   {
+      if (bounds == NULL)
+      {
+         transport->packFloat(&quantization.bounds.xmin, 6);
+      }
+      transport->packFloat(&quantization.speed, 1);
+   }
+   transport->packInt(wireWords, (header[1] * ATTRIBUTE_RECORD_WORDS) + (count * recordWords));
+#endif
+}
+
+
+// Unpack boid records from receive buffer into the record buffer.
+ProcessorSet::BOIDRECORD *ProcessorSet::unpackRecords(int count, int proc,
+                                                      Octree::BOUNDS *bounds)
+{
+#ifdef UNIX
+   register int    i;
+   int             header[2], *words, recordWords, number;
+   float           speed;
+   BOIDRECORD      *record;
+   ATTRIBUTERECORD *attribute;
+   STATERECORD     *state;
+   QUANTIZATION    quantization;
+#endif
+
+   growRecords(count);
+#ifdef UNIX
+   transport->unpackInt(header, 2);
+#ifdef _DEBUG
+   assert(header[0] == FULL_ENCODING || header[0] == COMPACT_ENCODING);
+   assert(header[1] >= 0 && header[1] <= count);
+#endif
+   if (header[0] == COMPACT_ENCODING)
+   {
+      if (bounds == NULL)
+      {
+         transport->unpackFloat(&quantization.bounds.xmin, 6);
+      }
+      else
+      {
+         quantization.bounds = *bounds;
+      }
+      transport->unpackFloat(&speed, 1);
+      setQuantization(&quantization, quantization.bounds, speed, 0.0f);
+      recordWords = COMPACT_RECORD_WORDS;
+   }
+   else
+   {
+      recordWords = STATE_RECORD_WORDS;
+   }
+   words = growWireWords((header[1] * ATTRIBUTE_RECORD_WORDS) + (count * recordWords));
+   transport->unpackInt(words, (header[1] * ATTRIBUTE_RECORD_WORDS) + (count * recordWords));
+
+   // Cache attributes sent.
+   attribute = (ATTRIBUTERECORD *)words;
+   for (i = 0; i < header[1]; i++, attribute++)
+   {
+      growAttributes(attribute->number);
+      attributes[attribute->number] = *attribute;
+   }
+   tickStats.count(proc, TickStats::ATTRIBUTE_MISSES_COUNT, header[1]);
+   tickStats.count(proc, TickStats::ATTRIBUTE_HITS_COUNT, count - header[1]);
+
+   // Boid states.
+   words = (int *)attribute;
+   state = (STATERECORD *)words;
+   for (i = 0; i < count; i++)
+   {
+      record = &records[i];
+      if (header[0] == COMPACT_ENCODING)
+      {
+         decodeCompact(&quantization, &words[i * COMPACT_RECORD_WORDS],
+                       record->position, record->velocity, &number);
+      }
+      else
+      {
+         memcpy(record->position, state[i].position, sizeof(record->position));
+         memcpy(record->velocity, state[i].velocity, sizeof(record->velocity));
+         number = state[i].number;
+      }
+#ifdef _DEBUG
+      assert(number >= 0 && number < attributeCapacity);
+      assert(attributes[number].type != -1);
+#endif
+      attribute             = &attributes[number];
+      record->dimensions[0] = attribute->dimensions[0];
+      record->dimensions[1] = attribute->dimensions[1];
+      record->dimensions[2] = attribute->dimensions[2];
+      record->type          = attribute->type;
+      record->number        = number;
+   }
+#endif
+   return(records);
+}
+
+
+// Grow the wire word buffer.
+int *ProcessorSet::growWireWords(int count)
+{
+   if (count > wireCapacity)
+   {
+      delete [] wireWords;
+      wireCapacity = count * 2;
+      wireWords    = new int[wireCapacity];
+#ifdef _DEBUG
+      assert(wireWords != NULL);
+#endif
+   }
+   return(wireWords);
+}
+
+
+// Grow the attribute cache to hold a boid number.
+void ProcessorSet::growAttributes(int number)
+{
+   register int    i;
+   int             capacity;
+   ATTRIBUTERECORD *cache;
+   unsigned char   *sent;
+
+#ifdef _DEBUG
+   assert(number >= 0);
+#endif
+   if (number < attributeCapacity)
+   {
+      return;
+   }
+   capacity = (number + 1) * 2;
+   cache    = new ATTRIBUTERECORD[capacity];
+   sent     = new unsigned char[capacity * numProcs];
+#ifdef _DEBUG
+   assert(cache != NULL);
+   assert(sent != NULL);
+#endif
+   for (i = 0; i < capacity; i++)
+   {
+      cache[i].type = -1;
+   }
+   memset(sent, 0, capacity * numProcs);
+   if (attributes != NULL)
+   {
+      memcpy(cache, attributes, attributeCapacity * sizeof(ATTRIBUTERECORD));
+      memcpy(sent, attributesSent, attributeCapacity * numProcs);
+      delete [] attributes;
+      delete [] attributesSent;
+   }
+   attributes        = cache;
+   attributesSent    = sent;
+   attributeCapacity = capacity;
+}
+
+
+// Attribute slot of a slave: its first processor.
+int ProcessorSet::attributeSlot(int tid)
+{
+   register int i;
+
+   for (i = 0; i < numProcs; i++)
+   {
+      if (ptids[i] == tid)
+      {
+         return(i);
+      }
+   }
+#ifdef _DEBUG
+   assert(false);
+#endif
+   return(0);
+}
 
-   // Report update done to master.
-   ready();
+
+// Forget which slaves were sent the attributes of a boid.
+void ProcessorSet::forgetAttributes(int number)
+{
+   if (number < attributeCapacity)
+   {
+      memset(&attributesSent[number * numProcs], 0, numProcs);
+   }
 }
 
 
-// Move boids.
-void ProcessorSet::move()
+// Pack visible object records into send buffer.
+// Compact records are relative to bounds sent with them.
+void ProcessorSet::packVisible(Transport *transport, VISIBLERECORD *records,
+                               int count, float error)
 {
-   register int       i, proc;
-   register OctObject *object, *object2;
-   register Boid      *boid;
-   Vector             position;
+#ifdef UNIX
+   register int i;
+   int          encoding, *words;
+   float        speed;
+   QUANTIZATION quantization;
 
-   for (proc = 0; proc < numProcs; proc++)
+   encoding = FULL_ENCODING;
+   if ((error > 0.0f) && (count > 0))
    {
-      // Update local objects.
-      if (ptids[proc] != tid)
+      for (i = 0; i < count; i++)
       {
-         continue;
+         extendRange(&quantization.bounds, &speed, records[i].position,
+                     records[i].velocity, i == 0);
       }
-
-      for (object = octrees[proc]->objects, object2 = NULL; object != NULL; )
+      if (setQuantization(&quantization, quantization.bounds, speed, error))
       {
-         boid = (Boid *)object->client;
-         boid->move();
-         position = boid->getPosition();
-         if (!object->move((float)position.x, (float)position.y, (float)position.z))
-         {
-            // Boid migrating processors.
-            octrees[proc]->load--;
-            if (object2 == NULL)
-            {
-               octrees[proc]->objects = object->next;
-            }
-            else
-            {
-               object2->next = object->next;
-            }
-            object->next = NULL;
-            for (i = 0; i < numProcs; i++)
-            {
-               if (i == proc)
-               {
-                  continue;
-               }
-               if (object->isInside(octrees[i]))
-               {
-                  insert(i, boid);
-                  break;
-               }
-            }
+         encoding = COMPACT_ENCODING;
+      }
+   }
+   transport->packInt(&encoding, 1);
+   if (encoding == FULL_ENCODING)
+   {
+      transport->packInt((int *)records, count * VISIBLE_RECORD_WORDS);
+      return;
+   }
+   transport->packFloat(&quantization.bounds.xmin, 6);
+   transport->packFloat(&quantization.speed, 1);
+   words = new int[count * COMPACT_RECORD_WORDS];
 #ifdef _DEBUG
-            assert(i < numProcs);
+   assert(words != NULL);
 #endif
-            delete object;
-            if (object2 == NULL)
-            {
-               object = octrees[proc]->objects;
-            }
-            else
-            {
-               object = object2->next;
-            }
-         }
-         else
-         {
-            object2 = object;
-            object  = object->next;
-         }
-      }
+   for (i = 0; i < count; i++)
+   {
+      encodeCompact(&quantization, records[i].position, records[i].velocity,
+                    records[i].id, &words[i * COMPACT_RECORD_WORDS]);
    }
-
-   // Report update done to master.
-   ready();
+   transport->packInt(words, count * COMPACT_RECORD_WORDS);
+   delete [] words;
+#endif
 }
 
 
-// Report load.
-void ProcessorSet::report()
+// Unpack visible object records from receive buffer.
+void ProcessorSet::unpackVisible(Transport *transport, VISIBLERECORD *records,
+                                 int count)
 {
-   int operation, proc;
+#ifdef UNIX
+   register int i;
+   int          encoding, *words;
+   float        speed;
+   QUANTIZATION quantization;
 
-   operation = REPORT_RESULT;
-   for (proc = 0; proc < numProcs; proc++)
+   transport->unpackInt(&encoding, 1);
+   if (encoding == FULL_ENCODING)
    {
-#ifdef UNIX
-      if (ptids[proc] != tid)
-      {
-         continue;
-      }
-      pvm_initsend(PvmDataDefault);
-      pvm_pkint(&operation, 1, 1);
-      pvm_pkint(&proc, 1, 1);
-      pvm_pkint(&(octrees[proc]->load), 1, 1);
-      octrees[proc]->findMedian();
-      pvm_pkfloat(&(octrees[proc]->median.m_x), 1, 1);
-      pvm_pkfloat(&(octrees[proc]->median.m_y), 1, 1);
-      pvm_pkfloat(&(octrees[proc]->median.m_z), 1, 1);
-      pvm_send(pvm_parent(), 0);
+      transport->unpackInt((int *)records, count * VISIBLE_RECORD_WORDS);
+      return;
+   }
+#ifdef _DEBUG
+   assert(encoding == COMPACT_ENCODING);
+#endif
+   transport->unpackFloat(&quantization.bounds.xmin, 6);
+   transport->unpackFloat(&speed, 1);
+   setQuantization(&quantization, quantization.bounds, speed, 0.0f);
+   words = new int[count * COMPACT_RECORD_WORDS];
+#ifdef _DEBUG
+   assert(words != NULL);
 #endif
+   transport->unpackInt(words, count * COMPACT_RECORD_WORDS);
+   for (i = 0; i < count; i++)
+   {
+      decodeCompact(&quantization, &words[i * COMPACT_RECORD_WORDS],
+                    records[i].position, records[i].velocity, &records[i].id);
    }
+   delete [] words;
+#endif
 }
 
 
-// Report statistics.
-void ProcessorSet::stats()
+// Send boid or visible object records to a task in frames of at most
+// MAX_FRAME_RECORDS. A frame holds the operation, the total number of
+// records, the number in the frame and its records, so a small result
+// costs one message.
+// Returns the number of frames sent.
+int ProcessorSet::sendFrames(int operation, BOIDRECORD *boids,
+                             VISIBLERECORD *visible, int count, int tid)
 {
-   int operation, proc, load;
+   int frames;
 
-   operation = STATS_RESULT;
 #ifdef UNIX
-   pvm_initsend(PvmDataDefault);
-   pvm_pkint(&operation, 1, 1);
-   pvm_pkint(&msgSent, 1, 1);
-   pvm_pkint(&msgRcv, 1, 1);
-   for (proc = load = 0; proc < numProcs; proc++)
+   int sent, header[3];
+
+   header[0] = operation;
+   header[1] = count;
+   sent      = frames = 0;
+   do
    {
-      if (ptids[proc] != tid)
+      header[2] = count - sent;
+      if (header[2] > MAX_FRAME_RECORDS)
       {
-         continue;
+         header[2] = MAX_FRAME_RECORDS;
+      }
+      transport->initSend();
+      transport->packInt(header, 3);
+      if (visible == NULL)
+      {
+         packRecords(&boids[sent], header[2], tid);
+      }
+      else
+      {
+         packVisible(transport, &visible[sent], header[2], wireError);
       }
-      load += octrees[proc]->load;
+      transport->send(tid);
+      sent += header[2];
+      frames++;
    }
-   pvm_pkint(&load, 1, 1);
-   pvm_send(pvm_parent(), 0);
+   while (sent < count);
+#else
+   frames = 0;
 #endif
-   msgSent = msgRcv = 0;
+   return(frames);
 }
 
 
-// Report readiness to master.
-void ProcessorSet::ready()
+// Set quantization: returns false if it exceeds the error bound
+// (0 = no bound).
+// Rounding to the nearest step errs by at most half a step.
+bool ProcessorSet::setQuantization(QUANTIZATION *quantization,
+                                   Octree::BOUNDS bounds, float speed, float error)
 {
-#ifdef UNIX
-   int operation, proc;
+   register int i;
 
-   operation = READY;
-   for (proc = 0; proc < numProcs; proc++)
+   quantization->bounds    = bounds;
+   quantization->speed     = speed;
+   quantization->step[0]   = (bounds.xmax - bounds.xmin) / 65535.0f;
+   quantization->step[1]   = (bounds.ymax - bounds.ymin) / 65535.0f;
+   quantization->step[2]   = (bounds.zmax - bounds.zmin) / 65535.0f;
+   quantization->speedStep = speed / 32767.0f;
+   if (error <= 0.0f)
    {
-      if (ptids[proc] != tid)
+      return(true);
+   }
+   for (i = 0; i < 3; i++)
+   {
+      if ((quantization->step[i] * 0.5f) > error)
       {
-         continue;
+         return(false);
       }
-      pvm_initsend(PvmDataDefault);
-      pvm_pkint(&operation, 1, 1);
-      pvm_pkint(&proc, 1, 1);
-      pvm_send(pvm_parent(), 0);
    }
-#endif
+   return((quantization->speedStep * 0.5f) <= error);
 }
 
 
-// Insert boid into a processor.
-bool ProcessorSet::insert(int proc, Boid *boid)
+// Position is inside bounds?
+// Bounds include their minima but not their maxima, as in
+// OctObject::isInside.
+bool ProcessorSet::insideBounds(Octree::BOUNDS *bounds, float *position)
 {
-   if (ptids[proc] == tid)
+   return((position[0] >= bounds->xmin) && (position[0] < bounds->xmax) &&
+          (position[1] >= bounds->ymin) && (position[1] < bounds->ymax) &&
+          (position[2] >= bounds->zmin) && (position[2] < bounds->zmax));
+}
+
+
+// Extend bounds and speed to cover a position and velocity.
+void ProcessorSet::extendRange(Octree::BOUNDS *bounds, float *speed,
+                               float *position, float *velocity, bool first)
+{
+   register int i;
+
+   if (first)
    {
-      // Local insert.
-      Vector    position = boid->getPosition();
-      OctObject *object  = new OctObject((float)(position.x),
-                                         (float)(position.y), (float)(position.z), (void *)boid);
-      return(octrees[proc]->insert(object));
+      bounds->xmin = bounds->xmax = position[0];
+      bounds->ymin = bounds->ymax = position[1];
+      bounds->zmin = bounds->zmax = position[2];
+      *speed       = 0.0f;
    }
-   else
+   if (position[0] < bounds->xmin)
    {
-      // Send remote insert.
-      int    i;
-      Vector v;
-      float  x, y, z;
-#ifdef UNIX
-      int operation, result, updated;
-      pvm_initsend(PvmDataDefault);
-      operation = INSERT;
-      pvm_pkint(&operation, 1, 1);
-      pvm_pkint(&proc, 1, 1);
-      v = boid->getPosition();
-      x = (float)(v.x);
-      y = (float)(v.y);
-      z = (float)(v.z);
-      pvm_pkfloat(&x, 1, 1);
-      pvm_pkfloat(&y, 1, 1);
-      pvm_pkfloat(&z, 1, 1);
-      v = boid->getVelocity();
-      x = (float)(v.x);
-      y = (float)(v.y);
-      z = (float)(v.z);
-      pvm_pkfloat(&x, 1, 1);
-      pvm_pkfloat(&y, 1, 1);
-      pvm_pkfloat(&z, 1, 1);
-      v = boid->getDimensions();
-      x = (float)(v.x);
-      y = (float)(v.y);
-      z = (float)(v.z);
-      pvm_pkfloat(&x, 1, 1);
-      pvm_pkfloat(&y, 1, 1);
-      pvm_pkfloat(&z, 1, 1);
-      i = boid->getBoidType();
-      pvm_pkint(&i, 1, 1);
-      i = boid->getBoidNumber();
-      pvm_pkint(&i, 1, 1);
-      pvm_send(ptids[proc], 0);
-      msgSent++;
-#endif
-      // Delete boid.
-      delete boid;
-
-      // For speed, assume successful.
-      return(true);
+      bounds->xmin = position[0];
+   }
+   if (position[0] > bounds->xmax)
+   {
+      bounds->xmax = position[0];
+   }
+   if (position[1] < bounds->ymin)
+   {
+      bounds->ymin = position[1];
+   }
+   if (position[1] > bounds->ymax)
+   {
+      bounds->ymax = position[1];
+   }
+   if (position[2] < bounds->zmin)
+   {
+      bounds->zmin = position[2];
+   }
+   if (position[2] > bounds->zmax)
+   {
+      bounds->zmax = position[2];
+   }
+   for (i = 0; i < 3; i++)
+   {
+      if (fabs(velocity[i]) > *speed)
+      {
+         *speed = (float)fabs(velocity[i]);
+      }
    }
 }
 
 
-// Search a processor.
-// Returns list of matching boids.
-Boid *ProcessorSet::search(int proc, Point3D point, float radius)
+// Quantize a value to 16 bits: unsigned steps from a minimum, or
+// signed steps from zero.
+static unsigned int quantizeUnsigned(float value, float minimum, float step)
 {
-   register OctObject *object;
-   register Boid      *boidList, *boid, *proxyBoid;
+   float code;
 
-   // Local search?
-   if (ptids[proc] == tid)
+   if (step <= 0.0f)
    {
-      // Local search.
-      boidList = NULL;
-      object   = octrees[proc]->search(point, radius);
-      while (object != NULL)
-      {
-         boid      = (Boid *)object->client;
-         proxyBoid = boid->clone();
-#ifdef _DEBUG
-         assert(proxyBoid != NULL);
-#endif
-         proxyBoid->next = boidList;
-         boidList        = proxyBoid;
-         object          = object->retnext;
-      }
-      return(boidList);
+      return(0);
    }
-   else
+   code = ((value - minimum) / step) + 0.5f;
+   if (code <= 0.0f)
    {
-      // Remote search.
-      boidList = NULL;
-#ifdef UNIX
-      register int i;
-      int          operation, result, packets, size;
-      bool         firstpacket;
-      Vector       pos, vel, dim;
-      float        x, y, z;
-      int          type, num;
-
-      pvm_initsend(PvmDataDefault);
-      operation = SEARCH;
-      pvm_pkint(&operation, 1, 1);
-      pvm_pkint(&tid, 1, 1);
-      pvm_pkint(&proc, 1, 1);
-      pvm_pkfloat(&point.m_x, 1, 1);
-      pvm_pkfloat(&point.m_y, 1, 1);
-      pvm_pkfloat(&point.m_z, 1, 1);
-      pvm_pkfloat(&radius, 1, 1);
-      pvm_send(ptids[proc], 0);
-      msgSent++;
+      return(0);
+   }
+   if (code >= 65535.0f)
+   {
+      return(65535);
+   }
+   return((unsigned int)code);
+}
 
-      // Get search results.
-      firstpacket = false;
-      while (!firstpacket || packets > 0)
-      {
-         pvm_recv(-1, 0);
-         msgRcv++;
-         pvm_upkint(&operation, 1, 1);
-         switch (operation)
-         {
-         case SEARCH_RESULT:
-            break;
 
-         case QUIT:
-            pvm_exit();
-            exit(0);
+static unsigned int quantizeSigned(float value, float step)
+{
+   int code;
 
-         default:
-            // Serve client request.
-            serveClient(operation);
-            continue;
-         }
+   if (step <= 0.0f)
+   {
+      return(0);
+   }
+   code = (int)floor((value / step) + 0.5f);
+   if (code < -32767)
+   {
+      code = -32767;
+   }
+   if (code > 32767)
+   {
+      code = 32767;
+   }
+   return((unsigned int)code & 0xffff);
+}
 
-         // Unpack search result packet.
-         if (!firstpacket)
-         {
-            pvm_upkint(&packets, 1, 1);
-            firstpacket = true;
-         }
-         pvm_upkint(&size, 1, 1);
-         for (i = 0; i < size; i++)
-         {
-            pvm_upkfloat(&x, 1, 1);
-            pvm_upkfloat(&y, 1, 1);
-            pvm_upkfloat(&z, 1, 1);
-            pos.x = (double)x;
-            pos.y = (double)y;
-            pos.z = (double)z;
-            pvm_upkfloat(&x, 1, 1);
-            pvm_upkfloat(&y, 1, 1);
-            pvm_upkfloat(&z, 1, 1);
-            vel.x = (double)x;
-            vel.y = (double)y;
-            vel.z = (double)z;
-            pvm_upkfloat(&x, 1, 1);
-            pvm_upkfloat(&y, 1, 1);
-            pvm_upkfloat(&z, 1, 1);
-            dim.x = (double)x;
-            dim.y = (double)y;
-            dim.z = (double)z;
-            pvm_upkint(&type, 1, 1);
-            pvm_upkint(&num, 1, 1);
-            proxyBoid = new Boid(pos, vel, dim, type, num);
-#ifdef _DEBUG
-            assert(proxyBoid != NULL);
-#endif
-            proxyBoid->next = boidList;
-            boidList        = proxyBoid;
-         }
-         packets--;
-      }
-#endif
-      return(boidList);
+
+static float dequantizeSigned(unsigned int code, float step)
+{
+   int value;
+
+   value = (int)(code & 0xffff);
+   if (value >= 32768)
+   {
+      value -= 65536;
    }
+   return((float)value * step);
+}
+
+
+// Encode a compact record.
+// Words: position x and y, position z and velocity x, velocity y and z,
+// each as low and high 16 bits, then the identity.
+void ProcessorSet::encodeCompact(QUANTIZATION *quantization, float *position,
+                                 float *velocity, int identity, int *words)
+{
+   unsigned int px, py, pz;
+
+   px       = quantizeUnsigned(position[0], quantization->bounds.xmin, quantization->step[0]);
+   py       = quantizeUnsigned(position[1], quantization->bounds.ymin, quantization->step[1]);
+   pz       = quantizeUnsigned(position[2], quantization->bounds.zmin, quantization->step[2]);
+   words[0] = (int)(px | (py << 16));
+   words[1] = (int)(pz | (quantizeSigned(velocity[0], quantization->speedStep) << 16));
+   words[2] = (int)(quantizeSigned(velocity[1], quantization->speedStep) |
+                    (quantizeSigned(velocity[2], quantization->speedStep) << 16));
+   words[3] = identity;
+}
+
+
+// Decode a compact record.
+void ProcessorSet::decodeCompact(QUANTIZATION *quantization, int *words,
+                                 float *position, float *velocity, int *identity)
+{
+   unsigned int w0, w1, w2;
+
+   w0          = (unsigned int)words[0];
+   w1          = (unsigned int)words[1];
+   w2          = (unsigned int)words[2];
+   position[0] = quantization->bounds.xmin + ((float)(w0 & 0xffff) * quantization->step[0]);
+   position[1] = quantization->bounds.ymin + ((float)(w0 >> 16) * quantization->step[1]);
+   position[2] = quantization->bounds.zmin + ((float)(w1 & 0xffff) * quantization->step[2]);
+   velocity[0] = dequantizeSigned(w1 >> 16, quantization->speedStep);
+   velocity[1] = dequantizeSigned(w2, quantization->speedStep);
+   velocity[2] = dequantizeSigned(w2 >> 16, quantization->speedStep);
+   *identity   = words[3];
 }
 
 
@@ -635,157 +1875,168 @@ Boid *ProcessorSet::search(int proc, Point3D point, float radius)
 void ProcessorSet::serveClient(int operation)
 {
 #ifdef UNIX
-   int                   i, j, proc, retOp, packets, size, updated, rtid;
-   Vector                pos, vel, dim;
-   int                   type, num;
+   int                   i, j, proc, size, rtid, rproc, count, total;
+   int                   header[4], *results;
+   Vector                pos;
    Point3D               position;
-   float                 radius, x, y, z;
-   register Boid         *boid, *boidList;
+   float                 query[4], radius;
+   register Boid         *boid;
    register OctObject    *object;
    struct Frustum::Plane planes[6];
    struct Frustum        *frustum;
    register VISIBLE      *visibleList, *visibleElem;
+   BOIDRECORD            *record;
+   QUERYRECORD           *queries;
+   VISIBLERECORD         *visible;
 
    switch (operation)
    {
    // Insert.
    case INSERT:
-      pvm_upkint(&proc, 1, 1);
+      transport->unpackInt(&proc, 1);
 #ifdef _DEBUG
       assert(ptids[proc] == tid);
 #endif
-      pvm_upkfloat(&x, 1, 1);
-      pvm_upkfloat(&y, 1, 1);
-      pvm_upkfloat(&z, 1, 1);
-      pos.x = (double)x;
-      pos.y = (double)y;
-      pos.z = (double)z;
-      pvm_upkfloat(&x, 1, 1);
-      pvm_upkfloat(&y, 1, 1);
-      pvm_upkfloat(&z, 1, 1);
-      vel.x = (double)x;
-      vel.y = (double)y;
-      vel.z = (double)z;
-      pvm_upkfloat(&x, 1, 1);
-      pvm_upkfloat(&y, 1, 1);
-      pvm_upkfloat(&z, 1, 1);
-      dim.x = (double)x;
-      dim.y = (double)y;
-      dim.z = (double)z;
-      pvm_upkint(&type, 1, 1);
-      pvm_upkint(&num, 1, 1);
-      boid = new Boid(pos, vel, dim, type, num);
-#ifdef _DEBUG
-      assert(boid != NULL);
-#endif
-      object = new OctObject((float)(pos.x), (float)(pos.y), (float)(pos.z), (void *)boid);
+      boid = newBoid(unpackRecords(1, proc, &(octrees[proc]->bounds)));
+
+      // Boid joins this slave: drop its cached attributes.
+      if (boid->getBoidNumber() < attributeCapacity)
+      {
+         attributes[boid->getBoidNumber()].type = -1;
+      }
+      pos    = boid->getPosition();
+      object = octrees[proc]->newObject((float)(pos.x), (float)(pos.y), (float)(pos.z), (void *)boid);
 #ifdef _DEBUG
       assert(object != NULL);
 #endif
-      octrees[proc]->insert(object);
+      if (!octrees[proc]->insert(object))
+      {
+         // The sender has let the boid go, so it is lost.
+         fprintf(stderr, "Slave %d: remote insert of boid %d into processor %d failed\n",
+                 tid, boid->getBoidNumber(), proc);
+         octrees[proc]->deleteObject(object);
+         delete boid;
+      }
+      else
+      {
+         tickStats.count(proc, TickStats::ALLOCATIONS_COUNT);
+      }
       break;
 
    // Search.
    case SEARCH:
-      pvm_upkint(&rtid, 1, 1);
-      pvm_upkint(&proc, 1, 1);
+      transport->unpackInt(header, 2);
+      rtid = header[0];
+      proc = header[1];
 #ifdef _DEBUG
       assert(ptids[proc] == tid);
 #endif
-      pvm_upkfloat(&position.m_x, 1, 1);
-      pvm_upkfloat(&position.m_y, 1, 1);
-      pvm_upkfloat(&position.m_z, 1, 1);
-      pvm_upkfloat(&radius, 1, 1);
+      transport->unpackFloat(query, 4);
+      position.m_x = query[0];
+      position.m_y = query[1];
+      position.m_z = query[2];
+      radius       = query[3];
 
       // Search.
-      boidList = search(proc, position, radius);
-
-      // Send results.
-      retOp = SEARCH_RESULT;
-      for (boid = boidList, size = 0; boid != NULL;
-           boid = boid->next, size++)
+      size   = searchLocal(proc, position, radius);
+      record = growRecords(size);
+      for (i = 0; i < size; i++)
       {
+         getRecord((Boid *)searchBuffer.objects[i]->client, &record[i]);
       }
-      pvm_initsend(PvmDataDefault);
-      pvm_pkint(&retOp, 1, 1);
-      if ((size % MAX_MESSAGE_ITEMS) == 0)
+
+      // Send results.
+      msgSent += sendFrames(SEARCH_RESULT, record, NULL, size, rtid);
+      break;
+
+   // Batched search.
+   case SEARCH_BATCH:
+      transport->unpackInt(header, 4);
+      rtid  = header[0];
+      rproc = header[1];
+      proc  = header[2];
+      size  = header[3];
+#ifdef _DEBUG
+      assert(ptids[proc] == tid);
+#endif
+      transport->unpackFloat(&radius, 1);
+      queries = new QUERYRECORD[size + 1];
+      results = new int[(size * 2) + 1];
+#ifdef _DEBUG
+      assert(queries != NULL && results != NULL);
+#endif
+      transport->unpackInt((int *)queries, size * QUERY_RECORD_WORDS);
+
+      // Search, collecting the results of all searches.
+      for (i = total = 0; i < size; i++)
       {
-         packets = size / MAX_MESSAGE_ITEMS;
-         if (packets == 0)
+         position.m_x = queries[i].position[0];
+         position.m_y = queries[i].position[1];
+         position.m_z = queries[i].position[2];
+         count        = searchLocal(proc, position, radius);
+         record       = growRecords(total + count);
+         for (j = 0; j < count; j++)
          {
-            packets = 1;
+            getRecord((Boid *)searchBuffer.objects[j]->client, &record[total + j]);
          }
-      }
-      else
-      {
-         packets = size / MAX_MESSAGE_ITEMS;
-         packets++;
-      }
-      pvm_pkint(&packets, 1, 1);
-      for (i = 0; i < packets; i++)
+         results[i * 2]       = queries[i].index;
+         results[(i * 2) + 1] = count;
+         total               += count;
+      }
+
+      // Send all results in one message.
+      transport->initSend();
+      header[0] = SEARCH_BATCH_RESULT;
+      header[1] = rproc;
+      header[2] = size;
+      transport->packInt(header, 3);
+      transport->packInt(results, size * 2);
+      packRecords(records, total, rtid);
+      transport->send(rtid);
+      msgSent++;
+      delete [] queries;
+      delete [] results;
+      break;
+
+   // Ghosts.
+   case GHOSTS:
+      transport->unpackInt(header, 2);
+      proc = header[0];
+      size = header[1];
+#ifdef _DEBUG
+      assert(ptids[proc] != tid);
+#endif
+      ghosts[proc]->setBounds(octrees[proc]->bounds);
+      record = unpackRecords(size, proc);
+      for (i = 0; i < size; i++)
       {
-         for (boid = boidList, size = 0; boid != NULL;
-              boid = boid->next, size++)
-         {
-         }
-         if (size > MAX_MESSAGE_ITEMS)
-         {
-            size = MAX_MESSAGE_ITEMS;
-         }
-         if (i > 0)
-         {
-            pvm_initsend(PvmDataDefault);
-            pvm_pkint(&retOp, 1, 1);
-         }
-         pvm_pkint(&size, 1, 1);
-         for (j = 0; j < size; j++)
+         boid   = newBoid(&record[i]);
+         pos    = boid->getPosition();
+         object = ghosts[proc]->newObject((float)(pos.x), (float)(pos.y), (float)(pos.z), (void *)boid);
+#ifdef _DEBUG
+         assert(object != NULL);
+#endif
+         if (!ghosts[proc]->insert(object))
          {
-            pos  = boidList->getPosition();
-            vel  = boidList->getVelocity();
-            dim  = boidList->getDimensions();
-            type = boidList->getBoidType();
-            num  = boidList->getBoidNumber();
-            x    = (float)(pos.x);
-            y    = (float)(pos.y);
-            z    = (float)(pos.z);
-            pvm_pkfloat(&x, 1, 1);
-            pvm_pkfloat(&y, 1, 1);
-            pvm_pkfloat(&z, 1, 1);
-            x = (float)(vel.x);
-            y = (float)(vel.y);
-            z = (float)(vel.z);
-            pvm_pkfloat(&x, 1, 1);
-            pvm_pkfloat(&y, 1, 1);
-            pvm_pkfloat(&z, 1, 1);
-            x = (float)(dim.x);
-            y = (float)(dim.y);
-            z = (float)(dim.z);
-            pvm_pkfloat(&x, 1, 1);
-            pvm_pkfloat(&y, 1, 1);
-            pvm_pkfloat(&z, 1, 1);
-            pvm_pkint(&type, 1, 1);
-            pvm_pkint(&num, 1, 1);
-            boid     = boidList;
-            boidList = boidList->next;
+            ghosts[proc]->deleteObject(object);
             delete boid;
          }
-         pvm_send(rtid, 0);
-         msgSent++;
       }
+      ghostsReceived++;
       break;
 
    // Search for visible objects.
    case VIEW:
-      pvm_upkint(&proc, 1, 1);
+      transport->unpackInt(&proc, 1);
 #ifdef _DEBUG
       assert(ptids[proc] == tid);
 #endif
       for (i = 0; i < 6; i++)
       {
-         pvm_upkfloat(&planes[i].a, 1, 1);
-         pvm_upkfloat(&planes[i].b, 1, 1);
-         pvm_upkfloat(&planes[i].c, 1, 1);
-         pvm_upkfloat(&planes[i].d, 1, 1);
+         transport->unpackFloat(&planes[i].a, 1);
+         transport->unpackFloat(&planes[i].b, 1);
+         transport->unpackFloat(&planes[i].c, 1);
+         transport->unpackFloat(&planes[i].d, 1);
       }
       frustum = new Frustum(planes);
 #ifdef _DEBUG
@@ -796,58 +2047,29 @@ void ProcessorSet::serveClient(int operation)
       visibleList = searchVisible(frustum);
 
       // Send results.
-      retOp = VIEW_RESULT;
       for (visibleElem = visibleList, size = 0; visibleElem != NULL;
            visibleElem = visibleElem->next, size++)
       {
       }
-      pvm_initsend(PvmDataDefault);
-      pvm_pkint(&retOp, 1, 1);
-      if ((size % MAX_MESSAGE_ITEMS) == 0)
-      {
-         packets = size / MAX_MESSAGE_ITEMS;
-         if (packets == 0)
-         {
-            packets = 1;
-         }
-      }
-      else
-      {
-         packets = size / MAX_MESSAGE_ITEMS;
-         packets++;
-      }
-      pvm_pkint(&packets, 1, 1);
-      for (i = 0; i < packets; i++)
-      {
-         for (visibleElem = visibleList, size = 0; visibleElem != NULL;
-              visibleElem = visibleElem->next, size++)
-         {
-         }
-         if (size > MAX_MESSAGE_ITEMS)
-         {
-            size = MAX_MESSAGE_ITEMS;
-         }
-         if (i > 0)
-         {
-            pvm_initsend(PvmDataDefault);
-            pvm_pkint(&retOp, 1, 1);
-         }
-         pvm_pkint(&size, 1, 1);
-         for (j = 0; j < size; j++)
-         {
-            pvm_pkint(&(visibleList->id), 1, 1);
-            pvm_pkfloat(&(visibleList->position.m_x), 1, 1);
-            pvm_pkfloat(&(visibleList->position.m_y), 1, 1);
-            pvm_pkfloat(&(visibleList->position.m_z), 1, 1);
-            pvm_pkfloat(&(visibleList->velocity.m_x), 1, 1);
-            pvm_pkfloat(&(visibleList->velocity.m_y), 1, 1);
-            pvm_pkfloat(&(visibleList->velocity.m_z), 1, 1);
-            visibleElem = visibleList;
-            visibleList = visibleList->next;
-            delete visibleElem;
-         }
-         pvm_send(pvm_parent(), 0);
-      }
+      visible = new VISIBLERECORD[size + 1];
+#ifdef _DEBUG
+      assert(visible != NULL);
+#endif
+      for (i = 0; i < size; i++)
+      {
+         visible[i].id          = visibleList->id;
+         visible[i].position[0] = visibleList->position.m_x;
+         visible[i].position[1] = visibleList->position.m_y;
+         visible[i].position[2] = visibleList->position.m_z;
+         visible[i].velocity[0] = visibleList->velocity.m_x;
+         visible[i].velocity[1] = visibleList->velocity.m_y;
+         visible[i].velocity[2] = visibleList->velocity.m_z;
+         visibleElem            = visibleList;
+         visibleList            = visibleList->next;
+         delete visibleElem;
+      }
+      sendFrames(VIEW_RESULT, NULL, visible, size, transport->parentTid());
+      delete [] visible;
       break;
 
    default:
@@ -866,7 +2088,9 @@ ProcessorSet::VISIBLE *ProcessorSet::searchVisible(Frustum *frustum)
    register OctObject *object;
    register VISIBLE   *visible, *visibleList;
    Vector             velocity;
+   TIME               start;
 
+   start       = tickStats.start();
    visibleList = NULL;
    for (proc = 0; proc < numProcs; proc++)
    {
@@ -891,6 +2115,7 @@ ProcessorSet::VISIBLE *ProcessorSet::searchVisible(Frustum *frustum)
          }
       }
    }
+   tickStats.stop(TickStats::VISIBLE_PHASE, start);
    return(visibleList);
 }
 
@@ -1654,6 +2879,9 @@ void ProcessorSet::migrate()
 {
    register int       i, proc;
    register OctObject *object;
+   TIME               start;
+
+   start = tickStats.start();
 
    // Cull and migrate boids to appropriate octrees.
    for (proc = 0; proc < numProcs; proc++)
@@ -1674,6 +2902,7 @@ void ProcessorSet::migrate()
          object           = migrations[proc];
          migrations[proc] = object->retnext;
          object->retnext  = NULL;
+         tickStats.count(proc, TickStats::MIGRATIONS_COUNT);
          for (i = 0; i < numProcs; i++)
          {
             if (i == proc)
@@ -1689,7 +2918,8 @@ void ProcessorSet::migrate()
 #ifdef _DEBUG
          assert(i < numProcs);
 #endif
-         delete object;
+         octrees[proc]->deleteObject(object);
       }
    }
+   tickStats.stop(TickStats::MIGRATE_PHASE, start);
 }
@@ -28,16 +28,20 @@
 #define __PROCESSORSET_HPP__
 
 #ifdef UNIX
-#include <pvm3.h>
 #include <pthread.h>
 #endif
 #include "message.h"
+#include "transport.hpp"
 #include "Boid.h"
 #include "octree.hpp"
 #include "frustum.hpp"
+#include "tickStats.hpp"
 
 #define PRECISION    100.0
 
+// Tick statistics file written at quit (%d = task id).
+#define TICKSTATS_FILE    "tickstats_%d.txt"
+
 class ProcessorSet
 {
 public:
@@ -45,6 +49,10 @@ public:
    // Maximum boundary movement rate for load-balancing.
    static const float MAX_BOUNDARY_VELOCITY;
 
+   // Neighbor search modes.
+   typedef enum { DEMAND_SEARCH, BATCH_SEARCH, HALO_SEARCH }
+   SEARCHMODE;
+
    // Load-balancing partitions.
    typedef enum { XCUT, YCUT, ZCUT }
    CUT;
@@ -66,9 +74,70 @@ public:
       struct Visible *next;
    } VISIBLE;
 
+   // Message records, packed as 32-bit words a batch at a time.
+   // Boid and visible object records start with position and velocity.
+   // Boid state.
+   typedef struct
+   {
+      float position[3];
+      float velocity[3];
+      float dimensions[3];
+      int   type;
+      int   number;
+   } BOIDRECORD;
+
+   // Boid state sent between slaves: static attributes are sent
+   // apart, once per boid and receiver.
+   typedef struct
+   {
+      float position[3];
+      float velocity[3];
+      int   number;
+   } STATERECORD;
+
+   // Static boid attributes.
+   typedef struct
+   {
+      int   number;
+      int   type;
+      float dimensions[3];
+   } ATTRIBUTERECORD;
+
+   // Batched search query.
+   typedef struct
+   {
+      int   index;
+      float position[3];
+   } QUERYRECORD;
+
+   // Visible object.
+   typedef struct
+   {
+      float position[3];
+      float velocity[3];
+      int   id;
+   } VISIBLERECORD;
+
+   // Compact record quantization.
+   // Positions are 16-bit fixed point within bounds and velocity
+   // components 16-bit signed fractions of a speed bound.
+   typedef struct
+   {
+      Octree::BOUNDS bounds;
+      float          speed;
+      float          step[3];                     // position step per axis
+      float          speedStep;
+   } QUANTIZATION;
+
    // Constructor.
+   // The transport carries messages to the master and other slaves;
+   // a proxy set without one only load-balances.
    ProcessorSet(int dimension, float span, int numBoids,
-                int *ptids, int tid, int randomSeed);
+                int *ptids, int tid, int randomSeed,
+                Transport *transport = NULL);
+
+   // Receive initialization from the master and create a slave's set.
+   static ProcessorSet *create(Transport *transport);
 
    // Destructor.
    ~ProcessorSet();
@@ -82,6 +151,9 @@ public:
    // Aim: update velocity and determine new position.
    void aim();
 
+   // Aim a processor using batched remote searches.
+   void aimBatch(int proc);
+
    // Move to new position.
    void move();
 
@@ -100,12 +172,104 @@ public:
    // Report ready.
    void ready();
 
+   // Write tick statistics, tell the master, and quit.
+   void quit();
+
    // Insert boid into a processor.
    bool insert(int proc, Boid *boid);
 
+   // Search a local processor, or a remote processor's ghosts.
+   // Matching objects are left in the search buffer; returns their number.
+   // A local search around an object of the processor starts from the
+   // object's node.
+   int searchLocal(int proc, Point3D point, float radius, OctObject *anchor = NULL);
+
    // Search a processor.
-   // Returns list of matching boids.
-   Boid *search(int proc, Point3D point, float radius);
+   // Appends views of matching boids to the neighbor buffer.
+   void search(int proc, Point3D point, float radius, NeighborBuffer *neighbors,
+               OctObject *anchor = NULL);
+
+   // Send a batch of searches to a remote processor.
+   // Returns false if no search intersects the processor.
+   bool searchBatch(int proc, int remote, OctObject **objects,
+                    int count, float radius);
+
+   // Send ghost copies of boids near remote processors.
+   void sendGhosts();
+
+   // Receive ghosts from remote processors.
+   void gatherGhosts();
+
+   // Delete received ghosts.
+   void clearGhosts();
+
+   // Processor is within visibility range of another's bounds?
+   bool haloIntersects(int proc, int proc2);
+
+   // Boid records.
+   void getRecord(Boid *boid, BOIDRECORD *record);
+   Boid *newBoid(BOIDRECORD *record);
+   void getNeighbor(BOIDRECORD *record, BoidNeighbor *neighbor);
+
+   // Grow the record buffer, keeping its contents.
+   BOIDRECORD *growRecords(int count);
+
+   // Pack boid records sent to a task; unpack boid records received
+   // for a processor, into the record buffer.
+   // Positions of compact records are relative to the given bounds,
+   // known to the receiver, or else to bounds sent with them.
+   void packRecords(BOIDRECORD *records, int count, int tid,
+                    Octree::BOUNDS *bounds = NULL);
+   BOIDRECORD *unpackRecords(int count, int proc, Octree::BOUNDS *bounds = NULL);
+
+   // Grow the wire word buffer.
+   int *growWireWords(int count);
+
+   // Static attribute cache.
+   // A slave caches the attributes of boids owned by other slaves by
+   // boid number, and marks the attributes of its own boids as sent
+   // to each slave, so they are sent once. A boid changing slaves has
+   // its marks cleared by the old owner and its cache entry dropped by
+   // the new one.
+   void growAttributes(int number);
+   int attributeSlot(int tid);
+   void forgetAttributes(int number);
+
+   // Pack/unpack visible object records.
+   static void packVisible(Transport *transport, VISIBLERECORD *records,
+                           int count, float error);
+   static void unpackVisible(Transport *transport, VISIBLERECORD *records,
+                             int count);
+
+   // Send boid or visible object records to a task in frames.
+   // Returns the number of frames.
+   int sendFrames(int operation, BOIDRECORD *boids, VISIBLERECORD *visible,
+                  int count, int tid);
+
+   // Compact record encoding.
+   // Compact records hold quantized position and velocity and an
+   // identity word: the boid number or visible object id.
+   // Set quantization: returns false if it exceeds the error bound.
+   static bool setQuantization(QUANTIZATION *quantization,
+                               Octree::BOUNDS bounds, float speed, float error);
+
+   // Position is inside bounds (excluding maxima)?
+   static bool insideBounds(Octree::BOUNDS *bounds, float *position);
+
+   // Extend bounds and speed to cover a position and velocity.
+   static void extendRange(Octree::BOUNDS *bounds, float *speed,
+                           float *position, float *velocity, bool first);
+
+   // Encode/decode a compact record.
+   static void encodeCompact(QUANTIZATION *quantization, float *position,
+                             float *velocity, int identity, int *words);
+   static void decodeCompact(QUANTIZATION *quantization, int *words,
+                             float *position, float *velocity, int *identity);
+
+   // Set wire error bound.
+   // Positions and velocities are sent as compact records when they can
+   // be within this error (0 = full records).
+   void setWireError(float error) { wireError = error; }
 
    // Search for visible local objects.
    VISIBLE *searchVisible(Frustum *frustum);
@@ -116,6 +280,25 @@ public:
    // Set load-balance.
    void setLoadBalance(bool mode) { loadBalance = mode; }
 
+   // Set neighbor search mode.
+   void setSearchMode(SEARCHMODE mode) { searchMode = mode; }
+
+   // Set approximate median mode for load-balancing.
+   void setApproximateMedian(bool mode);
+
+   // Set octree spatial index backend.
+   void setOctreeBackend(Octree::BACKEND backend);
+
+   // Set adaptive octree rebuild threshold.
+   // While more than this fraction of a partition's boids left their
+   // octree nodes in the last move, its octree is rebuilt in bulk
+   // after moving instead of relinking each boid (0 = never).
+   void setRebuildThreshold(float threshold);
+
+   // End a round of moves of a partition, recording relinks and
+   // any bulk rebuild of its octree.
+   void endMoves(int proc);
+
    // Load-balance.
    void balance(int *parray, int rows, int columns, int ranks,
                 CUT cut, Octree::BOUNDS bounds, CENTROID *centroids);
@@ -132,17 +315,42 @@ public:
                             Octree::BOUNDS bounds, Octree::BOUNDS *procBounds);
 
    // Data members.
-   int            dimension;
-   float          span;
-   float          margin;
-   int            numBoids;
-   int            numProcs;
-   Octree         **octrees;
-   OctObject      **migrations;
-   int            *ptids;
-   int            tid;
-   Octree::BOUNDS *newBounds;
-   bool           loadBalance;
-   int            msgSent, msgRcv;
+   int             dimension;
+   float           span;
+   float           margin;
+   int             numBoids;
+   int             numProcs;
+   Octree          **octrees;
+   Octree          **ghosts;
+   OctSearchBuffer searchBuffer;
+   NeighborBuffer  neighborBuffer;
+   NeighborBuffer  *batchNeighbors;
+   int             batchCapacity;
+   BOIDRECORD      *records;
+   int             recordCapacity;
+   int             *wireWords;
+   int             wireCapacity;
+   ATTRIBUTERECORD *attributes;                   // cache; type -1 = unknown
+   unsigned char   *attributesSent;               // by number and slave
+   int             attributeCapacity;
+   float           wireError;
+   int             ghostsReceived;
+   OctObject       **migrations;
+   int             *ptids;
+   int             tid;
+   Transport       *transport;
+   Octree::BOUNDS  *newBounds;
+   bool            loadBalance;
+   SEARCHMODE      searchMode;
+   int             msgSent, msgRcv;
+   TickStats       tickStats;
 };
+
+// Record sizes (words).
+#define BOID_RECORD_WORDS       ((int)(sizeof(ProcessorSet::BOIDRECORD) / sizeof(int)))
+#define STATE_RECORD_WORDS      ((int)(sizeof(ProcessorSet::STATERECORD) / sizeof(int)))
+#define ATTRIBUTE_RECORD_WORDS  ((int)(sizeof(ProcessorSet::ATTRIBUTERECORD) / sizeof(int)))
+#define QUERY_RECORD_WORDS      ((int)(sizeof(ProcessorSet::QUERYRECORD) / sizeof(int)))
+#define VISIBLE_RECORD_WORDS    ((int)(sizeof(ProcessorSet::VISIBLERECORD) / sizeof(int)))
+#define COMPACT_RECORD_WORDS    4
 #endif
@@ -20,6 +20,10 @@
  * File Name : ptree_master.cpp
  *
  * Description : PVM master for parallel octree program.
+ *               With -threads, the slaves run as threads of the master
+ *               process over an in-process transport instead of PVM.
+ *               With -mpi (built with USE_MPI), the master and slaves
+ *               run as MPI tasks: "mpirun -np <slaves + 1> ptree_master -mpi".
  *
  * Environment: MY_PVM set to directory containing ptree_slave and hostfile.
  *
@@ -61,6 +65,12 @@ pthread_cond_t  UpdateCond;
 pthread_mutex_t UpdateMutex;
 #endif
 
+// Quit: the update thread stops the slaves, which write their tick
+// statistics, then the process exits.
+volatile bool QuitRequested = false;
+volatile bool SlavesStopped = false;
+void          quit();
+
 // Random number seed.
 int RandomSeed;
 
@@ -70,6 +80,17 @@ int numMachines;
 #define SLAVE_NAME              "ptree_slave"
 int *Tids;
 
+// Message transport, and in-process slave threads or MPI slave
+// tasks (0 = PVM slaves).
+Transport              *MasterTransport = NULL;
+int                    NumSlaveThreads  = 0;
+int                    NumMpiSlaves     = 0;
+ThreadTransport::Hub   *SlaveHub;
+void                   *slave(void *arg);
+
+// Values gathered from slave machines.
+int *Gathered;
+
 // Per machine message counters.
 bool GetStats = false;
 int  *MsgSent;
@@ -87,6 +108,23 @@ int          Tid, Ptids[NUM_PROCS];
 ProcessorSet *ProxySet;
 bool         LoadBalance = false;
 
+// Neighbor search mode.
+ProcessorSet::SEARCHMODE SearchMode = ProcessorSet::DEMAND_SEARCH;
+
+// Approximate (histogram) medians for load-balancing.
+bool ApproximateMedian = false;
+
+// Octree spatial index backend.
+Octree::BACKEND OctreeBackend = Octree::POINTER_BACKEND;
+
+// Fraction of boids changing octree nodes above which a slave
+// rebuilds its octrees in bulk (0 = never).
+float RebuildThreshold = 0.0f;
+
+// Error bound of quantized boid positions and velocities sent between
+// tasks (0 = full records).
+float WireError = 0.0f;
+
 // Camera.
 #define GUIDE_Z          100.0f
 #define CAMERA_BEHIND    0.25f
@@ -408,10 +446,7 @@ void keyboard(unsigned char key, int x, int y)
          break;
 
       case 'q':                                   // Quit.
-#ifdef UNIX
-         pvm_halt();
-#endif
-         exit(0);
+         quit();
          break;
       }
       break;
@@ -458,15 +493,44 @@ void menu(int value)
       break;
 
    case 2:
-#ifdef UNIX
-      pvm_halt();
-#endif
-      exit(0);
+      quit();
       break;
    }
 }
 
 
+// Quit.
+// Waits for the update thread to stop the slaves.
+void quit()
+{
+#ifdef UNIX
+   QuitRequested = true;
+   while (!SlavesStopped)
+   {
+      pthread_cond_signal(&UpdateCond);
+      usleep(1000);
+   }
+   MasterTransport->finish();
+#endif
+   exit(0);
+}
+
+
+// Stop slaves, waiting until each has written its statistics.
+void stopSlaves()
+{
+#ifdef UNIX
+   int operation;
+
+   operation = QUIT;
+   MasterTransport->initSend();
+   MasterTransport->packInt(&operation, 1);
+   MasterTransport->multicast(Tids, numMachines);
+   MasterTransport->gather(Gathered, 1, Tids, numMachines);
+#endif
+}
+
+
 // Get statistics.
 void getStats()
 {
@@ -475,25 +539,21 @@ void getStats()
    int          operation, sent, rcv, load;
 
    // Request statistics.
-   pvm_initsend(PvmDataDefault);
+   MasterTransport->initSend();
    operation = STATS;
-   pvm_pkint(&operation, 1, 1);
-   pvm_mcast(Tids, numMachines, 0);
+   MasterTransport->packInt(&operation, 1);
+   MasterTransport->multicast(Tids, numMachines);
 
    // Get results.
+   MasterTransport->gather(Gathered, 3, Tids, numMachines);
    for (mach = 0; mach < numMachines; mach++)
    {
-      pvm_recv(Tids[mach], 0);
-      pvm_upkint(&operation, 1, 1);
-#ifdef _DEBUG
-      assert(operation == STATS_RESULT);
-#endif
-      pvm_upkint(&sent, 1, 1);
+      sent           = Gathered[mach * 3];
       MsgSent[mach] += sent;
-      pvm_upkint(&rcv, 1, 1);
-      MsgRcv[mach] += rcv;
-      pvm_upkint(&load, 1, 1);
-      Load[mach] = load;
+      rcv            = Gathered[(mach * 3) + 1];
+      MsgRcv[mach]  += rcv;
+      load           = Gathered[(mach * 3) + 2];
+      Load[mach]     = load;
       fprintf(Statsfp, "%d %d %d %d\n", mach, load, sent, rcv);
       fflush(Statsfp);
    }
@@ -508,8 +568,9 @@ void getVisible()
    register ProcessorSet::VISIBLE *newVisibleList, *visible;
 
 #ifdef UNIX
-   register int i, j, proc;
-   int          operation, result, packets, size;
+   register int                i, j, proc;
+   int                         operation, header[3], count;
+   ProcessorSet::VISIBLERECORD *records;
 #endif
 
    // Camera follows guide.
@@ -536,53 +597,50 @@ void getVisible()
 #ifdef UNIX
    for (proc = 0; proc < NUM_PROCS; proc++)
    {
-      pvm_initsend(PvmDataDefault);
+      MasterTransport->initSend();
       operation = VIEW;
-      pvm_pkint(&operation, 1, 1);
-      pvm_pkint(&proc, 1, 1);
+      MasterTransport->packInt(&operation, 1);
+      MasterTransport->packInt(&proc, 1);
       for (i = 0; i < 6; i++)
       {
-         pvm_pkfloat(&frustum->planes[i].a, 1, 1);
-         pvm_pkfloat(&frustum->planes[i].b, 1, 1);
-         pvm_pkfloat(&frustum->planes[i].c, 1, 1);
-         pvm_pkfloat(&frustum->planes[i].d, 1, 1);
+         MasterTransport->packFloat(&frustum->planes[i].a, 1);
+         MasterTransport->packFloat(&frustum->planes[i].b, 1);
+         MasterTransport->packFloat(&frustum->planes[i].c, 1);
+         MasterTransport->packFloat(&frustum->planes[i].d, 1);
       }
-      pvm_send(Ptids[proc], 0);
+      MasterTransport->send(Ptids[proc]);
 
-      // Get search results.
-      pvm_recv(Ptids[proc], 0);
-      pvm_upkint(&operation, 1, 1);
+      // Get search results, in one or more frames.
+      for (count = 0, header[1] = -1; (header[1] == -1) || (count < header[1]); )
+      {
+         MasterTransport->receive(Ptids[proc]);
+         MasterTransport->unpackInt(header, 3);
 #ifdef _DEBUG
-      assert(operation == VIEW_RESULT);
+         assert(header[0] == VIEW_RESULT);
 #endif
-      pvm_upkint(&packets, 1, 1);
-      for (i = 0; i < packets; i++)
-      {
-         if (i > 0)
-         {
-            pvm_recv(Ptids[proc], 0);
-            pvm_upkint(&operation, 1, 1);
+         records = new ProcessorSet::VISIBLERECORD[header[2] + 1];
 #ifdef _DEBUG
-            assert(operation == VIEW_RESULT);
+         assert(records != NULL);
 #endif
-         }
-         pvm_upkint(&size, 1, 1);
-         for (j = 0; j < size; j++)
+         ProcessorSet::unpackVisible(MasterTransport, records, header[2]);
+         for (j = 0; j < header[2]; j++)
          {
             visible = new ProcessorSet::VISIBLE;
 #ifdef _DEBUG
             assert(visible != NULL);
 #endif
-            pvm_upkint(&(visible->id), 1, 1);
-            pvm_upkfloat(&(visible->position.m_x), 1, 1);
-            pvm_upkfloat(&(visible->position.m_y), 1, 1);
-            pvm_upkfloat(&(visible->position.m_z), 1, 1);
-            pvm_upkfloat(&(visible->velocity.m_x), 1, 1);
-            pvm_upkfloat(&(visible->velocity.m_y), 1, 1);
-            pvm_upkfloat(&(visible->velocity.m_z), 1, 1);
-            visible->next  = newVisibleList;
-            newVisibleList = visible;
+            visible->id           = records[j].id;
+            visible->position.m_x = records[j].position[0];
+            visible->position.m_y = records[j].position[1];
+            visible->position.m_z = records[j].position[2];
+            visible->velocity.m_x = records[j].velocity[0];
+            visible->velocity.m_y = records[j].velocity[1];
+            visible->velocity.m_z = records[j].velocity[2];
+            visible->next         = newVisibleList;
+            newVisibleList        = visible;
          }
+         delete [] records;
+         count += header[2];
       }
    }
 #endif
@@ -607,19 +665,18 @@ void getVisible()
 // Gather ready messages from slaves.
 void gatherReady()
 {
-   int count, operation, proc;
-
 #ifdef UNIX
-   // Collect ready messages.
-   for (count = 0; count < NUM_PROCS; count++)
+   int mach, count;
+
+   // Gather counts of ready processors.
+   MasterTransport->gather(Gathered, 1, Tids, numMachines);
+   for (mach = count = 0; mach < numMachines; mach++)
    {
-      pvm_recv(-1, 0);
-      pvm_upkint(&operation, 1, 1);
+      count += Gathered[mach];
+   }
 #ifdef _DEBUG
-      assert(operation == READY);
+   assert(count == NUM_PROCS);
 #endif
-      pvm_upkint(&proc, 1, 1);
-   }
 #endif
 }
 
@@ -628,54 +685,69 @@ void gatherReady()
 #ifdef UNIX
 void *update(void *arg)
 {
-   int   i, mach, proc, balance, count;
-   int   operation, dimension;
-   float span;
-   char  *pvmdir, hostfile[PATHSIZE + 1];
-   char  machineName[PATHSIZE + 1], slavePath[PATHSIZE + 1];
-   bool  useHostfile;
-   int   argc;
-   char  *argv[1];
-   FILE  *fp;
-   int   *machAssign, *boidAssign;
+   int       i, mach, proc, balance, count;
+   int       operation, dimension, searchMode, approximateMedian, backend;
+   float     span, rebuildThreshold, wireError;
+   char      *pvmdir, hostfile[PATHSIZE + 1];
+   char      machineName[PATHSIZE + 1], slavePath[PATHSIZE + 1];
+   bool      useHostfile;
+   int       argc;
+   char      *argv[1];
+   FILE      *fp;
+   int       *machAssign, *boidAssign;
+   pthread_t slaveThread;
 
    // Get environment.
-   pvmdir = getenv("MY_PVM");
-   if ((pvmdir == NULL) || (*pvmdir == '\0'))
-   {
-      fprintf(stderr, "MY_PVM not set\n");
-      exit(1);
-   }
    argc        = 0;
    argv[0]     = NULL;
    numMachines = DEFAULT_NUM_MACHINES;
    useHostfile = false;
-   sprintf(hostfile, "%s/hostfile", pvmdir);
-   if (access(hostfile, F_OK) == 0)
+   if (NumSlaveThreads > 0)
+   {
+      numMachines = NumSlaveThreads;
+   }
+   else if (NumMpiSlaves > 0)
    {
-      argv[0] = hostfile;
-      argc    = 1;
-      if ((fp = fopen(hostfile, "r")) == NULL)
+      numMachines = NumMpiSlaves;
+   }
+#ifndef USE_MPI
+   else
+   {
+      pvmdir = getenv("MY_PVM");
+      if ((pvmdir == NULL) || (*pvmdir == '\0'))
       {
-         fprintf(stderr, "Cannot open hostfile %s\n", hostfile);
+         fprintf(stderr, "MY_PVM not set\n");
          exit(1);
       }
-      for (numMachines = 0; fscanf(fp, "%s", machineName) == 1; numMachines++)
+      sprintf(hostfile, "%s/hostfile", pvmdir);
+      if (access(hostfile, F_OK) == 0)
       {
+         argv[0] = hostfile;
+         argc    = 1;
+         if ((fp = fopen(hostfile, "r")) == NULL)
+         {
+            fprintf(stderr, "Cannot open hostfile %s\n", hostfile);
+            exit(1);
+         }
+         for (numMachines = 0; fscanf(fp, "%s", machineName) == 1; numMachines++)
+         {
+         }
+         fclose(fp);
+         useHostfile = true;
       }
-      fclose(fp);
-      if ((numMachines < 1) || ((numMachines > 1) && ((numMachines % 2) != 0)))
-      {
-         fprintf(stderr, "Number of machines must be one or even\n");
-         exit(1);
-      }
-      useHostfile = true;
+   }
+#endif
+   if ((numMachines < 1) || ((numMachines > 1) && ((numMachines % 2) != 0)))
+   {
+      fprintf(stderr, "Number of machines must be one or even\n");
+      exit(1);
    }
 
    // Clear message counters.
-   MsgSent = new int[numMachines];
-   MsgRcv  = new int[numMachines];
-   Load    = new int[numMachines];
+   MsgSent  = new int[numMachines];
+   MsgRcv   = new int[numMachines];
+   Load     = new int[numMachines];
+   Gathered = new int[numMachines * 3];
    for (i = 0; i < numMachines; i++)
    {
       MsgSent[i] = MsgRcv[i] = Load[i] = 0;
@@ -697,46 +769,80 @@ void *update(void *arg)
    machAssign = new int[NUM_PROCS];
    ProcessorSet::partition(machAssign, numMachines, DIMENSION);
 
-   // Start PVM
-   if (pvm_start_pvmd(argc, argv, 1) != 0)
+   Tids = new int[numMachines];
+   if (NumSlaveThreads > 0)
    {
-      fprintf(stderr, "Cannot start PVM daemon\n");
-      exit(1);
+      // Start slave threads: the master is task 1.
+      SlaveHub = new ThreadTransport::Hub(numMachines + 1);
+#ifdef _DEBUG
+      assert(SlaveHub != NULL);
+#endif
+      MasterTransport = new ThreadTransport(SlaveHub, 1);
+      Tid             = MasterTransport->myTid();
+      for (mach = 0; mach < numMachines; mach++)
+      {
+         Tids[mach] = mach + 2;
+         if (pthread_create(&slaveThread, NULL, slave, (void *)&Tids[mach]) != 0)
+         {
+            fprintf(stderr, "Cannot create slave thread, errno=%d\n", errno);
+            exit(1);
+         }
+      }
    }
-   Tid = pvm_mytid();
-
-   // Start slaves.
-   sprintf(slavePath, "%s/%s", pvmdir, SLAVE_NAME);
-   Tids = new int[numMachines];
-   if (useHostfile)
+   else if (NumMpiSlaves > 0)
    {
-      if ((fp = fopen(hostfile, "r")) == NULL)
+      // MPI slaves are started with the master: the master is rank 0.
+      Tid = MasterTransport->myTid();
+      for (mach = 0; mach < numMachines; mach++)
       {
-         fprintf(stderr, "Cannot open hostfile %s\n", hostfile);
-         pvm_halt();
-         exit(1);
+         Tids[mach] = mach + 1;
       }
    }
-   for (mach = 0; mach < numMachines; mach++)
+#ifndef USE_MPI
+   else
    {
-      strcpy(machineName, "");
-      if (useHostfile && (fscanf(fp, "%s", machineName) != 1))
+      // Start PVM
+      if (pvm_start_pvmd(argc, argv, 1) != 0)
       {
-         fprintf(stderr, "Error reading hostfile %s\n", hostfile);
-         pvm_halt();
+         fprintf(stderr, "Cannot start PVM daemon\n");
          exit(1);
       }
-      if (pvm_spawn(slavePath, (char **)0, 0, machineName, 1, &Tids[mach]) != 1)
+      MasterTransport = new PvmTransport();
+      Tid             = MasterTransport->myTid();
+
+      // Start slaves.
+      sprintf(slavePath, "%s/%s", pvmdir, SLAVE_NAME);
+      if (useHostfile)
       {
-         fprintf(stderr, "Cannot spawn slave. Error code = %d\n", Tids[i]);
-         pvm_halt();
-         exit(1);
+         if ((fp = fopen(hostfile, "r")) == NULL)
+         {
+            fprintf(stderr, "Cannot open hostfile %s\n", hostfile);
+            MasterTransport->halt();
+            exit(1);
+         }
+      }
+      for (mach = 0; mach < numMachines; mach++)
+      {
+         strcpy(machineName, "");
+         if (useHostfile && (fscanf(fp, "%s", machineName) != 1))
+         {
+            fprintf(stderr, "Error reading hostfile %s\n", hostfile);
+            MasterTransport->halt();
+            exit(1);
+         }
+         if (pvm_spawn(slavePath, (char **)0, 0, machineName, 1, &Tids[mach]) != 1)
+         {
+            fprintf(stderr, "Cannot spawn slave. Error code = %d\n", Tids[i]);
+            MasterTransport->halt();
+            exit(1);
+         }
+      }
+      if (useHostfile)
+      {
+         fclose(fp);
       }
    }
-   if (useHostfile)
-   {
-      fclose(fp);
-   }
+#endif
    for (mach = 0; mach < numMachines; mach++)
    {
       for (proc = 0; proc < NUM_PROCS; proc++)
@@ -752,48 +858,66 @@ void *update(void *arg)
    if ((Statsfp = fopen(STATS_FILE, "w")) == NULL)
    {
       fprintf(stderr, "Cannot open statistics file %s\n", STATS_FILE);
-      pvm_halt();
+      MasterTransport->halt();
       exit(1);
    }
 
    // Send initialization messages to slaves.
-   operation = INIT;
-   dimension = DIMENSION;
-   span      = SPAN;
+   operation         = INIT;
+   dimension         = DIMENSION;
+   span              = SPAN;
+   searchMode        = (int)SearchMode;
+   approximateMedian = ApproximateMedian ? 1 : 0;
+   backend           = (int)OctreeBackend;
+   rebuildThreshold  = RebuildThreshold;
+   wireError         = WireError;
    for (mach = count = 0; mach < numMachines; count += boidAssign[mach], mach++)
    {
-      pvm_initsend(PvmDataDefault);
-      pvm_pkint(&operation, 1, 1);
-      pvm_pkint(&dimension, 1, 1);
-      pvm_pkfloat(&span, 1, 1);
-      pvm_pkint(&boidAssign[mach], 1, 1);
-      pvm_pkint(&count, 1, 1);
-      pvm_pkint(Ptids, NUM_PROCS, 1);
-      pvm_pkint(&RandomSeed, 1, 1);
-      pvm_send(Tids[mach], 0);
+      MasterTransport->initSend();
+      MasterTransport->packInt(&operation, 1);
+      MasterTransport->packInt(&dimension, 1);
+      MasterTransport->packFloat(&span, 1);
+      MasterTransport->packInt(&boidAssign[mach], 1);
+      MasterTransport->packInt(&count, 1);
+      MasterTransport->packInt(Ptids, NUM_PROCS);
+      MasterTransport->packInt(&RandomSeed, 1);
+      MasterTransport->packInt(&searchMode, 1);
+      MasterTransport->packInt(&approximateMedian, 1);
+      MasterTransport->packInt(&backend, 1);
+      MasterTransport->packFloat(&rebuildThreshold, 1);
+      MasterTransport->packFloat(&wireError, 1);
+      MasterTransport->send(Tids[mach]);
    }
 
    // Update loop.
    while (true)
    {
       // Wait for display to run?
-      if (UserMode == RUN)
+      if ((UserMode == RUN) && !QuitRequested)
       {
          pthread_cond_wait(&UpdateCond, &UpdateMutex);
       }
 
+      // Quit?
+      if (QuitRequested)
+      {
+         stopSlaves();
+         SlavesStopped = true;
+         return(NULL);
+      }
+
       // Send aim message to update velocity and prepare to move.
       operation = AIM;
-      pvm_initsend(PvmDataDefault);
-      pvm_pkint(&operation, 1, 1);
-      pvm_mcast(Ptids, NUM_PROCS, 0);
+      MasterTransport->initSend();
+      MasterTransport->packInt(&operation, 1);
+      MasterTransport->multicast(Ptids, NUM_PROCS);
       gatherReady();
 
       // Send move message to update position.
       operation = MOVE;
-      pvm_initsend(PvmDataDefault);
-      pvm_pkint(&operation, 1, 1);
-      pvm_mcast(Ptids, NUM_PROCS, 0);
+      MasterTransport->initSend();
+      MasterTransport->packInt(&operation, 1);
+      MasterTransport->multicast(Ptids, NUM_PROCS);
       gatherReady();
 
       // Load-balance?
@@ -809,23 +933,23 @@ void *update(void *arg)
       {
          // Get load-balance status.
          operation = REPORT;
-         pvm_initsend(PvmDataDefault);
-         pvm_pkint(&operation, 1, 1);
-         pvm_mcast(Ptids, NUM_PROCS, 0);
+         MasterTransport->initSend();
+         MasterTransport->packInt(&operation, 1);
+         MasterTransport->multicast(Ptids, NUM_PROCS);
 
          // Collect report results.
          for (count = 0; count < NUM_PROCS; count++)
          {
-            pvm_recv(-1, 0);
-            pvm_upkint(&operation, 1, 1);
+            MasterTransport->receive(-1);
+            MasterTransport->unpackInt(&operation, 1);
 #ifdef _DEBUG
             assert(operation == REPORT_RESULT);
 #endif
-            pvm_upkint(&proc, 1, 1);
-            pvm_upkint(&(ProxySet->octrees[proc]->load), 1, 1);
-            pvm_upkfloat(&(ProxySet->octrees[proc]->median.m_x), 1, 1);
-            pvm_upkfloat(&(ProxySet->octrees[proc]->median.m_y), 1, 1);
-            pvm_upkfloat(&(ProxySet->octrees[proc]->median.m_z), 1, 1);
+            MasterTransport->unpackInt(&proc, 1);
+            MasterTransport->unpackInt(&(ProxySet->octrees[proc]->load), 1);
+            MasterTransport->unpackFloat(&(ProxySet->octrees[proc]->median.m_x), 1);
+            MasterTransport->unpackFloat(&(ProxySet->octrees[proc]->median.m_y), 1);
+            MasterTransport->unpackFloat(&(ProxySet->octrees[proc]->median.m_z), 1);
          }
 
          // Load-balance.
@@ -839,25 +963,25 @@ void *update(void *arg)
 
          // Distribute load-balanced bounds.
          operation = BALANCE;
-         pvm_initsend(PvmDataDefault);
-         pvm_pkint(&operation, 1, 1);
+         MasterTransport->initSend();
+         MasterTransport->packInt(&operation, 1);
          for (proc = 0; proc < NUM_PROCS; proc++)
          {
-            pvm_pkfloat(&(ProxySet->octrees[proc]->bounds.xmin), 1, 1);
-            pvm_pkfloat(&(ProxySet->octrees[proc]->bounds.xmax), 1, 1);
-            pvm_pkfloat(&(ProxySet->octrees[proc]->bounds.ymin), 1, 1);
-            pvm_pkfloat(&(ProxySet->octrees[proc]->bounds.ymax), 1, 1);
-            pvm_pkfloat(&(ProxySet->octrees[proc]->bounds.zmin), 1, 1);
-            pvm_pkfloat(&(ProxySet->octrees[proc]->bounds.zmax), 1, 1);
+            MasterTransport->packFloat(&(ProxySet->octrees[proc]->bounds.xmin), 1);
+            MasterTransport->packFloat(&(ProxySet->octrees[proc]->bounds.xmax), 1);
+            MasterTransport->packFloat(&(ProxySet->octrees[proc]->bounds.ymin), 1);
+            MasterTransport->packFloat(&(ProxySet->octrees[proc]->bounds.ymax), 1);
+            MasterTransport->packFloat(&(ProxySet->octrees[proc]->bounds.zmin), 1);
+            MasterTransport->packFloat(&(ProxySet->octrees[proc]->bounds.zmax), 1);
          }
-         pvm_mcast(Ptids, NUM_PROCS, 0);
+         MasterTransport->multicast(Ptids, NUM_PROCS);
          gatherReady();
 
          // Migrate boids.
          operation = MIGRATE;
-         pvm_initsend(PvmDataDefault);
-         pvm_pkint(&operation, 1, 1);
-         pvm_mcast(Ptids, NUM_PROCS, 0);
+         MasterTransport->initSend();
+         MasterTransport->packInt(&operation, 1);
+         MasterTransport->multicast(Ptids, NUM_PROCS);
          gatherReady();
       }
 
@@ -876,28 +1000,197 @@ void *update(void *arg)
 }
 
 
+// Slave thread: run a slave over the in-process transport.
+// Slaves start one at a time, as boid creation uses shared state.
+void *slave(void *arg)
+{
+   Transport    *transport;
+   ProcessorSet *pset;
+
+   transport = new ThreadTransport(SlaveHub, *(int *)arg);
+#ifdef _DEBUG
+   assert(transport != NULL);
 #endif
+   pthread_mutex_lock(&SlaveHub->startMutex);
+   pset = ProcessorSet::create(transport);
+   pthread_mutex_unlock(&SlaveHub->startMutex);
+   pset->run();
+   return(NULL);
+}
+
+
+#endif
+
+// Print usage and exit.
+void usage(char *program)
+{
+   fprintf(stderr, "Usage %s [-threads <number of slave threads> | -mpi] [-searchMode <demand | batch | halo>] [-approximateMedian] [-linearOctree | -spatialGrid] [-rebuildThreshold <fraction of boids changing octree nodes>] [-wireError <error bound of quantized positions and velocities>] [random number seed]\n", program);
+   exit(1);
+}
+
 
 int main(int argc, char **argv)
 {
-   GLUTWrapper glObj;
-   GLfloat     v[3];
-   int         proc, dummyTids[NUM_PROCS];
+   GLUTWrapper  glObj;
+   GLfloat      v[3];
+   int          arg, proc, dummyTids[NUM_PROCS];
+   bool         useMpi;
+
+#ifdef USE_MPI
+   MpiTransport *transport;
+   ProcessorSet *pset;
+#endif
 
-   // Set random seed.
-   if (argc == 2)
+   // Get options.
+   RandomSeed = time(NULL);
+   useMpi     = false;
+   for (arg = 1; arg < argc; arg++)
    {
-      RandomSeed = atoi(argv[1]);
+      // Run slaves as threads or MPI tasks?
+      if (strcmp(argv[arg], "-threads") == 0)
+      {
+         arg++;
+         if (arg >= argc)
+         {
+            usage(argv[0]);
+         }
+         if ((NumSlaveThreads = atoi(argv[arg])) < 1)
+         {
+            usage(argv[0]);
+         }
+         continue;
+      }
+
+#ifdef USE_MPI
+      if (strcmp(argv[arg], "-mpi") == 0)
+      {
+         useMpi = true;
+         continue;
+      }
+#endif
+
+      if (strcmp(argv[arg], "-searchMode") == 0)
+      {
+         arg++;
+         if (arg >= argc)
+         {
+            usage(argv[0]);
+         }
+         if (strcmp(argv[arg], "demand") == 0)
+         {
+            SearchMode = ProcessorSet::DEMAND_SEARCH;
+         }
+         else if (strcmp(argv[arg], "batch") == 0)
+         {
+            SearchMode = ProcessorSet::BATCH_SEARCH;
+         }
+         else if (strcmp(argv[arg], "halo") == 0)
+         {
+            SearchMode = ProcessorSet::HALO_SEARCH;
+         }
+         else
+         {
+            usage(argv[0]);
+         }
+         continue;
+      }
+
+      if (strcmp(argv[arg], "-approximateMedian") == 0)
+      {
+         ApproximateMedian = true;
+         continue;
+      }
+
+      if (strcmp(argv[arg], "-linearOctree") == 0)
+      {
+         if (OctreeBackend != Octree::POINTER_BACKEND)
+         {
+            usage(argv[0]);
+         }
+         OctreeBackend = Octree::LINEAR_BACKEND;
+         continue;
+      }
+
+      if (strcmp(argv[arg], "-spatialGrid") == 0)
+      {
+         if (OctreeBackend != Octree::POINTER_BACKEND)
+         {
+            usage(argv[0]);
+         }
+         OctreeBackend = Octree::GRID_BACKEND;
+         continue;
+      }
+
+      if (strcmp(argv[arg], "-rebuildThreshold") == 0)
+      {
+         arg++;
+         if (arg >= argc)
+         {
+            usage(argv[0]);
+         }
+         if ((RebuildThreshold = (float)atof(argv[arg])) < 0.0f)
+         {
+            usage(argv[0]);
+         }
+         continue;
+      }
+
+      if (strcmp(argv[arg], "-wireError") == 0)
+      {
+         arg++;
+         if (arg >= argc)
+         {
+            usage(argv[0]);
+         }
+         if ((WireError = (float)atof(argv[arg])) < 0.0f)
+         {
+            usage(argv[0]);
+         }
+         continue;
+      }
+
+      // Random number seed.
+      if ((arg == argc - 1) && (argv[arg][0] != '-'))
+      {
+         RandomSeed = atoi(argv[arg]);
+         continue;
+      }
+
+      usage(argv[0]);
    }
-   else if (argc == 1)
+   if (useMpi && (NumSlaveThreads > 0))
    {
-      RandomSeed = time(NULL);
+      usage(argv[0]);
    }
-   else
+
+#ifdef USE_MPI
+   // Without PVM, slaves not run as threads are MPI tasks.
+   if (NumSlaveThreads == 0)
    {
-      fprintf(stderr, "Usage %s [random number seed]\n", argv[0]);
-      exit(1);
+      useMpi = true;
+   }
+   if (useMpi)
+   {
+      // Rank 0 is the master; the other ranks are slaves.
+      transport = new MpiTransport(&argc, &argv);
+#ifdef _DEBUG
+      assert(transport != NULL);
+#endif
+      if (transport->myTid() != transport->parentTid())
+      {
+         pset = ProcessorSet::create(transport);
+         pset->run();
+         transport->exit();
+         return(0);
+      }
+      if ((NumMpiSlaves = transport->numTasks() - 1) < 1)
+      {
+         fprintf(stderr, "%s: MPI slave tasks needed\n", argv[0]);
+         transport->halt();
+      }
+      MasterTransport = transport;
    }
+#endif
    srand(RandomSeed);
 
    // Create display.
@@ -40,45 +40,22 @@
 int main(int argc, char **argv)
 {
 #ifdef UNIX
-   int          type, tid, dimension, numProcs, numBoids, count, random;
-   float        span;
-   int          *ptids;
+   Transport    *transport;
    ProcessorSet *pset;
-   int          i, j;
 
-   char buf[200];                                 // fliber
    // Enroll In PVM.
-   tid = pvm_mytid();
-
-   // Get initialization information.
-   pvm_recv(-1, 0);
-   pvm_upkint(&type, 1, 1);
-#ifdef _DEBUG
-   assert(type == INIT);
-#endif
-   pvm_upkint(&dimension, 1, 1);
-   pvm_upkfloat(&span, 1, 1);
-   pvm_upkint(&numBoids, 1, 1);
-   pvm_upkint(&count, 1, 1);
-   numProcs = dimension * dimension * dimension;
-   ptids    = new int[numProcs];
+   transport = new PvmTransport();
 #ifdef _DEBUG
-   assert(ptids != NULL);
+   assert(transport != NULL);
 #endif
-   pvm_upkint(ptids, numProcs, 1);
-   pvm_upkint(&random, 1, 1);
 
    // Create the processor set.
-   Boid::setBoidCount(count);
-   pset = new ProcessorSet(dimension, span, numBoids, ptids, tid, random);
-#ifdef _DEBUG
-   assert(pset != NULL);
-#endif
+   pset = ProcessorSet::create(transport);
 
    // Run.
    pset->run();
 
-   pvm_exit();
+   transport->exit();
 #endif
    return(0);
 }
@@ -0,0 +1,217 @@
+/*
+ * File Name : tickStats.cpp
+ *
+ * Description : Update tick instrumentation.
+ */
+
+#include "tickStats.hpp"
+#include <assert.h>
+
+// Names.
+static const char *PhaseNames[TickStats::NUM_PHASES] =
+{
+   "balance", "median", "aim", "search", "move", "migrate", "insert", "rebuild",
+   "visible"
+};
+static const char *CounterNames[TickStats::NUM_COUNTERS] =
+{
+   "queries", "neighbors", "migrations", "allocations", "relinks", "rebuilds",
+   "attr hits", "attr misses"
+};
+
+// Constructors.
+TickStats::TickStats()
+{
+   counters = NULL;
+   init(0);
+}
+
+
+TickStats::TickStats(int numPartitions)
+{
+   counters = NULL;
+   init(numPartitions);
+}
+
+
+void TickStats::init(int numPartitions)
+{
+   if (counters != NULL)
+   {
+      delete [] counters;
+   }
+   this->numPartitions = numPartitions;
+   counters            = new long long[(numPartitions * NUM_COUNTERS) + 1];
+#ifdef _DEBUG
+   assert(counters != NULL);
+#endif
+   enabled = true;
+   reset();
+}
+
+
+// Destructor.
+TickStats::~TickStats()
+{
+   delete [] counters;
+}
+
+
+// Clear statistics.
+void TickStats::reset()
+{
+   int i, j;
+
+   ticks = 0;
+   for (i = 0; i < NUM_PHASES; i++)
+   {
+      times[i] = 0;
+      calls[i] = 0;
+      for (j = 0; j < TICKSTATS_BUCKETS; j++)
+      {
+         histograms[i][j] = 0;
+      }
+   }
+   for (i = 0; i < numPartitions * NUM_COUNTERS; i++)
+   {
+      counters[i] = 0;
+   }
+}
+
+
+// Stop interval and charge it to phase.
+void TickStats::stop(PHASE phase, TIME start)
+{
+   TIME interval;
+   int  bucket;
+
+   if (!enabled)
+   {
+      return;
+   }
+   interval      = getmicrotime() - start;
+   times[phase] += interval;
+   calls[phase]++;
+   for (bucket = 0; bucket < TICKSTATS_BUCKETS - 1 &&
+        interval >= ((TIME)1 << bucket); bucket++)
+   {
+   }
+   histograms[phase][bucket]++;
+}
+
+
+// Add statistics into these.
+void TickStats::merge(TickStats *stats)
+{
+   int i, j;
+
+#ifdef _DEBUG
+   assert(stats->numPartitions == numPartitions);
+#endif
+   for (i = 0; i < NUM_PHASES; i++)
+   {
+      times[i] += stats->times[i];
+      calls[i] += stats->calls[i];
+      for (j = 0; j < TICKSTATS_BUCKETS; j++)
+      {
+         histograms[i][j] += stats->histograms[i][j];
+      }
+   }
+   for (i = 0; i < numPartitions * NUM_COUNTERS; i++)
+   {
+      counters[i] += stats->counters[i];
+   }
+}
+
+
+// Phase latency percentile (microseconds).
+TIME TickStats::getPercentile(PHASE phase, float fraction)
+{
+   int i, n, target;
+
+   if (calls[phase] == 0)
+   {
+      return(0);
+   }
+   target = (int)(fraction * (float)calls[phase]);
+   if (target >= calls[phase])
+   {
+      target = calls[phase] - 1;
+   }
+   for (i = n = 0; i < TICKSTATS_BUCKETS - 1; i++)
+   {
+      n += histograms[phase][i];
+      if (n > target)
+      {
+         break;
+      }
+   }
+   return((TIME)1 << i);
+}
+
+
+// Total count.
+long long TickStats::getTotal(COUNTER counter)
+{
+   int       i;
+   long long total;
+
+   for (i = 0, total = 0; i < numPartitions; i++)
+   {
+      total += getCount(i, counter);
+   }
+   return(total);
+}
+
+
+// Names.
+const char *TickStats::phaseName(PHASE phase)
+{
+   return(PhaseNames[phase]);
+}
+
+
+const char *TickStats::counterName(COUNTER counter)
+{
+   return(CounterNames[counter]);
+}
+
+
+// Print statistics.
+void TickStats::dump(FILE *fp)
+{
+   int i, j;
+
+   fprintf(fp, "ticks %d\n", ticks);
+   fprintf(fp, "%-8s %12s %10s %10s %8s %8s %8s\n", "phase", "usec", "calls",
+           "usec/tick", "p50", "p90", "p99");
+   for (i = 0; i < NUM_PHASES; i++)
+   {
+      fprintf(fp, "%-8s %12llu %10d %10.1f %8llu %8llu %8llu\n",
+              phaseName((PHASE)i), times[i], calls[i],
+              ticks > 0 ? (double)times[i] / (double)ticks : 0.0,
+              getPercentile((PHASE)i, 0.5f), getPercentile((PHASE)i, 0.9f),
+              getPercentile((PHASE)i, 0.99f));
+   }
+   fprintf(fp, "%-9s", "partition");
+   for (j = 0; j < NUM_COUNTERS; j++)
+   {
+      fprintf(fp, " %12s", counterName((COUNTER)j));
+   }
+   fprintf(fp, "\n");
+   for (i = 0; i < numPartitions; i++)
+   {
+      fprintf(fp, "%-9d", i);
+      for (j = 0; j < NUM_COUNTERS; j++)
+      {
+         fprintf(fp, " %12lld", getCount(i, (COUNTER)j));
+      }
+      fprintf(fp, "\n");
+   }
+   fprintf(fp, "%-9s", "total");
+   for (j = 0; j < NUM_COUNTERS; j++)
+   {
+      fprintf(fp, " %12lld", getTotal((COUNTER)j));
+   }
+   fprintf(fp, "\n");
+}
@@ -0,0 +1,881 @@
+/*
+ * This software is provided under the terms of the GNU General
+ * Public License as published by the Free Software Foundation.
+ *
+ * Copyright (c) 2003 Tom Portegys, All Rights Reserved.
+ * Permission to use, copy, modify, and distribute this software
+ * and its documentation for NON-COMMERCIAL purposes and without
+ * fee is hereby granted provided that this copyright notice
+ * appears in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.
+ */
+
+/*
+ * File Name : transport.cpp
+ *
+ * Description : Message transport between master and slave tasks.
+ */
+
+#include "transport.hpp"
+#include <string.h>
+#include <assert.h>
+#ifdef UNIX
+#include <sched.h>
+#include <time.h>
+#endif
+
+// Receive wait: spins, then yields, then sleeps between mailbox polls.
+#define RECEIVE_SPINS     1000
+#define RECEIVE_YIELDS    100
+#define RECEIVE_SLEEP     50000                   // nanoseconds
+
+// Initial message capacity (words).
+#define MESSAGE_WORDS     64
+
+#ifdef USE_MPI
+// Broadcast header (words): size and leading words of a broadcast.
+// A longer broadcast is followed by a body with the rest.
+#define BROADCAST_WORDS    MESSAGE_WORDS
+#define MESSAGE_TAG        0
+#endif
+
+// Contribute values to a gather by the parent.
+void Transport::contribute(int *values, int count)
+{
+   initSend();
+   packInt(values, count);
+   send(parentTid());
+}
+
+
+// Gather values contributed by each task in a list, in list order.
+void Transport::gather(int *results, int count, int *tids, int numTasks)
+{
+   int i;
+
+   for (i = 0; i < numTasks; i++)
+   {
+      receive(tids[i]);
+      unpackInt(&results[i * count], count);
+   }
+}
+
+
+#ifdef UNIX
+// Back off between polls: spin, then yield, then sleep.
+static void backoff(int spins)
+{
+   struct timespec delay;
+
+   if (spins < RECEIVE_SPINS)
+   {
+      return;
+   }
+   if (spins < RECEIVE_SPINS + RECEIVE_YIELDS)
+   {
+      sched_yield();
+      return;
+   }
+   delay.tv_sec  = 0;
+   delay.tv_nsec = RECEIVE_SLEEP;
+   nanosleep(&delay, NULL);
+}
+
+
+#ifndef USE_MPI
+// Enroll in PVM.
+PvmTransport::PvmTransport()
+{
+   tid = pvm_mytid();
+}
+#endif
+
+
+// Hub constructor.
+ThreadTransport::Hub::Hub(int numTasks)
+{
+   int i;
+
+   this->numTasks = numTasks;
+   mailboxes      = new std::atomic<MESSAGE *>[numTasks + 1];
+#ifdef _DEBUG
+   assert(mailboxes != NULL);
+#endif
+   for (i = 0; i <= numTasks; i++)
+   {
+      mailboxes[i].store(NULL);
+   }
+   pthread_mutex_init(&startMutex, NULL);
+}
+
+
+// Hub destructor.
+ThreadTransport::Hub::~Hub()
+{
+   int     i;
+   MESSAGE *message;
+
+   for (i = 0; i <= numTasks; i++)
+   {
+      while ((message = mailboxes[i].load()) != NULL)
+      {
+         mailboxes[i].store(message->next);
+         freeMessage(message);
+      }
+   }
+   delete [] mailboxes;
+   pthread_mutex_destroy(&startMutex);
+}
+
+
+// Post message to a task's mailbox.
+void ThreadTransport::Hub::post(int tid, MESSAGE *message)
+{
+   MESSAGE *head;
+
+#ifdef _DEBUG
+   assert(tid >= 1 && tid <= numTasks);
+#endif
+   head = mailboxes[tid].load(std::memory_order_relaxed);
+   do
+   {
+      message->next = head;
+   }
+   while (!mailboxes[tid].compare_exchange_weak(head, message,
+                                                std::memory_order_release,
+                                                std::memory_order_relaxed));
+}
+
+
+// Take posted messages of a task, oldest first.
+ThreadTransport::MESSAGE *ThreadTransport::Hub::take(int tid)
+{
+   MESSAGE *message, *next, *list;
+
+   message = mailboxes[tid].exchange(NULL, std::memory_order_acquire);
+   for (list = NULL; message != NULL; message = next)
+   {
+      next          = message->next;
+      message->next = list;
+      list          = message;
+   }
+   return(list);
+}
+
+
+// Constructor.
+ThreadTransport::ThreadTransport(Hub *hub, int tid)
+{
+#ifdef _DEBUG
+   assert(tid >= 1 && tid <= hub->numTasks);
+#endif
+   this->hub   = hub;
+   this->tid   = tid;
+   outgoing    = NULL;
+   received    = NULL;
+   cursor      = 0;
+   pending     = pendingTail = NULL;
+}
+
+
+// Destructor.
+ThreadTransport::~ThreadTransport()
+{
+   MESSAGE *message;
+
+   freeMessage(outgoing);
+   freeMessage(received);
+   while (pending != NULL)
+   {
+      message = pending;
+      pending = pending->next;
+      freeMessage(message);
+   }
+}
+
+
+// Start a new outgoing message.
+void ThreadTransport::initSend()
+{
+   if (outgoing == NULL)
+   {
+      outgoing           = new MESSAGE;
+      outgoing->capacity = MESSAGE_WORDS;
+      outgoing->words    = new int[MESSAGE_WORDS];
+#ifdef _DEBUG
+      assert(outgoing->words != NULL);
+#endif
+   }
+   outgoing->source = tid;
+   outgoing->size   = 0;
+   outgoing->next   = NULL;
+}
+
+
+// Pack values into the outgoing message.
+void ThreadTransport::packInt(int *values, int count)
+{
+   pack(values, count);
+}
+
+
+void ThreadTransport::packFloat(float *values, int count)
+{
+   pack(values, count);
+}
+
+
+void ThreadTransport::pack(void *values, int count)
+{
+   int *words;
+
+#ifdef _DEBUG
+   assert(outgoing != NULL);
+#endif
+   if (count == 0)
+   {
+      return;
+   }
+   if (outgoing->size + count > outgoing->capacity)
+   {
+      outgoing->capacity = (outgoing->size + count) * 2;
+      words              = new int[outgoing->capacity];
+#ifdef _DEBUG
+      assert(words != NULL);
+#endif
+      memcpy(words, outgoing->words, outgoing->size * sizeof(int));
+      delete [] outgoing->words;
+      outgoing->words = words;
+   }
+   memcpy(&outgoing->words[outgoing->size], values, count * sizeof(int));
+   outgoing->size += count;
+}
+
+
+// Send the outgoing message to a task.
+// The message is handed over whole; packing resumes after initSend().
+void ThreadTransport::send(int tid)
+{
+#ifdef _DEBUG
+   assert(outgoing != NULL);
+#endif
+   hub->post(tid, outgoing);
+   outgoing = NULL;
+}
+
+
+// Send a copy of the outgoing message once to each distinct task.
+void ThreadTransport::multicast(int *tids, int count)
+{
+   int i, j;
+
+#ifdef _DEBUG
+   assert(outgoing != NULL);
+#endif
+   for (i = 0; i < count; i++)
+   {
+      for (j = 0; j < i && tids[j] != tids[i]; j++)
+      {
+      }
+      if (j == i)
+      {
+         hub->post(tids[i], copyMessage());
+      }
+   }
+}
+
+
+// Copy of outgoing message.
+ThreadTransport::MESSAGE *ThreadTransport::copyMessage()
+{
+   MESSAGE *message;
+
+   message           = new MESSAGE;
+   message->source   = outgoing->source;
+   message->size     = outgoing->size;
+   message->capacity = outgoing->size;
+   message->words    = new int[message->capacity + 1];
+#ifdef _DEBUG
+   assert(message->words != NULL);
+#endif
+   memcpy(message->words, outgoing->words, outgoing->size * sizeof(int));
+   message->next = NULL;
+   return(message);
+}
+
+
+// Wait for a message from a task (-1 = any task).
+// Messages taken while waiting for another task are kept in arrival order.
+void ThreadTransport::receive(int tid)
+{
+   MESSAGE *message, *prev, *list;
+   int     spins;
+
+   freeMessage(received);
+   received = NULL;
+   cursor   = 0;
+   for (spins = 0; ; spins++)
+   {
+      // Find pending message.
+      for (message = pending, prev = NULL; message != NULL;
+           prev = message, message = message->next)
+      {
+         if ((tid == -1) || (message->source == tid))
+         {
+            break;
+         }
+      }
+      if (message != NULL)
+      {
+         if (prev == NULL)
+         {
+            pending = message->next;
+         }
+         else
+         {
+            prev->next = message->next;
+         }
+         if (pendingTail == message)
+         {
+            pendingTail = prev;
+         }
+         message->next = NULL;
+         received      = message;
+         return;
+      }
+
+      // Take posted messages.
+      if ((list = hub->take(this->tid)) != NULL)
+      {
+         if (pending == NULL)
+         {
+            pending = list;
+         }
+         else
+         {
+            pendingTail->next = list;
+         }
+         for (pendingTail = list; pendingTail->next != NULL;
+              pendingTail = pendingTail->next)
+         {
+         }
+         spins = 0;
+         continue;
+      }
+
+      backoff(spins);
+   }
+}
+
+
+// Unpack values from the received message.
+void ThreadTransport::unpackInt(int *values, int count)
+{
+   unpack(values, count);
+}
+
+
+void ThreadTransport::unpackFloat(float *values, int count)
+{
+   unpack(values, count);
+}
+
+
+void ThreadTransport::unpack(void *values, int count)
+{
+#ifdef _DEBUG
+   assert(received != NULL);
+   assert(cursor + count <= received->size);
+#endif
+   if (count == 0)
+   {
+      return;
+   }
+   memcpy(values, &received->words[cursor], count * sizeof(int));
+   cursor += count;
+}
+
+
+// Leave the transport, ending the task's thread.
+void ThreadTransport::exit()
+{
+   pthread_exit(NULL);
+}
+
+
+// Free message.
+void ThreadTransport::freeMessage(MESSAGE *message)
+{
+   if (message != NULL)
+   {
+      delete [] message->words;
+      delete message;
+   }
+}
+#endif
+
+
+#ifdef USE_MPI
+// Constructor: initialize MPI.
+// Only one thread of a task messages at a time.
+MpiTransport::MpiTransport(int *argc, char ***argv)
+{
+   int provided;
+
+   MPI_Init_thread(argc, argv, MPI_THREAD_SERIALIZED, &provided);
+   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+   MPI_Comm_size(MPI_COMM_WORLD, &size);
+   MPI_Comm_dup(MPI_COMM_WORLD, &messageComm);
+   MPI_Comm_dup(MPI_COMM_WORLD, &broadcastComm);
+   MPI_Comm_dup(MPI_COMM_WORLD, &gatherComm);
+   sending        = spares = NULL;
+   outgoing       = NULL;
+   received       = newBuffer(MESSAGE_WORDS);
+   cursor         = 0;
+   broadcast      = newBuffer(MESSAGE_WORDS);
+   broadcastState = BROADCAST_IDLE;
+   gathered       = newBuffer(MESSAGE_WORDS);
+   gathering      = false;
+}
+
+
+// Destructor.
+MpiTransport::~MpiTransport()
+{
+   BUFFER *buffer;
+
+   while (sending != NULL)
+   {
+      buffer  = sending;
+      sending = sending->next;
+      delete [] buffer->words;
+      delete buffer;
+   }
+   while ((buffer = spares) != NULL)
+   {
+      spares = spares->next;
+      delete [] buffer->words;
+      delete buffer;
+   }
+   if (outgoing != NULL)
+   {
+      delete [] outgoing->words;
+      delete outgoing;
+   }
+   delete [] received->words;
+   delete received;
+   delete [] broadcast->words;
+   delete broadcast;
+   delete [] gathered->words;
+   delete gathered;
+}
+
+
+// Start a new outgoing message.
+void MpiTransport::initSend()
+{
+   reap();
+   if (outgoing == NULL)
+   {
+      outgoing = newBuffer(MESSAGE_WORDS);
+   }
+   outgoing->size = 0;
+}
+
+
+// Pack values into the outgoing message.
+void MpiTransport::packInt(int *values, int count)
+{
+   pack(values, count);
+}
+
+
+void MpiTransport::packFloat(float *values, int count)
+{
+   pack(values, count);
+}
+
+
+void MpiTransport::pack(void *values, int count)
+{
+#ifdef _DEBUG
+   assert(outgoing != NULL);
+#endif
+   if (count == 0)
+   {
+      return;
+   }
+   if (outgoing->size + count > outgoing->capacity)
+   {
+      growBuffer(outgoing, (outgoing->size + count) * 2);
+   }
+   memcpy(&outgoing->words[outgoing->size + 1], values, count * sizeof(int));
+   outgoing->size += count;
+}
+
+
+// Send the outgoing message to a task.
+// The message is handed over whole; packing resumes after initSend().
+void MpiTransport::send(int tid)
+{
+#ifdef _DEBUG
+   assert(outgoing != NULL);
+#endif
+   MPI_Isend(&outgoing->words[1], outgoing->size, MPI_INT, tid,
+             MESSAGE_TAG, messageComm, &outgoing->requests[0]);
+   outgoing->numRequests = 1;
+   post(outgoing);
+   outgoing = NULL;
+}
+
+
+// Send the outgoing message once to each distinct task.
+// The master broadcasts a message for every other task.
+void MpiTransport::multicast(int *tids, int count)
+{
+   int    i, j;
+   BUFFER *buffer;
+
+#ifdef _DEBUG
+   assert(outgoing != NULL);
+#endif
+   if (rank == 0)
+   {
+      for (i = 1; i < size; i++)
+      {
+         for (j = 0; j < count && tids[j] != i; j++)
+         {
+         }
+         if (j == count)
+         {
+            break;
+         }
+      }
+      if (i == size)
+      {
+         growBuffer(outgoing, BROADCAST_WORDS - 1);
+         outgoing->words[0] = outgoing->size;
+         MPI_Ibcast(outgoing->words, BROADCAST_WORDS, MPI_INT, 0,
+                    broadcastComm, &outgoing->requests[0]);
+         outgoing->numRequests = 1;
+         if (outgoing->size >= BROADCAST_WORDS)
+         {
+            MPI_Ibcast(&outgoing->words[BROADCAST_WORDS],
+                       outgoing->size + 1 - BROADCAST_WORDS, MPI_INT, 0,
+                       broadcastComm, &outgoing->requests[1]);
+            outgoing->numRequests = 2;
+         }
+         post(outgoing);
+         outgoing = NULL;
+         return;
+      }
+   }
+   for (i = 0; i < count; i++)
+   {
+      for (j = 0; j < i && tids[j] != tids[i]; j++)
+      {
+      }
+      if (j == i)
+      {
+         buffer = newBuffer(outgoing->size);
+         copyBuffer(buffer, outgoing);
+         MPI_Isend(&buffer->words[1], buffer->size, MPI_INT, tids[i],
+                   MESSAGE_TAG, messageComm, &buffer->requests[0]);
+         buffer->numRequests = 1;
+         post(buffer);
+      }
+   }
+}
+
+
+// Wait for a message from a task (-1 = any task).
+// Messages from a task are received in order; a broadcast is only
+// received from any task, as the master broadcasts a new operation
+// only once every task is done with the last.
+void MpiTransport::receive(int tid)
+{
+   int         flag, count, spins;
+   MPI_Message message;
+   MPI_Status  status;
+   BUFFER      *buffer;
+
+   reap();
+   cursor = 0;
+   for (spins = 0; ; spins++)
+   {
+      // Point-to-point message?
+      MPI_Improbe(tid == -1 ? MPI_ANY_SOURCE : tid, MESSAGE_TAG,
+                  messageComm, &flag, &message, &status);
+      if (flag)
+      {
+         MPI_Get_count(&status, MPI_INT, &count);
+         received->size = 0;
+         growBuffer(received, count);
+         MPI_Mrecv(&received->words[1], count, MPI_INT, &message,
+                   MPI_STATUS_IGNORE);
+         received->size = count;
+         return;
+      }
+
+      // Broadcast?
+      if ((tid == -1) && (rank != 0) && (broadcastState == BROADCAST_IDLE))
+      {
+         MPI_Ibcast(broadcast->words, BROADCAST_WORDS, MPI_INT, 0,
+                    broadcastComm, &broadcastRequest);
+         broadcastState = BROADCAST_HEADER;
+      }
+      pollBroadcast();
+      if ((tid == -1) && (broadcastState == BROADCAST_DONE))
+      {
+         buffer         = received;
+         received       = broadcast;
+         broadcast      = buffer;
+         broadcastState = BROADCAST_IDLE;
+         return;
+      }
+
+      // Progress contribution.
+      if (gathering)
+      {
+         MPI_Test(&gatherRequest, &flag, MPI_STATUS_IGNORE);
+         gathering = !flag;
+      }
+      backoff(spins);
+   }
+}
+
+
+// Advance broadcast reception.
+void MpiTransport::pollBroadcast()
+{
+   int flag;
+
+   if ((broadcastState != BROADCAST_HEADER) && (broadcastState != BROADCAST_BODY))
+   {
+      return;
+   }
+   MPI_Test(&broadcastRequest, &flag, MPI_STATUS_IGNORE);
+   if (!flag)
+   {
+      return;
+   }
+   if ((broadcastState == BROADCAST_HEADER) && (broadcast->words[0] >= BROADCAST_WORDS))
+   {
+      broadcast->size = BROADCAST_WORDS - 1;
+      growBuffer(broadcast, broadcast->words[0]);
+      MPI_Ibcast(&broadcast->words[BROADCAST_WORDS],
+                 broadcast->words[0] + 1 - BROADCAST_WORDS, MPI_INT, 0,
+                 broadcastComm, &broadcastRequest);
+      broadcastState = BROADCAST_BODY;
+      return;
+   }
+   broadcast->size = broadcast->words[0];
+   broadcastState  = BROADCAST_DONE;
+}
+
+
+// Unpack values from the received message.
+void MpiTransport::unpackInt(int *values, int count)
+{
+   unpack(values, count);
+}
+
+
+void MpiTransport::unpackFloat(float *values, int count)
+{
+   unpack(values, count);
+}
+
+
+void MpiTransport::unpack(void *values, int count)
+{
+#ifdef _DEBUG
+   assert(cursor + count <= received->size);
+#endif
+   if (count == 0)
+   {
+      return;
+   }
+   memcpy(values, &received->words[cursor + 1], count * sizeof(int));
+   cursor += count;
+}
+
+
+// Contribute values to a gather by the master.
+// The contribution completes while the task goes on.
+void MpiTransport::contribute(int *values, int count)
+{
+#ifdef _DEBUG
+   assert(rank != 0);
+#endif
+   if (gathering)
+   {
+      wait(&gatherRequest);
+   }
+   gathered->size = 0;
+   growBuffer(gathered, count);
+   memcpy(&gathered->words[1], values, count * sizeof(int));
+   MPI_Igather(&gathered->words[1], count, MPI_INT, NULL, 0, MPI_INT, 0,
+               gatherComm, &gatherRequest);
+   gathering = true;
+}
+
+
+// Gather values contributed by each task in a list, in list order.
+// The list must hold every other task.
+void MpiTransport::gather(int *results, int count, int *tids, int numTasks)
+{
+   int i;
+
+#ifdef _DEBUG
+   assert(rank == 0 && numTasks == size - 1);
+#endif
+   gathered->size = 0;
+   growBuffer(gathered, size * count);
+   MPI_Igather(MPI_IN_PLACE, count, MPI_INT, &gathered->words[1], count,
+               MPI_INT, 0, gatherComm, &gatherRequest);
+   wait(&gatherRequest);
+   for (i = 0; i < numTasks; i++)
+   {
+      memcpy(&results[i * count], &gathered->words[(tids[i] * count) + 1],
+             count * sizeof(int));
+   }
+}
+
+
+// Wait for a request.
+void MpiTransport::wait(MPI_Request *request)
+{
+   int flag, spins;
+
+   for (spins = 0; ; spins++)
+   {
+      MPI_Test(request, &flag, MPI_STATUS_IGNORE);
+      if (flag)
+      {
+         return;
+      }
+      backoff(spins);
+   }
+}
+
+
+// Leave MPI.
+void MpiTransport::exit()
+{
+   // Finish contribution in flight.
+   if (gathering)
+   {
+      wait(&gatherRequest);
+      gathering = false;
+   }
+   MPI_Finalize();
+}
+
+
+// Stop all tasks on an error.
+// A normal run ends with finish(), which finalizes MPI.
+void MpiTransport::halt()
+{
+   MPI_Abort(MPI_COMM_WORLD, 0);
+}
+
+
+// New buffer, from the spares if possible.
+MpiTransport::BUFFER *MpiTransport::newBuffer(int capacity)
+{
+   BUFFER *buffer;
+
+   if ((buffer = spares) != NULL)
+   {
+      spares = spares->next;
+   }
+   else
+   {
+      buffer           = new BUFFER;
+      buffer->words    = NULL;
+      buffer->capacity = -1;
+   }
+   buffer->size        = 0;
+   buffer->numRequests = 0;
+   buffer->next        = NULL;
+   growBuffer(buffer, capacity);
+   return(buffer);
+}
+
+
+// Grow buffer capacity, keeping its contents.
+void MpiTransport::growBuffer(BUFFER *buffer, int capacity)
+{
+   int *words;
+
+   if (capacity <= buffer->capacity)
+   {
+      return;
+   }
+   words = new int[capacity + 1];
+#ifdef _DEBUG
+   assert(words != NULL);
+#endif
+   if (buffer->words != NULL)
+   {
+      memcpy(words, buffer->words, (buffer->size + 1) * sizeof(int));
+      delete [] buffer->words;
+   }
+   buffer->words    = words;
+   buffer->capacity = capacity;
+}
+
+
+// Copy buffer contents.
+void MpiTransport::copyBuffer(BUFFER *to, BUFFER *from)
+{
+   growBuffer(to, from->size);
+   memcpy(to->words, from->words, (from->size + 1) * sizeof(int));
+   to->size = from->size;
+}
+
+
+// Post buffer in flight.
+void MpiTransport::post(BUFFER *buffer)
+{
+   buffer->next = sending;
+   sending      = buffer;
+}
+
+
+// Return sent buffers to the spares.
+void MpiTransport::reap()
+{
+   int    flag;
+   BUFFER *buffer, *prev, *next;
+
+   for (buffer = sending, prev = NULL; buffer != NULL; buffer = next)
+   {
+      next = buffer->next;
+      MPI_Testall(buffer->numRequests, buffer->requests, &flag,
+                  MPI_STATUSES_IGNORE);
+      if (flag)
+      {
+         if (prev == NULL)
+         {
+            sending = next;
+         }
+         else
+         {
+            prev->next = next;
+         }
+         buffer->next = spares;
+         spares       = buffer;
+      }
+      else
+      {
+         prev = buffer;
+      }
+   }
+}
+#endif
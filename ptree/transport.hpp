@@ -0,0 +1,292 @@
+/*
+ * This software is provided under the terms of the GNU General
+ * Public License as published by the Free Software Foundation.
+ *
+ * Copyright (c) 2003 Tom Portegys, All Rights Reserved.
+ * Permission to use, copy, modify, and distribute this software
+ * and its documentation for NON-COMMERCIAL purposes and without
+ * fee is hereby granted provided that this copyright notice
+ * appears in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.
+ */
+
+/*
+ * File Name : transport.hpp
+ *
+ * Description : Message transport between master and slave tasks.
+ *               A task packs one outgoing message at a time and sends
+ *               or multicasts it, and unpacks the last message it
+ *               received. Messages from one task to another arrive
+ *               in order.
+ *
+ *               PvmTransport passes messages through the PVM daemon.
+ *               ThreadTransport runs the master and slaves as threads
+ *               of one process, posting messages to lock-free
+ *               mailboxes without encoding them.
+ *               MpiTransport (built with USE_MPI) runs the master and
+ *               slaves as MPI tasks.
+ */
+
+#ifndef __TRANSPORT_HPP__
+#define __TRANSPORT_HPP__
+
+#ifdef UNIX
+#ifndef USE_MPI
+#include <pvm3.h>
+#endif
+#include <pthread.h>
+#include <atomic>
+#endif
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+class Transport
+{
+public:
+
+   // Destructor.
+   virtual ~Transport() {}
+
+   // Task identifiers.
+   virtual int myTid()     = 0;
+   virtual int parentTid() = 0;
+
+   // Start a new outgoing message.
+   virtual void initSend() = 0;
+
+   // Pack values into the outgoing message.
+   virtual void packInt(int *values, int count)     = 0;
+   virtual void packFloat(float *values, int count) = 0;
+
+   // Send the outgoing message to a task, or once to each distinct
+   // task in a list.
+   virtual void send(int tid) = 0;
+   virtual void multicast(int *tids, int count) = 0;
+
+   // Wait for a message from a task (-1 = any task).
+   virtual void receive(int tid) = 0;
+
+   // Unpack values from the received message.
+   virtual void unpackInt(int *values, int count)     = 0;
+   virtual void unpackFloat(float *values, int count) = 0;
+
+   // Contribute values to a gather by the parent.
+   virtual void contribute(int *values, int count);
+
+   // Gather values contributed by each task in a list, in list order.
+   virtual void gather(int *results, int count, int *tids, int numTasks);
+
+   // Leave the transport; a threaded task also ends its thread.
+   virtual void exit() = 0;
+
+   // Stop all tasks.
+   virtual void halt() = 0;
+
+   // End a normal run once the slaves have stopped.
+   virtual void finish() { halt(); }
+};
+
+#ifdef UNIX
+#ifndef USE_MPI
+// PVM transport.
+// Not built with MPI, which needs no PVM.
+class PvmTransport : public Transport
+{
+public:
+
+   // Constructor: enroll in PVM.
+   PvmTransport();
+
+   int myTid() { return(tid); }
+   int parentTid() { return(pvm_parent()); }
+   void initSend() { pvm_initsend(PvmDataDefault); }
+   void packInt(int *values, int count) { pvm_pkint(values, count, 1); }
+   void packFloat(float *values, int count) { pvm_pkfloat(values, count, 1); }
+   void send(int tid) { pvm_send(tid, 0); }
+   void multicast(int *tids, int count) { pvm_mcast(tids, count, 0); }
+   void receive(int tid) { pvm_recv(tid, 0); }
+   void unpackInt(int *values, int count) { pvm_upkint(values, count, 1); }
+   void unpackFloat(float *values, int count) { pvm_upkfloat(values, count, 1); }
+   void exit() { pvm_exit(); }
+   void halt() { pvm_halt(); }
+
+   // Data members.
+   int tid;
+};
+#endif
+
+// In-process threaded transport.
+// Task identifiers are 1 to the number of tasks; the master is task 1
+// and the parent of all others. Each task owns an endpoint that only
+// its thread may use.
+class ThreadTransport : public Transport
+{
+public:
+
+   // Message: 32-bit words packed as they are given.
+   typedef struct Message
+   {
+      int            source;
+      int            size;
+      int            capacity;
+      int            *words;
+      struct Message *next;
+   } MESSAGE;
+
+   // Mailboxes shared by the tasks.
+   // Senders push onto a mailbox with compare-and-swap; its owner
+   // takes all posted messages at once.
+   class Hub
+   {
+   public:
+
+      // Constructor.
+      Hub(int numTasks);
+
+      // Destructor.
+      ~Hub();
+
+      // Post message to a task's mailbox.
+      void post(int tid, MESSAGE *message);
+
+      // Take posted messages of a task, oldest first.
+      MESSAGE *take(int tid);
+
+      // Data members.
+      int                    numTasks;
+      std::atomic<MESSAGE *> *mailboxes;
+      pthread_mutex_t        startMutex;          // serializes task start-up
+   };
+
+   // Constructor.
+   ThreadTransport(Hub *hub, int tid);
+
+   // Destructor.
+   ~ThreadTransport();
+
+   int myTid() { return(tid); }
+   int parentTid() { return(1); }
+   void initSend();
+   void packInt(int *values, int count);
+   void packFloat(float *values, int count);
+   void send(int tid);
+   void multicast(int *tids, int count);
+   void receive(int tid);
+   void unpackInt(int *values, int count);
+   void unpackFloat(float *values, int count);
+   void exit();
+   void halt() {}
+
+   // Pack and unpack words.
+   void pack(void *values, int count);
+   void unpack(void *values, int count);
+
+   // Copy of outgoing message.
+   MESSAGE *copyMessage();
+
+   // Free message.
+   static void freeMessage(MESSAGE *message);
+
+   // Data members.
+   Hub     *hub;
+   int     tid;
+   MESSAGE *outgoing;                             // being packed
+   MESSAGE *received;                             // being unpacked
+   int     cursor;                                // unpack position
+   MESSAGE *pending, *pendingTail;                // taken, not yet received
+};
+#endif
+
+#ifdef USE_MPI
+// MPI transport.
+// Task identifiers are ranks; the master is rank 0 and the parent of
+// all others. Messages are sent without blocking. A multicast by the
+// master to every other task is a broadcast, which a task takes only
+// when receiving from any task. Gathers span all tasks. Broadcasts and
+// gathers have their own communicators, so need not be ordered with
+// each other.
+class MpiTransport : public Transport
+{
+public:
+
+   // Message buffer: a size word followed by 32-bit words packed as
+   // they are given.
+   typedef struct Buffer
+   {
+      int           *words;
+      int           size;
+      int           capacity;
+      MPI_Request   requests[2];
+      int           numRequests;
+      struct Buffer *next;
+   } BUFFER;
+
+   // Broadcast reception states.
+   typedef enum { BROADCAST_IDLE, BROADCAST_HEADER, BROADCAST_BODY,
+                  BROADCAST_DONE }
+   BROADCAST_STATE;
+
+   // Constructor: initialize MPI.
+   MpiTransport(int *argc, char ***argv);
+
+   // Destructor.
+   ~MpiTransport();
+
+   int myTid() { return(rank); }
+   int parentTid() { return(0); }
+   void initSend();
+   void packInt(int *values, int count);
+   void packFloat(float *values, int count);
+   void send(int tid);
+   void multicast(int *tids, int count);
+   void receive(int tid);
+   void unpackInt(int *values, int count);
+   void unpackFloat(float *values, int count);
+   void contribute(int *values, int count);
+   void gather(int *results, int count, int *tids, int numTasks);
+   void exit();
+   void halt();
+   void finish() { exit(); }
+
+   // Number of tasks.
+   int numTasks() { return(size); }
+
+   // Pack and unpack words.
+   void pack(void *values, int count);
+   void unpack(void *values, int count);
+
+   // Buffer management.
+   BUFFER *newBuffer(int capacity);
+   void growBuffer(BUFFER *buffer, int capacity);
+   void copyBuffer(BUFFER *to, BUFFER *from);
+   void post(BUFFER *buffer);
+   void reap();
+
+   // Advance broadcast reception.
+   void pollBroadcast();
+
+   // Wait for a request.
+   void wait(MPI_Request *request);
+
+   // Data members.
+   int             rank, size;
+   MPI_Comm        messageComm, broadcastComm, gatherComm;
+   BUFFER          *outgoing;                     // being packed
+   BUFFER          *received;                     // being unpacked
+   int             cursor;                        // unpack position
+   BUFFER          *sending;                      // in flight
+   BUFFER          *spares;                       // free
+   BUFFER          *broadcast;                    // being broadcast to task
+   BROADCAST_STATE broadcastState;
+   MPI_Request     broadcastRequest;
+   BUFFER          *gathered;                     // gather or contribution
+   bool            gathering;                     // contribution in flight
+   MPI_Request     gatherRequest;
+};
+#endif
+#endif
@@ -61,26 +61,30 @@ Boid::accumulate(Vector& accumulator, Vector valueToAdd)
 
 
 Vector
-Boid::navigator(const std::list<Boid>& boidList)
+Boid::navigator(const BoidNeighbor *neighbors, int numNeighbors)
 {
    Vector vacc(0, 0, 0);                          // vector accumulator
 
+   // Visit neighbors once for all the flocking rules.
+   surveyNeighbors(neighbors, numNeighbors);
+   surveyed = true;
+
    if (accumulate(vacc, collisionAvoidance()) >= 1.0)
    {
       goto MAXACCEL_ATTAINED;
    }
-   if (accumulate(vacc, flockCentering(boidList)) >= 1.0)
+   if (accumulate(vacc, flockCentering(neighbors, numNeighbors)) >= 1.0)
    {
       goto MAXACCEL_ATTAINED;
    }
 #ifdef NEVER
    // This causes a problem when boids are not run sequentially.
-   if (accumulate(vacc, maintainingCruisingDistance(boidList)) >= 1.0)
+   if (accumulate(vacc, maintainingCruisingDistance(neighbors, numNeighbors)) >= 1.0)
    {
       goto MAXACCEL_ATTAINED;
    }
 #endif
-   if (accumulate(vacc, velocityMatching(boidList)) >= 1.0)
+   if (accumulate(vacc, velocityMatching(neighbors, numNeighbors)) >= 1.0)
    {
       goto MAXACCEL_ATTAINED;
    }
@@ -95,6 +99,8 @@ Boid::navigator(const std::list<Boid>& boidList)
 
 MAXACCEL_ATTAINED:                                /* label */
 
+   surveyed = false;
+
    // IMPORTANT:
    // Since the FlockCentering, CollisionAvoidance, and VelocityMatching modules
    // return a vector whose magnitude is a percentage of the maximum acceleration,
@@ -170,42 +176,18 @@ Boid::wander(void)
 Vector
 Boid::collisionAvoidance(void)
 {
-   Obstacle  *obs;
    ISectData d;
-   Vector    normalToObject(0, 0, 0);
-   int       objectSeen = 0;
-   Vector    pointOnObject;
-
-   // Ignore obstacles that are out of the range of our probe.
-   double distanceToObject = getProbeLength();
-
-   // Find closest imminent collision with non-boid object
-   obstacles.ResetIter();
-   while ((obs = obstacles.Iter()) != NULL)
-   {
-      d = obs->DoesRayIntersect(Direction(velocity), position);
 
-      if (d.intersectionflag == 1)
-      {
-         // Velocity vector intersects an obstacle
-
-         if (Magnitude(d.point - position) <= distanceToObject)
-         {
-            // found a closer object
-            objectSeen       = 1;
-            distanceToObject = Magnitude(d.point - position);
-            normalToObject   = d.normal;
-            pointOnObject    = d.point;
-         }
-      }
-   }
+   // Find closest imminent collision with non-boid object, ignoring
+   // obstacles that are out of the range of our probe.
+   d = obstacles.IntersectRay(Direction(velocity), position, getProbeLength());
 
-   if (!objectSeen)
+   if (d.intersectionflag != 1)
    {
       return(Vector(0, 0, 0));
    }
 
-   return(resolveCollision(pointOnObject, normalToObject));
+   return(resolveCollision(d.point, d.normal));
 }
 
 
@@ -235,53 +217,79 @@ Boid::resolveCollision(Vector pointOnObject, Vector normalToObject)
 }
 
 
-Vector
-Boid::maintainingCruisingDistance(const std::list<Boid>& boidList)
+void
+Boid::surveyNeighbors(const BoidNeighbor *neighbors, int numNeighbors)
 {
-   double distanceToClosestNeighbor = DBL_MAX;    // DBL_MAX defined in <limits.h>
-   int    foundClosestNeighbor      = 0;
-   Boid   *closestNeighbor;
-   double tempDistance;
+   double distanceToClosestNeighbor = DBL_MAX;    // squared until the end
+   double dot, tempDistance, velocity2;
+   Vector vectorToObject;
+
+   const BoidNeighbor *n;
+   int                i;
 
-   std::list<Boid>::const_iterator listItr;
+   neighborhood.center.Set(0, 0, 0);
+   neighborhood.count           = 0;
+   neighborhood.closest         = NULL;
+   neighborhood.closestDistance = DBL_MAX;
+   velocity2                    = velocity * velocity;
 
    // Cycle through visible boids.
-   for (listItr = boidList.begin(); listItr != boidList.end(); listItr++)
+   for (i = 0; i < numNeighbors; i++)
    {
-      Boid n = *listItr;
+      n = &neighbors[i];
 
       // Skip boids that we don't need to consider
-      if (!visibleToSelf(&n))
+      if ((n->boidType != boidType) && flockSelectively)
       {
          continue;
       }
-      if ((n.boidType != boidType) && flockSelectively)
+
+      // Skip boids outside our field of view (see visibleToSelf).
+      vectorToObject = n->position - position;
+      dot            = velocity * vectorToObject;
+      tempDistance   = vectorToObject * vectorToObject;
+      if ((dot <= 0) || ((dot * dot) < FIELD_OF_VIEW_COS2 * velocity2 * tempDistance))
       {
          continue;
       }
 
-      // Find distance from the current boid to self
-      tempDistance = Magnitude(n.position - position);
+      neighborhood.center += (double)n->count * n->position;
+      neighborhood.count  += n->count;
 
-      // remember distance to closest boid
+      // remember closest boid
       if (tempDistance < distanceToClosestNeighbor)
       {
          distanceToClosestNeighbor = tempDistance;
-         foundClosestNeighbor      = 1;
-         closestNeighbor           = &n;
+         neighborhood.closest      = n;
       }
    }
 
+   if (neighborhood.count != 0)
+   {
+      neighborhood.center         /= (double)neighborhood.count;
+      neighborhood.closestDistance = sqrt(distanceToClosestNeighbor);
+   }
+}
+
+
+Vector
+Boid::maintainingCruisingDistance(const BoidNeighbor *neighbors, int numNeighbors)
+{
+   if (!surveyed)
+   {
+      surveyNeighbors(neighbors, numNeighbors);
+   }
+
    Vector speedAdjustmentVector(0, 0, 0);
 
-   if (foundClosestNeighbor)
+   if (neighborhood.closest != NULL)
    {
       // Have the boid try to remain at least cruiseDistance away from its
       // nearest neighbor at all times in all directions (i.e., don't violate
       // your neighbor's "personal space" bounding sphere of radius
       // cruiseDistance, but stay as close to the neighbor as possible).
 
-      Vector separationVector = closestNeighbor->getPosition() - position;
+      Vector separationVector = neighborhood.closest->position - position;
 
       float separateFactor = 0.09;
       float approachFactor = 0.05;
@@ -321,47 +329,23 @@ Boid::maintainingCruisingDistance(const std::list<Boid>& boidList)
 
 
 Vector
-Boid::velocityMatching(const std::list<Boid>& boidList)
+Boid::velocityMatching(const BoidNeighbor *neighbors, int numNeighbors)
 {
    Vector velocityOfClosestNeighbor(0, 0, 0);
-   double tempDistance;
-   double distanceToClosestNeighbor = DBL_MAX;
 
-   std::list<Boid>::const_iterator listItr;
-
-   // Cycle through visible boids.
-   for (listItr = boidList.begin(); listItr != boidList.end(); listItr++)
+   if (!surveyed)
    {
-      Boid n = *listItr;
-
-      // Skip boids that we don't need to consider
-      if (!visibleToSelf(&n))
-      {
-         continue;
-      }
-      if ((n.boidType != boidType) && flockSelectively)
-      {
-         continue;
-      }
-
-      // Find distance from the current boid to self
-      tempDistance = Magnitude(n.position - position);
-
-      // remember velocity vector of closest boid
-      if (tempDistance < distanceToClosestNeighbor)
-      {
-         distanceToClosestNeighbor = tempDistance;
-         velocityOfClosestNeighbor = n.velocity;
-      }
+      surveyNeighbors(neighbors, numNeighbors);
    }
 
    // If we found a close boid, set the percentage of our acceleration that
    // we want to use in order to begin flying parallel to its velocity vector.
    // -- Otherwise, if we couldn't find a closest boid, velocityOfClosestNeighbor
    //    will have a magnitude of 0 and thus have no effect on navigation.
-   if (distanceToClosestNeighbor != DBL_MAX)
+   if (neighborhood.closest != NULL)
    {
       // return velocity vector of closest boid so we can try to match it
+      velocityOfClosestNeighbor = neighborhood.closest->velocity;
       velocityOfClosestNeighbor.SetMagnitude(0.05);
    }
 
@@ -370,41 +354,21 @@ Boid::velocityMatching(const std::list<Boid>& boidList)
 
 
 Vector
-Boid::flockCentering(const std::list<Boid>& boidList)
+Boid::flockCentering(const BoidNeighbor *neighbors, int numNeighbors)
 {
    Vector t;
-   double boids_observed = 0;                     // number of boids that were checked
-   Vector flockcenter(0, 0, 0);                   // approximate center of flock
 
-   std::list<Boid>::const_iterator listItr;
-
-   // Calculate approximate center of flock by averaging the positions of all
-   // visible boids that we are flocking with.
-
-   // Cycle through visible boids.
-   for (listItr = boidList.begin(); listItr != boidList.end(); listItr++)
+   if (!surveyed)
    {
-      Boid n = *listItr;
-
-      if (!visibleToSelf(&n))
-      {
-         continue;
-      }
-      if ((n.boidType != boidType) && flockSelectively)
-      {
-         continue;
-      }
-
-      flockcenter += n.position;
-      boids_observed++;
+      surveyNeighbors(neighbors, numNeighbors);
    }
 
-   if (boids_observed != 0)
+   // Head towards the approximate center of flock: the average of the
+   // positions of all visible boids that we are flocking with.
+   if (neighborhood.count != 0)
    {
-      flockcenter /= boids_observed;
-
       // now calculate a vector to head towards center of flock
-      t = flockcenter - position;
+      t = neighborhood.center - position;
 
       // and the percentage of maximum acceleration (in decimal) to use when yaw toward center
       t.SetMagnitude(0.1);
@@ -421,7 +385,19 @@ Boid::flockCentering(const std::list<Boid>& boidList)
 
 // Update velocity and acceleration, and determine new position.
 void
-Boid::aim(const std::list<Boid>& boidList, float simRate)
+Boid::aim(const BoidNeighbor *neighbors, int numNeighbors, float simRate)
+{
+   fly(simRate);
+
+   // remember desired acceleration (the acceleration vector that the
+   // Navigator() module specified
+   acceleration = navigator(neighbors, numNeighbors);
+}
+
+
+// Determine new position and velocity from previous acceleration.
+void
+Boid::fly(float simRate)
 {
    if (flightflag == false)
    {
@@ -508,10 +484,22 @@ Boid::aim(const std::list<Boid>& boidList, float simRate)
 
    // remember current velocity
    oldVelocity = velocity;
+}
 
-   // remember desired acceleration (the acceleration vector that the
-   // Navigator() module specified
-   acceleration = navigator(boidList);
+
+// Set acceleration from a resolved steering vector.
+void
+Boid::steer(Vector steering)
+{
+   acceleration = steering * (maxAcceleration * maxVelocity);
+}
+
+
+// Determine acceleration of a flown boid.
+void
+Boid::navigate(const BoidNeighbor *neighbors, int numNeighbors)
+{
+   acceleration = navigator(neighbors, numNeighbors);
 }
 
 
@@ -527,6 +515,7 @@ Boid::move()
 Boid::Boid(Vector bPosition, Vector bVelocity, Vector bDimensions)
 {
    flightflag       = false;                      // haven't flown yet
+   surveyed         = false;
    position         = bPosition;
    velocity         = bVelocity;
    dimensions       = bDimensions;                // width, height, length
@@ -555,6 +544,7 @@ Boid::Boid(Vector bPosition, Vector bVelocity, Vector bDimensions,
            int bBoidType, int bBoidNumber)
 {
    flightflag       = false;                      // haven't flown yet
+   surveyed         = false;
    position         = bPosition;
    velocity         = bVelocity;
    dimensions       = bDimensions;                // width, height, length
@@ -45,8 +45,30 @@
 #define MAX_ACCELERATION    0.9
 #define CRUISE_DISTANCE     0.1
 
+// Field of view half-angle [radians], and its squared cosine for
+// dot product tests.
+#define FIELD_OF_VIEW         1.0471967
+#define FIELD_OF_VIEW_COS2    0.25000073715823950
+
+struct BoidNeighbor
+{
+   Vector position;
+   Vector velocity;
+   int    boidType;
+   int    boidNumber;
+   int    count;
+};
+// Read-only view of a neighboring boid: the state the steering
+// functions use, without the SimObject base and name of a full Boid.
+// Neighbors are passed to aim() as a contiguous array. A view may
+// also stand for a group of count boids, at their centroid with their
+// mean velocity; such views have boidType and boidNumber -1.
+
 class Boid : public SimObject
 {
+   friend class FlockKernel;
+   // Resolves navigator() priorities with vectorized neighbor terms.
+
 public:
 
    enum boidTypes
@@ -69,11 +91,27 @@ public:
 
    // Clone boid.
 
-   virtual void aim(const std::list<Boid>& boidList, float simRate = 1.0f);
+   virtual void aim(const BoidNeighbor *neighbors, int numNeighbors, float simRate = 1.0f);
 
    // Updates velocity and acceleration and determines the new position of
    // the object based on the previous acceleration and velocity.
 
+   virtual void fly(float simRate = 1.0f);
+
+   // Determines the new position and velocity from the previous
+   // acceleration. This is the first half of aim().
+
+   void steer(Vector steering);
+
+   // Sets the acceleration from a steering vector resolved outside
+   // navigator(), as a fraction of maximum acceleration. This is the
+   // second half of aim().
+
+   void navigate(const BoidNeighbor *neighbors, int numNeighbors);
+
+   // Sets the acceleration from navigator(). aim() is fly() followed by
+   // navigate(), for callers that search for neighbors after flying.
+
    virtual void move(void);
 
    // Move the object to the position determined by aim().
@@ -122,9 +160,15 @@ public:
 
    // Returns the type of this boid.
 
+   bool getFlockSelectively(void) const { return(flockSelectively); }
+   // Returns true if this boid flocks only with boids of its own type.
+
    int getBoidNumber() { return(boidNumber); }
    // Returns the number of this boid.
 
+   void getNeighbor(BoidNeighbor *neighbor);
+   // Fills in a neighbor view of this boid.
+
 protected:
 
    virtual double getGravAcceleration(void) const;
@@ -162,6 +206,7 @@ protected:
    // circumstances.
 
    virtual bool visibleToSelf(Boid *b);
+   virtual bool visibleToSelf(const BoidNeighbor *b);
 
    // Returns true if this boid can see boid b.
 
@@ -186,24 +231,24 @@ protected:
    // with a specific obstacle, and returns an acceleration vector indicating
    // how the boid should accelerate to achieve this end.
 
-   virtual Vector maintainingCruisingDistance(const std::list<Boid>& boidList);
+   virtual Vector maintainingCruisingDistance(const BoidNeighbor *neighbors, int numNeighbors);
 
    // Returns a vector which indicates how the boid would like to accelerate
    // in order to maintain a distance of cruiseDistance from the nearest
    // visible boid.
 
-   virtual Vector velocityMatching(const std::list<Boid>& boidList);
+   virtual Vector velocityMatching(const BoidNeighbor *neighbors, int numNeighbors);
 
    // Returns a vector which indicates how the boid would like to accelerate
    // in order to fly at approximately the same speed and direction as the
    // nearby boids.
 
-   virtual Vector flockCentering(const std::list<Boid>& boidList);
+   virtual Vector flockCentering(const BoidNeighbor *neighbors, int numNeighbors);
 
    // Returns a vector which indicates how the boid would like to accelerate
    // in order to be near the center of the flock.
 
-   virtual Vector navigator(const std::list<Boid>& boidList);
+   virtual Vector navigator(const BoidNeighbor *neighbors, int numNeighbors);
 
    // This method prioritizes and resolves the acceleration vectors from
    // CollisionAvoidance(), FlockCentering(), MaintainingCruisingDistance(),
@@ -211,6 +256,26 @@ protected:
    // acceleration vector that the boid will apply to its flight in the
    // current time step. It is supplied a list of visible boids.
 
+   typedef struct
+   {
+      Vector             center;                  // center of visible flockmates
+      int                count;                   // number of visible flockmates
+      const BoidNeighbor *closest;                // closest visible flockmate, or NULL
+      double             closestDistance;         // [m] distance to closest
+   } NEIGHBORHOOD;
+
+   virtual void surveyNeighbors(const BoidNeighbor *neighbors, int numNeighbors);
+
+   // Visits each neighbor once, and records the flock center and the
+   // closest visible flockmate in neighborhood. Visibility is a dot
+   // product test against the field of view cosine, and distances are
+   // compared squared. navigator() surveys once for all the flocking
+   // rules; a rule called on its own surveys for itself.
+
+   NEIGHBORHOOD neighborhood;
+   bool         surveyed;
+   // Survey of the neighbors passed to the current navigator() call.
+
    double bodyLength;
    // [m] Length of the boid. By default this value is equal to the z
    // component of the bDimensions passed to the constructor.
@@ -291,6 +356,39 @@ Boid::visibleToSelf(Boid *b)
 }
 
 
+inline bool
+Boid::visibleToSelf(const BoidNeighbor *b)
+{
+   // find out if the boid b is within our field of view
+   Vector vectorToObject = b->position - position;
+
+   // Same as AngleBetween(velocity, vectorToObject) <= FIELD_OF_VIEW,
+   // without the acos and square roots.
+   double dot = velocity * vectorToObject;
+
+   if ((dot > 0) && ((dot * dot) >= FIELD_OF_VIEW_COS2 *
+                     (velocity * velocity) * (vectorToObject * vectorToObject)))
+   {
+      return(true);
+   }
+   else
+   {
+      return(false);
+   }
+}
+
+
+inline void
+Boid::getNeighbor(BoidNeighbor *neighbor)
+{
+   neighbor->position   = position;
+   neighbor->velocity   = velocity;
+   neighbor->boidType   = boidType;
+   neighbor->boidNumber = boidNumber;
+   neighbor->count      = 1;
+}
+
+
 inline float
 Boid::getProbeLength(void)
 {
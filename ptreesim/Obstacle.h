@@ -47,6 +47,12 @@ class Box;
 class Sphere;
 class ObstacleList;
 
+// Bounding volume hierarchy: obstacles per leaf, maximum depth, and
+// bounds padding.
+#define BVH_LEAF_SIZE    4
+#define BVH_DEPTH        64
+#define BVH_PAD          1.0e-6
+
 //---------------- CLASS OBSTACLE ------------------------------
 
 // A generic object class
@@ -69,6 +75,12 @@ public:
    // Does a ray intersect this obstacle if it projects from rayorigin in the
    // direction specified by raydirection? raydirection MUST NOT be (0,0,0) !
 
+   virtual void Bounds(Vector& lower, Vector& upper) const;
+
+   // Axis-aligned box containing every intersection point this obstacle
+   // can report. The default is unbounded, so obstacles that do not
+   // override it are tested by every ray query.
+
    virtual int getId(void) const;
 
    virtual void setId(int id);
@@ -107,6 +119,8 @@ public:
 
    friend int operator==(const Polygon& a, const Polygon& b);
 
+   virtual void Bounds(Vector& lower, Vector& upper) const;
+
 protected:
    virtual ISectData IntersectionWithRay(const Vector& raydirection,
                                          const Vector& rayorigin) const;
@@ -151,6 +165,8 @@ public:
 
    friend int operator==(const Box& a, const Box& b);
 
+   virtual void Bounds(Vector& lower, Vector& upper) const;
+
 protected:
    virtual ISectData IntersectionWithRay(const Vector& raydirection,
                                          const Vector& rayorigin) const;
@@ -182,6 +198,8 @@ public:
 
    friend int operator==(const Sphere& a, const Sphere& b);
 
+   virtual void Bounds(Vector& lower, Vector& upper) const;
+
 protected:
    virtual ostream& Disp(ostream& strm) const;
 
@@ -213,6 +231,21 @@ public:
 
    void ResetIter(void);
 
+   ISectData IntersectRay(const Vector& raydirection, const Vector& rayorigin,
+                          double range) const;
+
+   // Returns the closest intersection of a ray with any obstacle, within
+   // range of rayorigin. Only obstacles whose bounds the probe line
+   // segment (rayorigin +/- range along raydirection) crosses are tested.
+   // Reentrant.
+
+   Obstacle *Iter(void **cursor) const;
+
+   void ResetIter(void **cursor) const;
+
+   // Reentrant iteration: the caller owns the cursor, so several threads
+   // may walk the list at once.
+
    ObstacleList(void);
 
    ~ObstacleList(void);
@@ -239,6 +272,28 @@ private:
 
    obnode *head;
    obnode *iterptr;
+
+   // Bounding volume hierarchy over the obstacles, rebuilt on Add() and
+   // Delete(). Interior nodes have their first child at the next index.
+   struct bvnode
+   {
+      Vector lower, upper;                        // bounds of obstacles below
+      int    first, count;                        // leaf obstacles (count > 0)
+      int    right;                               // second child (interior)
+   };
+
+   bvnode   *nodes;
+   int      numNodes;
+   Obstacle **leaves;
+   Vector   *lowers, *uppers;
+
+   void Index(void);
+
+   // Rebuilds the hierarchy.
+
+   int IndexNode(int first, int count);
+
+   // Builds the node for leaves [first, first + count); returns its index.
 };
 
 // ----------------------------- -------------- --------------------------
@@ -368,7 +423,11 @@ Sphere::Disp(ostream& strm) const
 inline
 ObstacleList::ObstacleList(void)
 {
-   head = NULL;
+   head     = NULL;
+   nodes    = NULL;
+   numNodes = 0;
+   leaves   = NULL;
+   lowers   = uppers = NULL;
 }
 
 
@@ -406,4 +465,28 @@ ObstacleList::ResetIter(void)
 }
 
 
+inline Obstacle *
+ObstacleList::Iter(void **cursor) const
+{
+   obnode *foo = (obnode *)*cursor;
+
+   if (foo != NULL)
+   {
+      *cursor = foo->next;
+      return(foo->obj);
+   }
+   else
+   {
+      return(NULL);
+   }
+}
+
+
+inline void
+ObstacleList::ResetIter(void **cursor) const
+{
+   *cursor = head;
+}
+
+
 #endif                                            /* #ifndef _OBSTACLE_H */
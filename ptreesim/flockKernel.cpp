@@ -0,0 +1,512 @@
+/*
+ * File Name : flockKernel.cpp
+ *
+ * Description : Structure-of-arrays flocking kernel.
+ */
+
+#include "flockKernel.hpp"
+#include <float.h>
+#include <assert.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FLOCK_X86
+#define FLOCK_TARGET(isa)    __attribute__((target(isa)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define FLOCK_X86
+#define FLOCK_TARGET(isa)
+#include <intrin.h>
+#endif
+#ifdef FLOCK_X86
+#include <immintrin.h>
+#endif
+
+// Field of view test, as Boid::visibleToSelf.
+// A neighbor is visible if dot > 0 and dot^2 >= FOV_COS2 * d^2 * v^2,
+// where d is the offset to the neighbor and v the boid's velocity.
+#define FOV_COS2    ((float)FIELD_OF_VIEW_COS2)
+
+// Constructor.
+FlockKernel::FlockKernel(ISA isa)
+{
+   if ((isa == AUTO_ISA) || !supports(isa))
+   {
+      if (supports(AVX512_ISA) && (isa != AVX2_ISA))
+      {
+         isa = AVX512_ISA;
+      }
+      else if (supports(AVX2_ISA))
+      {
+         isa = AVX2_ISA;
+      }
+      else
+      {
+         isa = SCALAR_ISA;
+      }
+   }
+   this->isa = isa;
+   size      = 0;
+}
+
+
+// Instruction set supported by processor?
+bool FlockKernel::supports(ISA isa)
+{
+   switch (isa)
+   {
+   case SCALAR_ISA:
+      return(true);
+
+#if defined(FLOCK_X86) && defined(__GNUC__)
+   case AVX2_ISA:
+      __builtin_cpu_init();
+      return(__builtin_cpu_supports("avx2") != 0);
+
+   case AVX512_ISA:
+      __builtin_cpu_init();
+      return(__builtin_cpu_supports("avx512f") != 0);
+#elif defined(FLOCK_X86)
+   case AVX2_ISA:
+   case AVX512_ISA:
+      {
+         int              info[4];
+         unsigned __int64 xcr;
+
+         // Processor and operating system must both support the registers.
+         __cpuid(info, 1);
+         if ((info[2] & (1 << 27)) == 0)
+         {
+            return(false);
+         }
+         xcr = _xgetbv(0);
+         __cpuidex(info, 7, 0);
+         if (isa == AVX2_ISA)
+         {
+            return(((xcr & 0x6) == 0x6) && ((info[1] & (1 << 5)) != 0));
+         }
+         return(((xcr & 0xe6) == 0xe6) && ((info[1] & (1 << 16)) != 0));
+      }
+#endif
+
+   default:
+      return(false);
+   }
+}
+
+
+// Instruction set name.
+const char *FlockKernel::isaName(ISA isa)
+{
+   switch (isa)
+   {
+   case SCALAR_ISA:
+      return("scalar");
+
+   case AVX2_ISA:
+      return("avx2");
+
+   case AVX512_ISA:
+      return("avx512");
+
+   default:
+      return("auto");
+   }
+}
+
+
+// Load tick-start state.
+void FlockKernel::load(int size)
+{
+   this->size = size;
+   if ((int)px.size() < size)
+   {
+      px.resize(size);
+      py.resize(size);
+      pz.resize(size);
+      vx.resize(size);
+      vy.resize(size);
+      vz.resize(size);
+      type.resize(size);
+   }
+}
+
+
+void FlockKernel::setBoid(int slot, Boid *boid)
+{
+   Vector position, velocity;
+   int    number;
+
+#ifdef _DEBUG
+   assert(slot >= 0 && slot < size);
+#endif
+   position   = boid->getPosition();
+   velocity   = boid->getVelocity();
+   px[slot]   = (float)position.x;
+   py[slot]   = (float)position.y;
+   pz[slot]   = (float)position.z;
+   vx[slot]   = (float)velocity.x;
+   vy[slot]   = (float)velocity.y;
+   vz[slot]   = (float)velocity.z;
+   type[slot] = boid->getBoidType();
+   number     = boid->getBoidNumber();
+   if (number >= (int)slots.size())
+   {
+      slots.resize((number * 2) + 1, -1);
+   }
+   slots[number] = slot;
+}
+
+
+// Resolve steering of a flown boid in a slot against neighbors.
+Vector FlockKernel::navigate(int slot, Boid *boid, const BoidNeighbor *neighbors,
+                             int numNeighbors)
+{
+   float  self[7];
+   int    flockType, closest;
+   TERMS  terms;
+   Vector position, velocity, center(0, 0, 0), match(0, 0, 0);
+   Vector vacc(0, 0, 0);                          // vector accumulator
+
+   position = boid->getPosition();
+   velocity = boid->getVelocity();
+   self[0]  = (float)position.x;
+   self[1]  = (float)position.y;
+   self[2]  = (float)position.z;
+   self[3]  = (float)velocity.x;
+   self[4]  = (float)velocity.y;
+   self[5]  = (float)velocity.z;
+   self[6]  = FOV_COS2 * ((self[3] * self[3]) + (self[4] * self[4]) + (self[5] * self[5]));
+   if (boid->flockSelectively)
+   {
+      flockType = boid->boidType;
+   }
+   else
+   {
+      flockType = -1;
+   }
+
+   // Reduce neighbor terms.
+   switch (isa)
+   {
+#ifdef FLOCK_X86
+   case AVX512_ISA:
+      reduceAVX512(slot, self, flockType, neighbors, numNeighbors, &terms);
+      break;
+
+   case AVX2_ISA:
+      reduceAVX2(slot, self, flockType, neighbors, numNeighbors, &terms);
+      break;
+#endif
+
+   default:
+      reduceScalar(slot, self, flockType, neighbors, numNeighbors, &terms);
+      break;
+   }
+
+   // Flock centering: head towards the center of visible boids.
+   if (terms.count > 0)
+   {
+      center.x = ((double)terms.cx / (double)terms.count) - position.x;
+      center.y = ((double)terms.cy / (double)terms.count) - position.y;
+      center.z = ((double)terms.cz / (double)terms.count) - position.z;
+      center.SetMagnitude(0.1);
+   }
+
+   // Velocity matching: fly parallel to the closest visible boid.
+   if (terms.closest >= 0)
+   {
+      closest = slots[neighbors[terms.closest].boidNumber];
+      match.x = (double)vx[closest];
+      match.y = (double)vy[closest];
+      match.z = (double)vz[closest];
+      match.SetMagnitude(0.05);
+   }
+
+   // Accumulate in Boid::navigator priority order.
+   if (boid->accumulate(vacc, boid->collisionAvoidance()) >= 1.0)
+   {
+      return(vacc);
+   }
+   if (boid->accumulate(vacc, center) >= 1.0)
+   {
+      return(vacc);
+   }
+   if (boid->accumulate(vacc, match) >= 1.0)
+   {
+      return(vacc);
+   }
+   if (boid->accumulate(vacc, boid->wander()) >= 1.0)
+   {
+      return(vacc);
+   }
+   boid->accumulate(vacc, boid->levelFlight(vacc));
+   return(vacc);
+}
+
+
+// Reduce neighbor terms one neighbor at a time.
+// The boid itself is skipped without testing its visibility.
+void FlockKernel::reduceScalar(int slot, const float *self, int flockType,
+                               const BoidNeighbor *neighbors, int numNeighbors,
+                               TERMS *terms)
+{
+   register int i, j;
+   float        dx, dy, dz, d2, dot;
+
+   terms->cx      = terms->cy = terms->cz = 0.0f;
+   terms->count   = 0;
+   terms->d2      = FLT_MAX;
+   terms->closest = -1;
+   for (i = 0; i < numNeighbors; i++)
+   {
+      j = slots[neighbors[i].boidNumber];
+      if (j == slot)
+      {
+         continue;
+      }
+      dx  = px[j] - self[0];
+      dy  = py[j] - self[1];
+      dz  = pz[j] - self[2];
+      d2  = (dx * dx) + (dy * dy) + (dz * dz);
+      dot = (self[3] * dx) + (self[4] * dy) + (self[5] * dz);
+      if ((dot <= 0.0f) || ((dot * dot) < (self[6] * d2)))
+      {
+         continue;
+      }
+      if ((flockType >= 0) && (type[j] != flockType))
+      {
+         continue;
+      }
+      terms->cx += px[j];
+      terms->cy += py[j];
+      terms->cz += pz[j];
+      terms->count++;
+      if (d2 < terms->d2)
+      {
+         terms->d2      = d2;
+         terms->closest = i;
+      }
+   }
+}
+
+
+#ifdef FLOCK_X86
+// Reduce neighbor terms 8 neighbors at a time.
+// Neighbors past the end are padded with the boid itself, which is
+// never visible to itself.
+FLOCK_TARGET("avx2")
+void FlockKernel::reduceAVX2(int slot, const float *self, int flockType,
+                             const BoidNeighbor *neighbors, int numNeighbors,
+                             TERMS *terms)
+{
+   register int i, j;
+   int          index[8], best[8];
+   float        cx[8], cy[8], cz[8], count[8], d2s[8];
+   __m256i      vindex, vbest, vlane, vtype;
+   __m256       sx, sy, sz, svx, svy, svz, sfov, zero, one, inf;
+   __m256       x, y, z, dx, dy, dz, d2, dot, visible, closer;
+   __m256       vcx, vcy, vcz, vcount, vd2;
+
+   sx     = _mm256_set1_ps(self[0]);
+   sy     = _mm256_set1_ps(self[1]);
+   sz     = _mm256_set1_ps(self[2]);
+   svx    = _mm256_set1_ps(self[3]);
+   svy    = _mm256_set1_ps(self[4]);
+   svz    = _mm256_set1_ps(self[5]);
+   sfov   = _mm256_set1_ps(self[6]);
+   zero   = _mm256_setzero_ps();
+   one    = _mm256_set1_ps(1.0f);
+   inf    = _mm256_set1_ps(FLT_MAX);
+   vtype  = _mm256_set1_epi32(flockType);
+   vlane  = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+   vcx    = vcy = vcz = vcount = zero;
+   vd2    = inf;
+   vbest  = _mm256_set1_epi32(-1);
+   for (i = 0; i < numNeighbors; i += 8)
+   {
+      for (j = 0; j < 8; j++)
+      {
+         if (i + j < numNeighbors)
+         {
+            index[j] = slots[neighbors[i + j].boidNumber];
+         }
+         else
+         {
+            index[j] = slot;
+         }
+      }
+      vindex  = _mm256_loadu_si256((__m256i *)index);
+      x       = _mm256_i32gather_ps(&px[0], vindex, 4);
+      y       = _mm256_i32gather_ps(&py[0], vindex, 4);
+      z       = _mm256_i32gather_ps(&pz[0], vindex, 4);
+      dx      = _mm256_sub_ps(x, sx);
+      dy      = _mm256_sub_ps(y, sy);
+      dz      = _mm256_sub_ps(z, sz);
+      d2      = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx),
+                                            _mm256_mul_ps(dy, dy)),
+                              _mm256_mul_ps(dz, dz));
+      dot     = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(svx, dx),
+                                            _mm256_mul_ps(svy, dy)),
+                              _mm256_mul_ps(svz, dz));
+      visible = _mm256_and_ps(_mm256_cmp_ps(dot, zero, _CMP_GT_OQ),
+                              _mm256_cmp_ps(_mm256_mul_ps(dot, dot),
+                                            _mm256_mul_ps(sfov, d2), _CMP_GE_OQ));
+      if (flockType >= 0)
+      {
+         visible = _mm256_and_ps(visible, _mm256_castsi256_ps(
+                                    _mm256_cmpeq_epi32(_mm256_i32gather_epi32(&type[0], vindex, 4), vtype)));
+      }
+      vcx    = _mm256_add_ps(vcx, _mm256_and_ps(visible, x));
+      vcy    = _mm256_add_ps(vcy, _mm256_and_ps(visible, y));
+      vcz    = _mm256_add_ps(vcz, _mm256_and_ps(visible, z));
+      vcount = _mm256_add_ps(vcount, _mm256_and_ps(visible, one));
+      closer = _mm256_and_ps(visible, _mm256_cmp_ps(d2, vd2, _CMP_LT_OQ));
+      vd2    = _mm256_blendv_ps(vd2, d2, closer);
+      vbest  = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(vbest),
+                                                    _mm256_castsi256_ps(_mm256_add_epi32(vlane, _mm256_set1_epi32(i))),
+                                                    closer));
+   }
+
+   // Sum lanes; the closest neighbor breaks ties by order.
+   _mm256_storeu_ps(cx, vcx);
+   _mm256_storeu_ps(cy, vcy);
+   _mm256_storeu_ps(cz, vcz);
+   _mm256_storeu_ps(count, vcount);
+   _mm256_storeu_ps(d2s, vd2);
+   _mm256_storeu_si256((__m256i *)best, vbest);
+   terms->cx      = terms->cy = terms->cz = 0.0f;
+   terms->count   = 0;
+   terms->d2      = FLT_MAX;
+   terms->closest = -1;
+   for (j = 0; j < 8; j++)
+   {
+      terms->cx    += cx[j];
+      terms->cy    += cy[j];
+      terms->cz    += cz[j];
+      terms->count += (int)count[j];
+      if ((best[j] >= 0) && ((d2s[j] < terms->d2) ||
+                             ((d2s[j] == terms->d2) && (best[j] < terms->closest))))
+      {
+         terms->d2      = d2s[j];
+         terms->closest = best[j];
+      }
+   }
+}
+
+
+// Reduce neighbor terms 16 neighbors at a time.
+FLOCK_TARGET("avx512f")
+void FlockKernel::reduceAVX512(int slot, const float *self, int flockType,
+                               const BoidNeighbor *neighbors, int numNeighbors,
+                               TERMS *terms)
+{
+   register int i, j;
+   int          index[16], best[16], count[16];
+   float        cx[16], cy[16], cz[16], d2s[16];
+   __m512i      vindex, vbest, vlane, vtype, vcount, one;
+   __m512       sx, sy, sz, svx, svy, svz, sfov, zero;
+   __m512       x, y, z, dx, dy, dz, d2, dot;
+   __m512       vcx, vcy, vcz, vd2;
+   __mmask16    visible, closer;
+
+   sx     = _mm512_set1_ps(self[0]);
+   sy     = _mm512_set1_ps(self[1]);
+   sz     = _mm512_set1_ps(self[2]);
+   svx    = _mm512_set1_ps(self[3]);
+   svy    = _mm512_set1_ps(self[4]);
+   svz    = _mm512_set1_ps(self[5]);
+   sfov   = _mm512_set1_ps(self[6]);
+   zero   = _mm512_setzero_ps();
+   one    = _mm512_set1_epi32(1);
+   vtype  = _mm512_set1_epi32(flockType);
+   vlane  = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+   vcx    = vcy = vcz = zero;
+   vcount = _mm512_setzero_si512();
+   vd2    = _mm512_set1_ps(FLT_MAX);
+   vbest  = _mm512_set1_epi32(-1);
+   for (i = 0; i < numNeighbors; i += 16)
+   {
+      for (j = 0; j < 16; j++)
+      {
+         if (i + j < numNeighbors)
+         {
+            index[j] = slots[neighbors[i + j].boidNumber];
+         }
+         else
+         {
+            index[j] = slot;
+         }
+      }
+      vindex  = _mm512_loadu_si512(index);
+      x       = _mm512_i32gather_ps(vindex, &px[0], 4);
+      y       = _mm512_i32gather_ps(vindex, &py[0], 4);
+      z       = _mm512_i32gather_ps(vindex, &pz[0], 4);
+      dx      = _mm512_sub_ps(x, sx);
+      dy      = _mm512_sub_ps(y, sy);
+      dz      = _mm512_sub_ps(z, sz);
+      d2      = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx),
+                                            _mm512_mul_ps(dy, dy)),
+                              _mm512_mul_ps(dz, dz));
+      dot     = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(svx, dx),
+                                            _mm512_mul_ps(svy, dy)),
+                              _mm512_mul_ps(svz, dz));
+      visible = _mm512_cmp_ps_mask(dot, zero, _CMP_GT_OQ) &
+                _mm512_cmp_ps_mask(_mm512_mul_ps(dot, dot),
+                                   _mm512_mul_ps(sfov, d2), _CMP_GE_OQ);
+      if (flockType >= 0)
+      {
+         visible &= _mm512_cmpeq_epi32_mask(_mm512_i32gather_epi32(vindex, &type[0], 4), vtype);
+      }
+      vcx    = _mm512_mask_add_ps(vcx, visible, vcx, x);
+      vcy    = _mm512_mask_add_ps(vcy, visible, vcy, y);
+      vcz    = _mm512_mask_add_ps(vcz, visible, vcz, z);
+      vcount = _mm512_mask_add_epi32(vcount, visible, vcount, one);
+      closer = _mm512_mask_cmp_ps_mask(visible, d2, vd2, _CMP_LT_OQ);
+      vd2    = _mm512_mask_mov_ps(vd2, closer, d2);
+      vbest  = _mm512_mask_mov_epi32(vbest, closer,
+                                     _mm512_add_epi32(vlane, _mm512_set1_epi32(i)));
+   }
+
+   // Sum lanes; the closest neighbor breaks ties by order.
+   _mm512_storeu_ps(cx, vcx);
+   _mm512_storeu_ps(cy, vcy);
+   _mm512_storeu_ps(cz, vcz);
+   _mm512_storeu_ps(d2s, vd2);
+   _mm512_storeu_si512(count, vcount);
+   _mm512_storeu_si512(best, vbest);
+   terms->cx      = terms->cy = terms->cz = 0.0f;
+   terms->count   = 0;
+   terms->d2      = FLT_MAX;
+   terms->closest = -1;
+   for (j = 0; j < 16; j++)
+   {
+      terms->cx    += cx[j];
+      terms->cy    += cy[j];
+      terms->cz    += cz[j];
+      terms->count += count[j];
+      if ((best[j] >= 0) && ((d2s[j] < terms->d2) ||
+                             ((d2s[j] == terms->d2) && (best[j] < terms->closest))))
+      {
+         terms->d2      = d2s[j];
+         terms->closest = best[j];
+      }
+   }
+}
+
+
+#else
+// Vector instruction sets are not available on this processor.
+void FlockKernel::reduceAVX2(int slot, const float *self, int flockType,
+                             const BoidNeighbor *neighbors, int numNeighbors,
+                             TERMS *terms)
+{
+   reduceScalar(slot, self, flockType, neighbors, numNeighbors, terms);
+}
+
+
+void FlockKernel::reduceAVX512(int slot, const float *self, int flockType,
+                               const BoidNeighbor *neighbors, int numNeighbors,
+                               TERMS *terms)
+{
+   reduceScalar(slot, self, flockType, neighbors, numNeighbors, terms);
+}
+#endif
@@ -0,0 +1,90 @@
+/*
+ * File Name : flockKernel.hpp
+ *
+ * Description : Structure-of-arrays flocking kernel.
+ *               Boid state is snapshotted into float arrays at the
+ *               start of a tick, and the neighbor terms of the
+ *               navigator (flock centering and velocity matching)
+ *               are reduced 8 (AVX2) or 16 (AVX-512) neighbors at a
+ *               time, with a scalar fallback.
+ *
+ *               navigate() resolves the same priorities as
+ *               Boid::navigator: collision avoidance, flock centering,
+ *               velocity matching, wander and level flight, each
+ *               accumulated up to unit magnitude. Neighbor terms are
+ *               computed in single precision, so steering agrees
+ *               with Boid::navigator to within FLOCK_TOLERANCE of
+ *               maximum acceleration, except where a neighbor lies
+ *               on the edge of the field of view or ties for closest.
+ */
+
+#ifndef __FLOCKKERNEL_HPP__
+#define __FLOCKKERNEL_HPP__
+
+#include "Boid.h"
+#include <vector>
+
+// Steering tolerance, as a fraction of maximum acceleration.
+#define FLOCK_TOLERANCE    1.0e-5
+
+class FlockKernel
+{
+public:
+
+   // Instruction sets.
+   typedef enum { SCALAR_ISA, AVX2_ISA, AVX512_ISA, AUTO_ISA }
+   ISA;
+
+   // Constructor.
+   // An unsupported instruction set falls back to the best supported.
+   FlockKernel(ISA isa = AUTO_ISA);
+
+   // Instruction set supported by processor?
+   static bool supports(ISA isa);
+
+   // Instruction set name.
+   static const char *isaName(ISA isa);
+
+   // Load tick-start state.
+   void load(int size);
+   void setBoid(int slot, Boid *boid);
+
+   // Resolve steering of a flown boid in a slot against neighbors.
+   // Returns a fraction of maximum acceleration, as Boid::navigator.
+   Vector navigate(int slot, Boid *boid, const BoidNeighbor *neighbors,
+                   int numNeighbors);
+
+   // Neighbor term sums.
+   typedef struct
+   {
+      float cx, cy, cz;                           // visible position sum
+      int   count;                                // visible neighbors
+      float d2;                                   // closest distance squared
+      int   closest;                              // closest neighbor, or -1
+   } TERMS;
+
+   // Data members.
+   ISA                isa;
+   int                size;
+   std::vector<float> px, py, pz;
+   std::vector<float> vx, vy, vz;
+   std::vector<int>   type;
+   std::vector<int>   slots;                      // slot by boid number
+
+private:
+
+   // Reduce neighbor terms.
+   // slot is the boid's own, which is never visible to itself;
+   // self holds position, velocity and the visibility threshold;
+   // flockType is the type to flock with, or -1 for all types.
+   void reduceScalar(int slot, const float *self, int flockType,
+                     const BoidNeighbor *neighbors, int numNeighbors,
+                     TERMS *terms);
+   void reduceAVX2(int slot, const float *self, int flockType,
+                   const BoidNeighbor *neighbors, int numNeighbors,
+                   TERMS *terms);
+   void reduceAVX512(int slot, const float *self, int flockType,
+                     const BoidNeighbor *neighbors, int numNeighbors,
+                     TERMS *terms);
+};
+#endif
@@ -13,3 +13,6 @@
 typedef unsigned long long   TIME;
 #define INVALID_TIME    ((unsigned long long)(-1))
 TIME gettime();
+
+// Get time in microseconds since the initial call.
+TIME getmicrotime();
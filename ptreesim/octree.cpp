@@ -9,6 +9,10 @@
 
 #include "octree.hpp"
 #include <assert.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <new>
 
 // Constructors.
 OctObject::OctObject()
@@ -40,6 +44,9 @@ void OctObject::init(Point3D point, void *client)
    position     = point;
    node         = NULL;
    this->client = client;
+   tree         = NULL;
+   index        = -1;
+   velocity.set(0.0f, 0.0f, 0.0f);
 }
 
 
@@ -61,11 +68,37 @@ bool OctObject::move(float x, float y, float z)
 
 bool OctObject::move(Point3D point)
 {
-   position = point;
+   return(move(point, velocity));
+}
+
+
+// Move object with velocity.
+bool OctObject::move(Point3D point, Point3D velocity)
+{
+   if ((node != NULL) && node->tree->rebuilding)
+   {
+      position       = point;
+      this->velocity = velocity;
+      return(node->deferMove(this));
+   }
+   if (node != NULL)
+   {
+      node->shiftSums(this, point, velocity);
+   }
+   position       = point;
+   this->velocity = velocity;
    if (node != NULL)
    {
       return(node->move(this));
    }
+   if ((tree != NULL) && (tree->linear != NULL))
+   {
+      return(tree->linear->move(this));
+   }
+   if (tree != NULL)
+   {
+      return(tree->grid->move(this));
+   }
    return(false);
 }
 
@@ -77,6 +110,10 @@ void OctObject::remove()
    {
       node->tree->remove(this);
    }
+   else if (tree != NULL)
+   {
+      tree->remove(this);
+   }
 }
 
 
@@ -250,6 +287,30 @@ void Octree::init(Point3D center, float span, float precision)
    bounds.zmax     = center.m_z + span;
    objects.clear();
    load = 0;
+
+   // Median selection.
+   approximateMedian = false;
+   medianBuffer      = NULL;
+   medianBufferSize  = 0;
+
+   // Allocation pools.
+   nodePool.init(sizeof(OctNode));
+   objectPool.init(sizeof(OctObject));
+
+   // Pointer-based nodes.
+   backend   = POINTER_BACKEND;
+   linear    = NULL;
+   grid      = NULL;
+   cellSize  = 0.0f;
+   aggregate = false;
+
+   // Incremental moves.
+   rebuildThreshold  = 0.0f;
+   rebuilding        = false;
+   relinks           = 0;
+   relinkFraction    = 0.0f;
+   rebuildBuffer     = NULL;
+   rebuildBufferSize = 0;
 }
 
 
@@ -257,6 +318,22 @@ void Octree::init(Point3D center, float span, float precision)
 Octree::~Octree()
 {
    clear();
+   if (linear != NULL)
+   {
+      delete linear;
+   }
+   if (grid != NULL)
+   {
+      delete grid;
+   }
+   if (medianBuffer != NULL)
+   {
+      delete [] medianBuffer;
+   }
+   if (rebuildBuffer != NULL)
+   {
+      delete [] rebuildBuffer;
+   }
 }
 
 
@@ -264,13 +341,166 @@ void Octree::clear()
 {
    if (root != NULL)
    {
-      delete root;
+      deleteNode(root);
+   }
+   if (linear != NULL)
+   {
+      linear->clear();
+   }
+   if (grid != NULL)
+   {
+      grid->clear();
    }
    root = NULL;
    objects.clear();
 }
 
 
+// Allocate object from tree pool.
+OctObject *Octree::newObject(float x, float y, float z, void *client)
+{
+   return(new(objectPool.allocate())OctObject(x, y, z, client));
+}
+
+
+OctObject *Octree::newObject(Point3D point, void *client)
+{
+   return(new(objectPool.allocate())OctObject(point, client));
+}
+
+
+// Free object to tree pool.
+void Octree::deleteObject(OctObject *object)
+{
+#ifdef _DEBUG
+   assert(object != NULL);
+#endif
+   object->~OctObject();
+   objectPool.release(object);
+}
+
+
+// Allocate node from tree pool.
+OctNode *Octree::newNode(float x, float y, float z, float span,
+                         OctNode *parent, OctObject *object)
+{
+   return(new(nodePool.allocate())OctNode(x, y, z, span, this, parent, object));
+}
+
+
+OctNode *Octree::newNode(Point3D center, float span,
+                         OctNode *parent, OctObject *object)
+{
+   return(new(nodePool.allocate())OctNode(center, span, this, parent, object));
+}
+
+
+// Free node to tree pool.
+void Octree::deleteNode(OctNode *node)
+{
+#ifdef _DEBUG
+   assert(node != NULL);
+#endif
+   node->~OctNode();
+   nodePool.release(node);
+}
+
+
+// Set spatial index backend.
+// Objects already in the tree are re-indexed.
+void Octree::setBackend(BACKEND backend)
+{
+   register OctObject *o;
+
+   std::list<OctObject *>::iterator itr;
+
+   // Detach objects from current index.
+   for (itr = objects.begin(); itr != objects.end(); itr++)
+   {
+      o = *itr;
+      if (o->node != NULL)
+      {
+         o->node->remove(o);
+      }
+      else if (o->tree != NULL)
+      {
+         if (linear != NULL)
+         {
+            linear->remove(o);
+         }
+         else
+         {
+            grid->remove(o);
+         }
+      }
+   }
+   if (root != NULL)
+   {
+      deleteNode(root);
+      root = NULL;
+   }
+   if (linear != NULL)
+   {
+      delete linear;
+      linear = NULL;
+   }
+   if (grid != NULL)
+   {
+      delete grid;
+      grid = NULL;
+   }
+
+   this->backend = backend;
+   if (backend == LINEAR_BACKEND)
+   {
+      linear = new LinearOctree(this);
+#ifdef _DEBUG
+      assert(linear != NULL);
+#endif
+   }
+   else if (backend == GRID_BACKEND)
+   {
+      grid = new SpatialGrid(this, cellSize > 0.0f ? cellSize : (2.0f * span) / (float)GRID_CELLS);
+#ifdef _DEBUG
+      assert(grid != NULL);
+#endif
+   }
+
+   // Re-index objects.
+   for (itr = objects.begin(); itr != objects.end(); itr++)
+   {
+      o = *itr;
+      if (linear != NULL)
+      {
+         linear->insert(o);
+      }
+      else if (grid != NULL)
+      {
+         grid->insert(o);
+      }
+      else if (root == NULL)
+      {
+         root = newNode(center, span, NULL, o);
+      }
+      else
+      {
+         root->insert(o);
+      }
+   }
+}
+
+
+// Set grid backend cell size.
+void Octree::setCellSize(float size)
+{
+   cellSize = size;
+   if (grid != NULL)
+   {
+      setBackend(GRID_BACKEND);
+   }
+}
+
+
 // Insert object.
 bool Octree::insert(OctObject *object)
 {
@@ -285,9 +515,17 @@ bool Octree::insert(OctObject *object)
    }
 
    // Insert into tree.
-   if (root == NULL)
+   if (linear != NULL)
+   {
+      ret = linear->insert(object);
+   }
+   else if (grid != NULL)
+   {
+      ret = grid->insert(object);
+   }
+   else if (root == NULL)
    {
-      root = new OctNode(center, span, this, NULL, object);
+      root = newNode(center, span, NULL, object);
       ret  = true;
    }
    else
@@ -301,6 +539,7 @@ bool Octree::insert(OctObject *object)
 
    // Insert into object list.
    objects.push_back(object);
+   object->listEntry = --objects.end();
    load++;
 
    return(true);
@@ -310,10 +549,6 @@ bool Octree::insert(OctObject *object)
 // Remove object.
 void Octree::remove(OctObject *object)
 {
-   register OctObject *o;
-
-   std::list<OctObject *>::iterator itr;
-
 #ifdef _DEBUG
    assert(object != NULL);
 #endif
@@ -322,21 +557,109 @@ void Octree::remove(OctObject *object)
    {
       object->node->remove(object);
    }
+   else if (object->tree != NULL)
+   {
+      if (linear != NULL)
+      {
+         linear->remove(object);
+      }
+      else
+      {
+         grid->remove(object);
+      }
+   }
 
    // Remove from object list.
-   for (itr = objects.begin(); itr != objects.end(); itr++)
+#ifdef _DEBUG
+   assert(*object->listEntry == object);
+#endif
+   objects.erase(object->listEntry);
+   load--;
+}
+
+
+// Begin a round of object moves.
+bool Octree::beginMoves()
+{
+   relinks    = 0;
+   rebuilding = (backend == POINTER_BACKEND) && (rebuildThreshold > 0.0f) &&
+                (relinkFraction > rebuildThreshold);
+   return(rebuilding);
+}
+
+
+// End a round of object moves.
+void Octree::endMoves()
+{
+   if (rebuilding)
    {
-      o = *itr;
-      if (o == object)
+      rebuilding = false;
+      rebuild();
+   }
+   if (load > 0)
+   {
+      relinkFraction = (float)relinks / (float)load;
+   }
+   else
+   {
+      relinkFraction = 0.0f;
+   }
+}
+
+
+// Rebuild pointer tree in bulk from object list.
+// Objects are gathered into an array, emptying their nodes, and
+// the old nodes are freed before the tree is built top-down.
+void Octree::rebuild()
+{
+   register int       i;
+   register OctObject *object;
+
+   std::list<OctObject *>::iterator itr;
+
+#ifdef _DEBUG
+   assert(backend == POINTER_BACKEND);
+#endif
+   if (rebuildBufferSize < load)
+   {
+      if (rebuildBuffer != NULL)
       {
-         break;
+         delete [] rebuildBuffer;
+      }
+      rebuildBufferSize = load * 2;
+      rebuildBuffer     = new OctObject *[rebuildBufferSize * 2];
+#ifdef _DEBUG
+      assert(rebuildBuffer != NULL);
+#endif
+   }
+   for (itr = objects.begin(), i = 0; itr != objects.end(); itr++, i++)
+   {
+      object = *itr;
+      if (object->node != NULL)
+      {
+         object->node->objects.clear();
+         object->node = NULL;
       }
+      rebuildBuffer[i] = object;
    }
 #ifdef _DEBUG
-   assert(itr != objects.end());
+   assert(i == load);
 #endif
-   objects.erase(itr);
-   load--;
+   if (root != NULL)
+   {
+      deleteNode(root);
+      root = NULL;
+   }
+   if (load == 0)
+   {
+      return;
+   }
+   root = newNode(center, span, NULL, NULL);
+   root->build(rebuildBuffer, load, &rebuildBuffer[rebuildBufferSize]);
+   if (aggregate)
+   {
+      root->sumObjects();
+   }
 }
 
 
@@ -356,152 +679,465 @@ void Octree::search(Point3D point, float radius,
                     std::list<OctObject *>& searchList)
 {
    searchList.clear();
-   if (root != NULL)
-   {
-      root->search(point, radius, searchList);
-   }
+   search(point, radius, append, &searchList);
 }
 
 
-// Search for visible objects.
-// Returns list of matching objects.
-void Octree::searchVisible(Frustum                 *frustum,
-                           std::list<OctObject *>& searchList)
+// Reentrant search.
+void Octree::search(Point3D point, float radius, OctSearchBuffer *buffer)
 {
-   searchList.clear();
-   if (root != NULL)
+   search(point, radius, OctSearchBuffer::visit, buffer);
+}
+
+
+void Octree::search(Point3D point, float radius, OCTVISITOR visitor, void *data)
+{
+   if (linear != NULL)
    {
-      root->searchVisible(frustum, searchList);
+      linear->search(point, radius, visitor, data);
+   }
+   else if (grid != NULL)
+   {
+      grid->search(point, radius, visitor, data);
+   }
+   else if (root != NULL)
+   {
+      root->search(point, radius, visitor, data);
    }
 }
 
 
-// Set bounds.
-void Octree::setBounds(BOUNDS bounds)
+// Search around an object in the tree.
+void Octree::search(OctObject *object, float radius, OctSearchBuffer *buffer)
 {
-   this->bounds = bounds;
+   search(object, radius, OctSearchBuffer::visit, buffer);
 }
 
 
-// Cull objects outside of bounds.
-// Returns list of culled objects.
-void Octree::cull(std::list<OctObject *>& cullList)
+void Octree::search(OctObject *object, float radius, OCTVISITOR visitor, void *data)
 {
-   register OctObject *object;
-
-   std::list<OctObject *>           tmpList;
-   std::list<OctObject *>::iterator itr;
+   register OctNode *node;
 
-   cullList.clear();
-   tmpList.clear();
-   for (itr = objects.begin(); itr != objects.end(); itr++)
+   if (linear != NULL)
    {
-      object = *itr;
-      if (!object->isInside(this))
+      if (object->tree == this)
       {
-         load--;
-         if (object->node != NULL)
-         {
-            object->node->remove(object);
-         }
-         cullList.push_back(object);
+         linear->search(object, radius, visitor, data);
       }
       else
       {
-         tmpList.push_back(object);
+         linear->search(object->position, radius, visitor, data);
       }
    }
-   objects.clear();
-   for (itr = tmpList.begin(); itr != tmpList.end(); itr++)
+   else if (grid != NULL)
    {
-      object = *itr;
-      objects.push_back(object);
+      grid->search(object->position, radius, visitor, data);
+   }
+   else if (root != NULL)
+   {
+      // Objects are held only by leaf nodes, so every match is under
+      // the first ancestor containing the search cube.
+      node = object->node;
+      if ((node == NULL) || (node->tree != this))
+      {
+         node = root;
+      }
+      while ((node->parent != NULL) && !node->contains(object->position, radius))
+      {
+         node = node->parent;
+      }
+      node->search(object->position, radius, visitor, data);
    }
 }
 
 
-// Find median point of objects.
-void Octree::findMedian()
+// Search for visible objects.
+// Returns list of matching objects.
+void Octree::searchVisible(Frustum                 *frustum,
+                           std::list<OctObject *>& searchList)
 {
-   register OctObject *o, *o2;
+   searchList.clear();
+   searchVisible(frustum, append, &searchList);
+}
 
-   std::list<OctObject *>::iterator itr;
-   float d, m;
 
-   if (load == 0)
-   {
-      median.m_x = (bounds.xmax - bounds.xmin) / 2.0f;
-      median.m_y = (bounds.ymax - bounds.ymin) / 2.0f;
-      median.m_z = (bounds.zmax - bounds.zmin) / 2.0f;
-      return;
-   }
+void Octree::searchVisible(Frustum *frustum, OctSearchBuffer *buffer)
+{
+   searchVisible(frustum, OctSearchBuffer::visit, buffer);
+}
+
 
-   // Get X median.
-   sortObjects(XSORT);
-   d = 0.0f;
-   m = ((float)load - 1.0f) / 2.0f;
-   for (itr = objects.begin(), o2 = NULL;
-        itr != objects.end(); itr++, o2 = o)
+void Octree::searchVisible(Frustum *frustum, OCTVISITOR visitor, void *data)
+{
+   if (linear != NULL)
    {
-      o = *itr;
-      if (d >= m)
-      {
-         break;
-      }
-      d += 1.0f;
+      linear->searchVisible(frustum, visitor, data);
    }
-   if (d > m)
+   else if (grid != NULL)
    {
-      median.m_x = (o2->position.m_x + o->position.m_x) / 2.0f;
+      grid->searchVisible(frustum, visitor, data);
    }
-   else
+   else if (root != NULL)
    {
-      median.m_x = o->position.m_x;
+      root->searchVisible(frustum, visitor, data);
    }
+}
+
 
-   // Get Y median.
-   sortObjects(YSORT);
-   d = 0.0f;
-   for (itr = objects.begin(), o2 = NULL;
-        itr != objects.end(); itr++, o2 = o)
+// Set aggregate mode.
+void Octree::setAggregate(bool mode)
+{
+   aggregate = mode;
+   if (aggregate && (root != NULL))
    {
-      o = *itr;
-      if (d >= m)
+      root->sumObjects();
+   }
+}
+
+
+// Aggregate search.
+void Octree::searchAggregate(Point3D point, float radius, Point3D direction,
+                             float cos2, float theta, OCTVISITOR visitor,
+                             OCTNODEVISITOR nodeVisitor, void *data)
+{
+   CONE  cone;
+   float length;
+
+   length = sqrt((direction.m_x * direction.m_x) + (direction.m_y * direction.m_y) +
+                 (direction.m_z * direction.m_z));
+   if (!aggregate || (backend != POINTER_BACKEND) || (length <= 0.0f))
+   {
+      search(point, radius, visitor, data);
+   }
+   else if (root != NULL)
+   {
+      cone.axis.m_x = direction.m_x / length;
+      cone.axis.m_y = direction.m_y / length;
+      cone.axis.m_z = direction.m_z / length;
+      cone.cosine   = sqrt(cos2);
+      cone.sine     = sqrt(1.0f - cos2);
+      root->searchAggregate(point, radius, &cone, theta,
+                            visitor, nodeVisitor, data);
+   }
+}
+
+
+// Join.
+// Passes each pair of objects within radius to the visitor once.
+void Octree::join(float radius, OCTPAIRVISITOR visitor, void *data)
+{
+   if (linear != NULL)
+   {
+      linear->join(radius, visitor, data);
+   }
+   else if (grid != NULL)
+   {
+      grid->join(radius, visitor, data);
+   }
+   else if (root != NULL)
+   {
+      root->join(radius, visitor, data);
+   }
+}
+
+
+// Join against another tree.
+// Objects of this tree are passed first.
+void Octree::join(Octree *tree, float radius, OCTPAIRVISITOR visitor, void *data)
+{
+   PAIR pair;
+
+   std::list<OctObject *>::iterator itr;
+
+   if ((linear != NULL) && (tree->linear != NULL))
+   {
+      linear->join(tree->linear, radius, visitor, data);
+   }
+   else if ((backend == POINTER_BACKEND) && (tree->backend == POINTER_BACKEND))
+   {
+      if ((root != NULL) && (tree->root != NULL))
       {
-         break;
+         root->join(tree->root, radius, visitor, data);
+      }
+   }
+   else
+   {
+      // Grids and mixed backends: search the other tree for each object.
+      pair.swap    = false;
+      pair.visitor = visitor;
+      pair.data    = data;
+      for (itr = objects.begin(); itr != objects.end(); itr++)
+      {
+         pair.object = *itr;
+         tree->search(pair.object->position, radius, visitPair, &pair);
       }
-      d += 1.0f;
    }
-   if (d > m)
+}
+
+
+// Search result to join result adapter.
+void Octree::visitPair(OctObject *object, void *pair)
+{
+   PAIR *p = (PAIR *)pair;
+
+   if (p->swap)
    {
-      median.m_y = (o2->position.m_y + o->position.m_y) / 2.0f;
+      p->visitor(object, p->object, p->data);
    }
    else
    {
-      median.m_y = o->position.m_y;
+      p->visitor(p->object, object, p->data);
    }
+}
+
 
-   // Get Z median.
-   sortObjects(ZSORT);
-   d = 0.0f;
-   for (itr = objects.begin(), o2 = NULL;
-        itr != objects.end(); itr++, o2 = o)
+// Squared distance between cubes given by centers and half spans.
+float Octree::gapSquare(Point3D& center, float span,
+                        Point3D& center2, float span2)
+{
+   float d, g2;
+
+   g2 = 0.0f;
+   d  = center.m_x - center2.m_x;
+   d  = ((d < 0.0f) ? -d : d) - span - span2;
+   if (d > 0.0f)
    {
-      o = *itr;
-      if (d >= m)
+      g2 += d * d;
+   }
+   d = center.m_y - center2.m_y;
+   d = ((d < 0.0f) ? -d : d) - span - span2;
+   if (d > 0.0f)
+   {
+      g2 += d * d;
+   }
+   d = center.m_z - center2.m_z;
+   d = ((d < 0.0f) ? -d : d) - span - span2;
+   if (d > 0.0f)
+   {
+      g2 += d * d;
+   }
+   return(g2);
+}
+
+
+// Prepare index for concurrent searches.
+// Searches of a committed tree do not modify it.
+void Octree::commit()
+{
+   if (linear != NULL)
+   {
+      linear->commit();
+   }
+   else if (grid != NULL)
+   {
+      grid->commit();
+   }
+}
+
+
+// Visitor appending results to a list.
+void Octree::append(OctObject *object, void *list)
+{
+   ((std::list<OctObject *> *)list)->push_back(object);
+}
+
+
+// Set bounds.
+void Octree::setBounds(BOUNDS bounds)
+{
+   this->bounds = bounds;
+}
+
+
+// Cull objects outside of bounds.
+// Returns list of culled objects.
+void Octree::cull(std::list<OctObject *>& cullList)
+{
+   register OctObject *object;
+
+   std::list<OctObject *>::iterator itr;
+
+   cullList.clear();
+   for (itr = objects.begin(); itr != objects.end(); )
+   {
+      object = *itr;
+      if (!object->isInside(this))
+      {
+         load--;
+         if (object->node != NULL)
+         {
+            object->node->remove(object);
+         }
+         else if (object->tree != NULL)
+         {
+            if (linear != NULL)
+            {
+               linear->remove(object);
+            }
+            else
+            {
+               grid->remove(object);
+            }
+         }
+         cullList.push_back(object);
+         itr = objects.erase(itr);
+      }
+      else
+      {
+         itr++;
+      }
+   }
+}
+
+
+// Find median point of objects.
+void Octree::findMedian()
+{
+   register int i;
+
+   std::list<OctObject *>::iterator itr;
+
+   if (load == 0)
+   {
+      median.m_x = (bounds.xmax - bounds.xmin) / 2.0f;
+      median.m_y = (bounds.ymax - bounds.ymin) / 2.0f;
+      median.m_z = (bounds.zmax - bounds.zmin) / 2.0f;
+      return;
+   }
+   if (approximateMedian && (backend == POINTER_BACKEND))
+   {
+      findApproximateMedian();
+      return;
+   }
+
+   // Select medians from a contiguous position buffer.
+   if (medianBufferSize < load)
+   {
+      if (medianBuffer != NULL)
+      {
+         delete [] medianBuffer;
+      }
+      medianBufferSize = load * 2;
+      medianBuffer     = new float[medianBufferSize];
+#ifdef _DEBUG
+      assert(medianBuffer != NULL);
+#endif
+   }
+   for (itr = objects.begin(), i = 0; itr != objects.end(); itr++, i++)
+   {
+      medianBuffer[i] = (*itr)->position.m_x;
+   }
+   median.m_x = selectMedian(medianBuffer, load);
+   for (itr = objects.begin(), i = 0; itr != objects.end(); itr++, i++)
+   {
+      medianBuffer[i] = (*itr)->position.m_y;
+   }
+   median.m_y = selectMedian(medianBuffer, load);
+   for (itr = objects.begin(), i = 0; itr != objects.end(); itr++, i++)
+   {
+      medianBuffer[i] = (*itr)->position.m_z;
+   }
+   median.m_z = selectMedian(medianBuffer, load);
+}
+
+
+// Select median of values in expected linear time, reordering them.
+// An even count yields the mean of the two middle values.
+float Octree::selectMedian(float *values, int count)
+{
+   int   m;
+   float v;
+
+#ifdef _DEBUG
+   assert(count > 0);
+#endif
+   m = (count - 1) / 2;
+   std::nth_element(values, values + m, values + count);
+   v = values[m];
+   if ((count % 2) == 0)
+   {
+      v = (v + *std::min_element(values + m + 1, values + count)) / 2.0f;
+   }
+   return(v);
+}
+
+
+// Find approximate median point of objects.
+// Node counts are binned into per-axis histograms at MEDIAN_DEPTH,
+// and the median is interpolated within the bin holding it.
+void Octree::findApproximateMedian()
+{
+   int   xbins[1 << MEDIAN_DEPTH];
+   int   ybins[1 << MEDIAN_DEPTH];
+   int   zbins[1 << MEDIAN_DEPTH];
+   int   i, numBins;
+   float width;
+
+   numBins = 1 << MEDIAN_DEPTH;
+   for (i = 0; i < numBins; i++)
+   {
+      xbins[i] = ybins[i] = zbins[i] = 0;
+   }
+   if (root != NULL)
+   {
+      root->countObjects(0, xbins, ybins, zbins);
+   }
+   width      = (span * 2.0f) / (float)numBins;
+   median.m_x = histogramMedian(xbins, numBins, center.m_x - span, width, load);
+   median.m_y = histogramMedian(ybins, numBins, center.m_y - span, width, load);
+   median.m_z = histogramMedian(zbins, numBins, center.m_z - span, width, load);
+   if (median.m_x < bounds.xmin)
+   {
+      median.m_x = bounds.xmin;
+   }
+   if (median.m_x > bounds.xmax)
+   {
+      median.m_x = bounds.xmax;
+   }
+   if (median.m_y < bounds.ymin)
+   {
+      median.m_y = bounds.ymin;
+   }
+   if (median.m_y > bounds.ymax)
+   {
+      median.m_y = bounds.ymax;
+   }
+   if (median.m_z < bounds.zmin)
+   {
+      median.m_z = bounds.zmin;
+   }
+   if (median.m_z > bounds.zmax)
+   {
+      median.m_z = bounds.zmax;
+   }
+}
+
+
+// Median of histogram.
+float Octree::histogramMedian(int *bins, int numBins, float origin,
+                              float width, int count)
+{
+   int   i, sum;
+   float mid;
+
+   mid = (float)count / 2.0f;
+   for (i = sum = 0; i < numBins; i++)
+   {
+      if ((float)(sum + bins[i]) >= mid)
       {
          break;
       }
-      d += 1.0f;
+      sum += bins[i];
    }
-   if (d > m)
+   if (i == numBins)
    {
-      median.m_z = (o2->position.m_z + o->position.m_z) / 2.0f;
+      return(origin + (width * (float)numBins));
    }
-   else
+   if (bins[i] == 0)
    {
-      median.m_z = o->position.m_z;
+      return(origin + (width * (float)i));
    }
+   return(origin + (width * ((float)i + ((mid - (float)sum) / (float)bins[i]))));
 }
 
 
@@ -555,15 +1191,9 @@ void Octree::sortObjects(SORTTYPE type)
             }
          }
       }
-      objects.erase(itr2);
-      tmpList.push_back(object);
-   }
-   objects.clear();
-   for (itr = tmpList.begin(); itr != tmpList.end(); itr++)
-   {
-      object = *itr;
-      objects.push_back(object);
+      tmpList.splice(tmpList.end(), objects, itr2);
    }
+   objects.swap(tmpList);
 }
 
 
@@ -576,6 +1206,38 @@ void Octree::audit()
 
    std::list<OctObject *>::iterator itr, itr2;
 
+   if (linear != NULL)
+   {
+      for (itr = objects.begin(), count = 0; itr != objects.end(); itr++)
+      {
+         object = *itr;
+         assert(object->tree == this);
+         assert(object->node == NULL);
+         assert(*object->listEntry == object);
+         count++;
+      }
+      assert(count == load);
+      assert(count == linear->size);
+      linear->audit();
+      return;
+   }
+
+   if (grid != NULL)
+   {
+      for (itr = objects.begin(), count = 0; itr != objects.end(); itr++)
+      {
+         object = *itr;
+         assert(object->tree == this);
+         assert(object->node == NULL);
+         assert(*object->listEntry == object);
+         count++;
+      }
+      assert(count == load);
+      assert(count == grid->size);
+      grid->audit();
+      return;
+   }
+
    for (itr = objects.begin(), count = 0; itr != objects.end(); itr++)
    {
       object = *itr;
@@ -583,6 +1245,8 @@ void Octree::audit()
       assert(object->node->tree != NULL);
       assert(object->node->tree == this);
       assert(root != NULL && root->findNode(object->node));
+      assert(*object->listEntry == object);
+      assert(*object->nodeEntry == object);
       for (itr2 = object->node->objects.begin();
            itr2 != object->node->objects.end(); itr2++)
       {
@@ -627,12 +1291,12 @@ bool OctNode::findNode(OctNode *node)
 
 bool OctNode::auditNode(Octree *tree)
 {
-   register int       i;
+   register int       i, n;
    register OctObject *object, *object2;
 
    std::list<OctObject *>::iterator itr, itr2;
 
-   for (itr = objects.begin(); itr != objects.end(); itr++)
+   for (itr = objects.begin(), n = 0; itr != objects.end(); itr++, n++)
    {
       object = *itr;
       assert(object->node == this);
@@ -652,6 +1316,15 @@ bool OctNode::auditNode(Octree *tree)
       }
    }
 
+   for (i = 0; i < 8; i++)
+   {
+      if (children[i] != NULL)
+      {
+         n += children[i]->count;
+      }
+   }
+   assert(n == count);
+
    for (i = 0; i < 8; i++)
    {
       if ((children[i] != NULL) && !children[i]->auditNode(tree))
@@ -665,60 +1338,210 @@ bool OctNode::auditNode(Octree *tree)
 
 #endif
 
-// Constructors.
-OctNode::OctNode(float x, float y, float z, float span,
-                 Octree *tree, OctNode *parent, OctObject *object)
+// Search buffer constructor.
+OctSearchBuffer::OctSearchBuffer(int capacity)
 {
-   Point3D center;
+   if (capacity < 1)
+   {
+      capacity = 1;
+   }
+   this->capacity = capacity;
+   size           = 0;
+   objects        = new OctObject *[capacity];
+#ifdef _DEBUG
+   assert(objects != NULL);
+#endif
+}
 
-   center.set(x, y, z);
-   init(center, span, tree, parent, object);
+
+// Search buffer destructor.
+OctSearchBuffer::~OctSearchBuffer()
+{
+   delete [] objects;
 }
 
 
-OctNode::OctNode(Point3D center, float span, Octree *tree,
-                 OctNode *parent, OctObject *object)
+// Grow storage.
+void OctSearchBuffer::grow()
 {
-   init(center, span, tree, parent, object);
+   OctObject **o;
+
+   capacity *= 2;
+   o         = new OctObject *[capacity];
+#ifdef _DEBUG
+   assert(o != NULL);
+#endif
+   memcpy(o, objects, size * sizeof(OctObject *));
+   delete [] objects;
+   objects = o;
 }
 
 
-void OctNode::init(Point3D center, float span, Octree *tree,
-                   OctNode *parent, OctObject *object)
+// Visitor appending to buffer.
+void OctSearchBuffer::visit(OctObject *object, void *buffer)
 {
-   int i;
+   ((OctSearchBuffer *)buffer)->append(object);
+}
 
-   this->center = center;
-   this->span   = span;
-   this->tree   = tree;
-   this->parent = parent;
-   for (i = 0; i < 8; i++)
-   {
-      children[i] = NULL;
-   }
-   numChildren = 0;
-   if (object != NULL)
-   {
-      objects.push_back(object);
-      object->node = this;
-   }
+
+// Pool constructors.
+OctPool::OctPool()
+{
+   init(0);
 }
 
 
-// Destructor.
-OctNode::~OctNode()
+OctPool::OctPool(int blockSize, int slabBlocks)
 {
-   register int       i;
-   register OctObject *object;
+   init(blockSize, slabBlocks);
+}
 
-   std::list<OctObject *>::iterator itr;
 
-   for (itr = objects.begin(); itr != objects.end(); itr++)
+void OctPool::init(int blockSize, int slabBlocks)
+{
+   // Blocks must hold a free list link and keep alignment.
+   if (blockSize < (int)sizeof(void *))
+   {
+      blockSize = (int)sizeof(void *);
+   }
+   this->blockSize  = (blockSize + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1);
+   this->slabBlocks = slabBlocks;
+   slabs            = NULL;
+   freeList         = NULL;
+   numSlabs         = 0;
+   numLive          = 0;
+   numFree          = 0;
+   peakLive         = 0;
+}
+
+
+// Pool destructor.
+OctPool::~OctPool()
+{
+   char *slab;
+
+   while (slabs != NULL)
    {
-      object = *itr;
-      delete object;
+      slab  = slabs;
+      slabs = *(char **)slab;
+      delete [] slab;
    }
-   objects.clear();
+}
+
+
+// Allocate block.
+void *OctPool::allocate()
+{
+   register int  i;
+   register char *slab;
+   void          *block;
+
+   // Carve a new slab into the free list?
+   if (freeList == NULL)
+   {
+      slab = new char[POOL_ALIGN + (blockSize * slabBlocks)];
+#ifdef _DEBUG
+      assert(slab != NULL);
+#endif
+      *(char **)slab = slabs;
+      slabs          = slab;
+      numSlabs++;
+      for (i = slabBlocks - 1; i >= 0; i--)
+      {
+         block           = (void *)(slab + POOL_ALIGN + (i * blockSize));
+         *(void **)block = freeList;
+         freeList        = block;
+      }
+      numFree += slabBlocks;
+   }
+
+   block    = freeList;
+   freeList = *(void **)block;
+   numFree--;
+   numLive++;
+   if (numLive > peakLive)
+   {
+      peakLive = numLive;
+   }
+   return(block);
+}
+
+
+// Release block to free list.
+void OctPool::release(void *block)
+{
+#ifdef _DEBUG
+   assert(block != NULL);
+   assert(numLive > 0);
+#endif
+   *(void **)block = freeList;
+   freeList        = block;
+   numLive--;
+   numFree++;
+}
+
+
+// Constructors.
+OctNode::OctNode(float x, float y, float z, float span,
+                 Octree *tree, OctNode *parent, OctObject *object)
+{
+   Point3D center;
+
+   center.set(x, y, z);
+   init(center, span, tree, parent, object);
+}
+
+
+OctNode::OctNode(Point3D center, float span, Octree *tree,
+                 OctNode *parent, OctObject *object)
+{
+   init(center, span, tree, parent, object);
+}
+
+
+void OctNode::init(Point3D center, float span, Octree *tree,
+                   OctNode *parent, OctObject *object)
+{
+   int i;
+
+   this->center = center;
+   this->span   = span;
+   this->tree   = tree;
+   this->parent = parent;
+   for (i = 0; i < 8; i++)
+   {
+      children[i] = NULL;
+   }
+   numChildren = 0;
+   count       = 0;
+   for (i = 0; i < 3; i++)
+   {
+      positionSum[i] = velocitySum[i] = 0.0;
+   }
+   if (object != NULL)
+   {
+      objects.push_back(object);
+      object->nodeEntry = --objects.end();
+      object->node      = this;
+      adjustCount(1, object);
+   }
+}
+
+
+// Destructor.
+OctNode::~OctNode()
+{
+   register int       i;
+   register OctObject *object;
+
+   std::list<OctObject *>::iterator itr;
+
+   for (itr = objects.begin(); itr != objects.end(); itr++)
+   {
+      object = *itr;
+      tree->deleteObject(object);
+   }
+   objects.clear();
 
    for (i = 0; i < 8; i++)
    {
@@ -726,7 +1549,7 @@ OctNode::~OctNode()
       {
          continue;
       }
-      delete children[i];
+      tree->deleteNode(children[i]);
       children[i] = NULL;
    }
 }
@@ -759,8 +1582,10 @@ bool OctNode::insert(OctObject *object, bool upFlag)
    if (((objects.size() == 0) && (numChildren == 0)) ||
        ((objects.size() > 0) && (*objects.begin())->isClose(object)))
    {
-      object->node = this;
       objects.push_back(object);
+      object->nodeEntry = --objects.end();
+      object->node      = this;
+      adjustCount(1, object);
       return(true);
    }
 
@@ -774,8 +1599,8 @@ bool OctNode::insert(OctObject *object, bool upFlag)
          {
             if (children[0] == NULL)
             {
-               children[0] = new OctNode(center.m_x - span2, center.m_y - span2,
-                                         center.m_z - span2, span2, tree, this, object);
+               children[0] = tree->newNode(center.m_x - span2, center.m_y - span2,
+                                          center.m_z - span2, span2, this, object);
                assert(children[0] != NULL);
                numChildren++;
             }
@@ -788,8 +1613,8 @@ bool OctNode::insert(OctObject *object, bool upFlag)
          {
             if (children[1] == NULL)
             {
-               children[1] = new OctNode(center.m_x - span2, center.m_y + span2,
-                                         center.m_z - span2, span2, tree, this, object);
+               children[1] = tree->newNode(center.m_x - span2, center.m_y + span2,
+                                          center.m_z - span2, span2, this, object);
                assert(children[1] != NULL);
                numChildren++;
             }
@@ -805,8 +1630,8 @@ bool OctNode::insert(OctObject *object, bool upFlag)
          {
             if (children[2] == NULL)
             {
-               children[2] = new OctNode(center.m_x + span2, center.m_y - span2,
-                                         center.m_z - span2, span2, tree, this, object);
+               children[2] = tree->newNode(center.m_x + span2, center.m_y - span2,
+                                          center.m_z - span2, span2, this, object);
                assert(children[2] != NULL);
                numChildren++;
             }
@@ -819,8 +1644,8 @@ bool OctNode::insert(OctObject *object, bool upFlag)
          {
             if (children[3] == NULL)
             {
-               children[3] = new OctNode(center.m_x + span2, center.m_y + span2,
-                                         center.m_z - span2, span2, tree, this, object);
+               children[3] = tree->newNode(center.m_x + span2, center.m_y + span2,
+                                          center.m_z - span2, span2, this, object);
                assert(children[3] != NULL);
                numChildren++;
             }
@@ -839,8 +1664,8 @@ bool OctNode::insert(OctObject *object, bool upFlag)
          {
             if (children[4] == NULL)
             {
-               children[4] = new OctNode(center.m_x - span2, center.m_y - span2,
-                                         center.m_z + span2, span2, tree, this, object);
+               children[4] = tree->newNode(center.m_x - span2, center.m_y - span2,
+                                          center.m_z + span2, span2, this, object);
                assert(children[4] != NULL);
                numChildren++;
             }
@@ -853,8 +1678,8 @@ bool OctNode::insert(OctObject *object, bool upFlag)
          {
             if (children[5] == NULL)
             {
-               children[5] = new OctNode(center.m_x - span2, center.m_y + span2,
-                                         center.m_z + span2, span2, tree, this, object);
+               children[5] = tree->newNode(center.m_x - span2, center.m_y + span2,
+                                          center.m_z + span2, span2, this, object);
                assert(children[5] != NULL);
                numChildren++;
             }
@@ -870,8 +1695,8 @@ bool OctNode::insert(OctObject *object, bool upFlag)
          {
             if (children[6] == NULL)
             {
-               children[6] = new OctNode(center.m_x + span2, center.m_y - span2,
-                                         center.m_z + span2, span2, tree, this, object);
+               children[6] = tree->newNode(center.m_x + span2, center.m_y - span2,
+                                          center.m_z + span2, span2, this, object);
                assert(children[6] != NULL);
                numChildren++;
             }
@@ -884,8 +1709,8 @@ bool OctNode::insert(OctObject *object, bool upFlag)
          {
             if (children[7] == NULL)
             {
-               children[7] = new OctNode(center.m_x + span2, center.m_y + span2,
-                                         center.m_z + span2, span2, tree, this, object);
+               children[7] = tree->newNode(center.m_x + span2, center.m_y + span2,
+                                          center.m_z + span2, span2, this, object);
                assert(children[7] != NULL);
                numChildren++;
             }
@@ -899,15 +1724,11 @@ bool OctNode::insert(OctObject *object, bool upFlag)
 
    // Re-insert existing objects.
    tmpList.clear();
-   for (itr = objects.begin(); itr != objects.end(); itr++)
-   {
-      o = *itr;
-      tmpList.push_back(o);
-   }
-   objects.clear();
+   tmpList.swap(objects);
    for (itr = tmpList.begin(); itr != tmpList.end(); itr++)
    {
       o = *itr;
+      adjustCount(-1, o);
       insert(o);
    }
    return(true);
@@ -917,32 +1738,169 @@ bool OctNode::insert(OctObject *object, bool upFlag)
 // Remove object.
 void OctNode::remove(OctObject *object)
 {
-   register OctObject *o;
-
-   std::list<OctObject *>::iterator itr;
-
 #ifdef _DEBUG
    assert(object != NULL);
+   assert(object->node == this);
+   assert(*object->nodeEntry == object);
 #endif
    // Unlink from object list.
+   objects.erase(object->nodeEntry);
+   object->node = NULL;
+   adjustCount(-1, object);
+
+   // Contract parent.
+   if (parent != NULL)
+   {
+      parent->contract();
+   }
+}
+
+
+// Adjust object count and aggregates of node and ancestors.
+void OctNode::adjustCount(int delta, OctObject *object)
+{
+   register OctNode *node;
+   double           p[3], v[3];
+
+   if (!tree->aggregate)
+   {
+      for (node = this; node != NULL; node = node->parent)
+      {
+         node->count += delta;
+      }
+      return;
+   }
+   p[0] = (double)delta * (double)object->position.m_x;
+   p[1] = (double)delta * (double)object->position.m_y;
+   p[2] = (double)delta * (double)object->position.m_z;
+   v[0] = (double)delta * (double)object->velocity.m_x;
+   v[1] = (double)delta * (double)object->velocity.m_y;
+   v[2] = (double)delta * (double)object->velocity.m_z;
+   for (node = this; node != NULL; node = node->parent)
+   {
+      node->count          += delta;
+      node->positionSum[0] += p[0];
+      node->positionSum[1] += p[1];
+      node->positionSum[2] += p[2];
+      node->velocitySum[0] += v[0];
+      node->velocitySum[1] += v[1];
+      node->velocitySum[2] += v[2];
+   }
+}
+
+
+// Shift aggregates of node and ancestors for a moving object.
+// Called before the object's position and velocity are updated.
+void OctNode::shiftSums(OctObject *object, Point3D& point, Point3D& velocity)
+{
+   register OctNode *node;
+   double           p[3], v[3];
+
+   if (!tree->aggregate)
+   {
+      return;
+   }
+   p[0] = (double)point.m_x - (double)object->position.m_x;
+   p[1] = (double)point.m_y - (double)object->position.m_y;
+   p[2] = (double)point.m_z - (double)object->position.m_z;
+   v[0] = (double)velocity.m_x - (double)object->velocity.m_x;
+   v[1] = (double)velocity.m_y - (double)object->velocity.m_y;
+   v[2] = (double)velocity.m_z - (double)object->velocity.m_z;
+   for (node = this; node != NULL; node = node->parent)
+   {
+      node->positionSum[0] += p[0];
+      node->positionSum[1] += p[1];
+      node->positionSum[2] += p[2];
+      node->velocitySum[0] += v[0];
+      node->velocitySum[1] += v[1];
+      node->velocitySum[2] += v[2];
+   }
+}
+
+
+// Recompute aggregates of subtree.
+void OctNode::sumObjects()
+{
+   int       i, j;
+   OctObject *object;
+
+   std::list<OctObject *>::iterator itr;
+
+   for (i = 0; i < 3; i++)
+   {
+      positionSum[i] = velocitySum[i] = 0.0;
+   }
    for (itr = objects.begin(); itr != objects.end(); itr++)
    {
-      o = *itr;
-      if (o == object)
+      object = *itr;
+      positionSum[0] += object->position.m_x;
+      positionSum[1] += object->position.m_y;
+      positionSum[2] += object->position.m_z;
+      velocitySum[0] += object->velocity.m_x;
+      velocitySum[1] += object->velocity.m_y;
+      velocitySum[2] += object->velocity.m_z;
+   }
+   for (i = 0; i < 8; i++)
+   {
+      if (children[i] != NULL)
       {
-         break;
+         children[i]->sumObjects();
+         for (j = 0; j < 3; j++)
+         {
+            positionSum[j] += children[i]->positionSum[j];
+            velocitySum[j] += children[i]->velocitySum[j];
+         }
       }
    }
-#ifdef _DEBUG
-   assert(itr != objects.end());
-#endif
-   objects.erase(itr);
-   o->node = NULL;
+}
 
-   // Contract parent.
-   if (parent != NULL)
+
+// Count objects into median histograms.
+// Nodes at MEDIAN_DEPTH span exactly one bin on each axis.
+void OctNode::countObjects(int depth, int *xbins, int *ybins, int *zbins)
+{
+   register int       i;
+   register OctObject *object;
+   float              origin, width;
+   int                numBins;
+
+   std::list<OctObject *>::iterator itr;
+
+   numBins = 1 << MEDIAN_DEPTH;
+   width   = (tree->span * 2.0f) / (float)numBins;
+   if (depth == MEDIAN_DEPTH)
+   {
+      origin = tree->center.m_x - tree->span;
+      i      = (int)((center.m_x - origin) / width);
+      xbins[i < 0 ? 0 : (i >= numBins ? numBins - 1 : i)] += count;
+      origin = tree->center.m_y - tree->span;
+      i      = (int)((center.m_y - origin) / width);
+      ybins[i < 0 ? 0 : (i >= numBins ? numBins - 1 : i)] += count;
+      origin = tree->center.m_z - tree->span;
+      i      = (int)((center.m_z - origin) / width);
+      zbins[i < 0 ? 0 : (i >= numBins ? numBins - 1 : i)] += count;
+      return;
+   }
+
+   for (itr = objects.begin(); itr != objects.end(); itr++)
    {
-      parent->contract();
+      object = *itr;
+      origin = tree->center.m_x - tree->span;
+      i      = (int)((object->position.m_x - origin) / width);
+      xbins[i < 0 ? 0 : (i >= numBins ? numBins - 1 : i)]++;
+      origin = tree->center.m_y - tree->span;
+      i      = (int)((object->position.m_y - origin) / width);
+      ybins[i < 0 ? 0 : (i >= numBins ? numBins - 1 : i)]++;
+      origin = tree->center.m_z - tree->span;
+      i      = (int)((object->position.m_z - origin) / width);
+      zbins[i < 0 ? 0 : (i >= numBins ? numBins - 1 : i)]++;
+   }
+   for (i = 0; i < 8; i++)
+   {
+      if (children[i] != NULL)
+      {
+         children[i]->countObjects(depth + 1, xbins, ybins, zbins);
+      }
    }
 }
 
@@ -966,7 +1924,7 @@ void OctNode::contract()
       {
          if (children[i]->objects.size() == 0)
          {
-            delete children[i];
+            tree->deleteNode(children[i]);
             children[i] = NULL;
             numChildren--;
          }
@@ -990,16 +1948,13 @@ void OctNode::contract()
       // Bring up single child's objects?
       if (j != -1)
       {
-         objects.clear();
-         for (itr = children[j]->objects.begin();
-              itr != children[j]->objects.end(); itr++)
+         objects.splice(objects.end(), children[j]->objects);
+         for (itr = objects.begin(); itr != objects.end(); itr++)
          {
             object       = *itr;
             object->node = this;
-            objects.push_back(object);
          }
-         children[j]->objects.clear();
-         delete children[j];
+         tree->deleteNode(children[j]);
          children[j] = NULL;
          numChildren--;
          if (parent != NULL)
@@ -1014,25 +1969,12 @@ void OctNode::contract()
 // Move object.
 bool OctNode::move(OctObject *object)
 {
-   register OctObject *o;
-
-   std::list<OctObject *>::iterator itr;
    bool ret;
 
 #ifdef _DEBUG
    assert(object != NULL);
-#endif
-   // Find object.
-   for (itr = objects.begin(); itr != objects.end(); itr++)
-   {
-      o = *itr;
-      if (o == object)
-      {
-         break;
-      }
-   }
-#ifdef _DEBUG
-   assert(itr != objects.end());
+   assert(object->node == this);
+   assert(*object->nodeEntry == object);
 #endif
 
    // Object remains in node?
@@ -1040,14 +1982,16 @@ bool OctNode::move(OctObject *object)
    {
       return(true);
    }
+   tree->relinks++;
 
    // Remove from node.
-   objects.erase(itr);
-   o->node = NULL;
+   objects.erase(object->nodeEntry);
+   object->node = NULL;
+   adjustCount(-1, object);
 
    // Insert into parent.
    ret = false;
-   if ((parent != NULL) && parent->insert(o, true))
+   if ((parent != NULL) && parent->insert(object, true))
    {
       ret = true;
    }
@@ -1065,10 +2009,102 @@ bool OctNode::move(OctObject *object)
 }
 
 
+// Move object while tree awaits rebuild.
+// Node lists and aggregates are left stale until the rebuild.
+bool OctNode::deferMove(OctObject *object)
+{
+#ifdef _DEBUG
+   assert(object != NULL);
+   assert(object->node == this);
+#endif
+   if (object->isInside(this))
+   {
+      return(true);
+   }
+   tree->relinks++;
+   if (object->isInside(tree))
+   {
+      return(true);
+   }
+   remove(object);
+   return(false);
+}
+
+
+// Build subtree in bulk from objects inside node.
+void OctNode::build(OctObject **array, int count, OctObject **scratch)
+{
+   register int       i, j;
+   register OctObject *object;
+   int                octants[8], starts[8];
+   float              span2;
+
+   // Keep objects together?
+   for (i = 1; i < count; i++)
+   {
+      if ((int)(array[i]->position.DistSquare(array[0]->position) * tree->precision) != 0)
+      {
+         break;
+      }
+   }
+   if (i == count)
+   {
+      for (i = 0; i < count; i++)
+      {
+         object = array[i];
+         objects.push_back(object);
+         object->nodeEntry = --objects.end();
+         object->node      = this;
+      }
+      this->count = count;
+      return;
+   }
+
+   // Partition objects into octants.
+   for (j = 0; j < 8; j++)
+   {
+      octants[j] = 0;
+   }
+   for (i = 0; i < count; i++)
+   {
+      octants[octant(array[i]->position)]++;
+   }
+   for (j = 0, i = 0; j < 8; j++)
+   {
+      starts[j] = i;
+      i        += octants[j];
+   }
+   for (i = 0; i < count; i++)
+   {
+      object = array[i];
+      scratch[starts[octant(object->position)]++] = object;
+   }
+
+   // Build children, trading array and scratch.
+   span2       = span / 2.0f;
+   this->count = count;
+   for (j = 0, i = 0; j < 8; j++)
+   {
+      if (octants[j] == 0)
+      {
+         continue;
+      }
+      children[j] = tree->newNode((j & 2) ? center.m_x + span2 : center.m_x - span2,
+                                  (j & 1) ? center.m_y + span2 : center.m_y - span2,
+                                  (j & 4) ? center.m_z + span2 : center.m_z - span2,
+                                  span2, this, NULL);
+      assert(children[j] != NULL);
+      numChildren++;
+      children[j]->build(&scratch[i], octants[j], &array[i]);
+      i += octants[j];
+   }
+}
+
+
 // Search.
-// Returns list of matching objects.
+// Matching objects are passed to the visitor.
 void OctNode::search(Point3D point, float radius,
-                     std::list<OctObject *>& searchList)
+                     OCTVISITOR visitor, void *data)
 {
    register int       i;
    register OctObject *object;
@@ -1086,7 +2122,7 @@ void OctNode::search(Point3D point, float radius,
       object = *itr;
       if (object->position.DistSquare(point) <= r2)
       {
-         searchList.push_back(object);
+         visitor(object, data);
       }
    }
 
@@ -1121,66 +2157,231 @@ void OctNode::search(Point3D point, float radius,
       {
          continue;
       }
-      children[i]->search(point, radius, searchList);
+      children[i]->search(point, radius, visitor, data);
    }
 }
 
 
-// Search for visible objects.
-// Returns list of matching objects.
-void OctNode::searchVisible(Frustum                 *frustum,
-                            std::list<OctObject *>& searchList)
+// Aggregate search.
+// Children outside the cone are skipped, and children that can be
+// aggregated are passed to the node visitor instead of being searched.
+void OctNode::searchAggregate(Point3D& point, float radius, Octree::CONE *cone,
+                              float theta, OCTVISITOR visitor,
+                              OCTNODEVISITOR nodeVisitor, void *data)
 {
    register int       i;
    register OctObject *object;
 
    std::list<OctObject *>::iterator itr;
    register OctNode                 *child;
-   float xmin, xmax, ymin, ymax, zmin, zmax;
+   float r2;
 
-   // Node intersects frustum?
-   xmin = center.m_x - span;
-   if (xmin < tree->bounds.xmin)
-   {
-      xmin = tree->bounds.xmin;
-   }
-   xmax = center.m_x + span;
-   if (xmax > tree->bounds.xmax)
-   {
-      xmax = tree->bounds.xmax;
-   }
-   ymin = center.m_y - span;
-   if (ymin < tree->bounds.ymin)
-   {
-      ymin = tree->bounds.ymin;
-   }
-   ymax = center.m_y + span;
-   if (ymax > tree->bounds.ymax)
-   {
-      ymax = tree->bounds.ymax;
-   }
-   zmin = center.m_z - span;
-   if (zmin < tree->bounds.zmin)
-   {
-      zmin = tree->bounds.zmin;
-   }
-   zmax = center.m_z + span;
-   if (zmax > tree->bounds.zmax)
-   {
-      zmax = tree->bounds.zmax;
-   }
-   if (!frustum->intersects(xmin, xmax, ymin, ymax, zmin, zmax))
-   {
-      return;
-   }
+   // Get squared search radius.
+   r2 = radius * radius;
 
-   // Check for objects within frustum.
+   // Check for objects within search radius.
    for (itr = objects.begin(); itr != objects.end(); itr++)
    {
       object = *itr;
-      if (frustum->isInside(object->position))
+      if (object->position.DistSquare(point) <= r2)
       {
-         searchList.push_back(object);
+         visitor(object, data);
+      }
+   }
+
+   // Search or aggregate matching children.
+   for (i = 0; i < 8; i++)
+   {
+      if ((child = children[i]) == NULL)
+      {
+         continue;
+      }
+      if ((point.m_x + radius) < (child->center.m_x - child->span))
+      {
+         continue;
+      }
+      if ((point.m_x - radius) > (child->center.m_x + child->span))
+      {
+         continue;
+      }
+      if ((point.m_y + radius) < (child->center.m_y - child->span))
+      {
+         continue;
+      }
+      if ((point.m_y - radius) > (child->center.m_y + child->span))
+      {
+         continue;
+      }
+      if ((point.m_z + radius) < (child->center.m_z - child->span))
+      {
+         continue;
+      }
+      if ((point.m_z - radius) > (child->center.m_z + child->span))
+      {
+         continue;
+      }
+      if (child->isOutside(point, cone))
+      {
+         continue;
+      }
+      if ((child->count > 1) && child->isAggregate(point, radius, cone, theta))
+      {
+         nodeVisitor(child, data);
+      }
+      else
+      {
+         child->searchAggregate(point, radius, cone, theta,
+                                visitor, nodeVisitor, data);
+      }
+   }
+}
+
+
+// Subtree can be passed whole by an aggregate search?
+// The node must be smaller than theta times the distance to its
+// center, and every corner must lie within radius and the cone.
+// The cone is convex, so the node then lies entirely within it and
+// cannot hold the search point.
+bool OctNode::isAggregate(Point3D& point, float radius, Octree::CONE *cone,
+                          float theta)
+{
+   int   i;
+   float dx, dy, dz, d2, dot, size, r2, cos2;
+
+   // Opening criterion.
+   size = 2.0f * span;
+   dx   = center.m_x - point.m_x;
+   dy   = center.m_y - point.m_y;
+   dz   = center.m_z - point.m_z;
+   d2   = (dx * dx) + (dy * dy) + (dz * dz);
+   if ((size * size) >= (theta * theta * d2))
+   {
+      return(false);
+   }
+
+   // Check corners.
+   r2   = radius * radius;
+   cos2 = cone->cosine * cone->cosine;
+   for (i = 0; i < 8; i++)
+   {
+      dx  = center.m_x + ((i & 1) ? span : -span) - point.m_x;
+      dy  = center.m_y + ((i & 2) ? span : -span) - point.m_y;
+      dz  = center.m_z + ((i & 4) ? span : -span) - point.m_z;
+      d2  = (dx * dx) + (dy * dy) + (dz * dz);
+      dot = (dx * cone->axis.m_x) + (dy * cone->axis.m_y) + (dz * cone->axis.m_z);
+      if ((d2 > r2) || (dot <= 0.0f) || ((dot * dot) < (cos2 * d2)))
+      {
+         return(false);
+      }
+   }
+   return(true);
+}
+
+
+// Node entirely outside search cone?
+// The node's bounding sphere is compared with the plane through the
+// cone's apex touching the cone nearest the node's center; its radius
+// is slightly over span times root 3 to absorb rounding.
+bool OctNode::isOutside(Point3D& point, Octree::CONE *cone)
+{
+   float dx, dy, dz, axial, radial;
+
+   dx     = center.m_x - point.m_x;
+   dy     = center.m_y - point.m_y;
+   dz     = center.m_z - point.m_z;
+   axial  = (dx * cone->axis.m_x) + (dy * cone->axis.m_y) + (dz * cone->axis.m_z);
+   radial = (dx * dx) + (dy * dy) + (dz * dz) - (axial * axial);
+   radial = radial > 0.0f ? sqrt(radial) : 0.0f;
+   return(((radial * cone->cosine) - (axial * cone->sine)) > (1.75f * span));
+}
+
+
+// Node contains search cube?
+bool OctNode::contains(Point3D& point, float radius)
+{
+   if ((point.m_x - radius) < (center.m_x - span))
+   {
+      return(false);
+   }
+   if ((point.m_x + radius) > (center.m_x + span))
+   {
+      return(false);
+   }
+   if ((point.m_y - radius) < (center.m_y - span))
+   {
+      return(false);
+   }
+   if ((point.m_y + radius) > (center.m_y + span))
+   {
+      return(false);
+   }
+   if ((point.m_z - radius) < (center.m_z - span))
+   {
+      return(false);
+   }
+   if ((point.m_z + radius) > (center.m_z + span))
+   {
+      return(false);
+   }
+   return(true);
+}
+
+
+// Search for visible objects.
+// Matching objects are passed to the visitor.
+void OctNode::searchVisible(Frustum *frustum,
+                            OCTVISITOR visitor, void *data)
+{
+   register int       i;
+   register OctObject *object;
+
+   std::list<OctObject *>::iterator itr;
+   register OctNode                 *child;
+   float xmin, xmax, ymin, ymax, zmin, zmax;
+
+   // Node intersects frustum?
+   xmin = center.m_x - span;
+   if (xmin < tree->bounds.xmin)
+   {
+      xmin = tree->bounds.xmin;
+   }
+   xmax = center.m_x + span;
+   if (xmax > tree->bounds.xmax)
+   {
+      xmax = tree->bounds.xmax;
+   }
+   ymin = center.m_y - span;
+   if (ymin < tree->bounds.ymin)
+   {
+      ymin = tree->bounds.ymin;
+   }
+   ymax = center.m_y + span;
+   if (ymax > tree->bounds.ymax)
+   {
+      ymax = tree->bounds.ymax;
+   }
+   zmin = center.m_z - span;
+   if (zmin < tree->bounds.zmin)
+   {
+      zmin = tree->bounds.zmin;
+   }
+   zmax = center.m_z + span;
+   if (zmax > tree->bounds.zmax)
+   {
+      zmax = tree->bounds.zmax;
+   }
+   if (!frustum->intersects(xmin, xmax, ymin, ymax, zmin, zmax))
+   {
+      return;
+   }
+
+   // Check for objects within frustum.
+   for (itr = objects.begin(); itr != objects.end(); itr++)
+   {
+      object = *itr;
+      if (frustum->isInside(object->position))
+      {
+         visitor(object, data);
       }
    }
 
@@ -1191,6 +2392,1251 @@ void OctNode::searchVisible(Frustum                 *frustum,
       {
          continue;
       }
-      children[i]->searchVisible(frustum, searchList);
+      children[i]->searchVisible(frustum, visitor, data);
+   }
+}
+
+
+// Join subtree.
+// Pairs among the node's objects, between the node's objects and its
+// descendants, then within and between child subtrees.
+void OctNode::join(float radius, OCTPAIRVISITOR visitor, void *data)
+{
+   register int       i, j;
+   register OctObject *object;
+
+   std::list<OctObject *>::iterator itr, itr2;
+   float r2;
+
+   r2 = radius * radius;
+   for (itr = objects.begin(); itr != objects.end(); itr++)
+   {
+      object = *itr;
+      for (itr2 = itr, itr2++; itr2 != objects.end(); itr2++)
+      {
+         if (object->position.DistSquare((*itr2)->position) <= r2)
+         {
+            visitor(object, *itr2, data);
+         }
+      }
+      for (i = 0; i < 8; i++)
+      {
+         if (children[i] != NULL)
+         {
+            children[i]->joinObject(object, false, radius, visitor, data);
+         }
+      }
+   }
+   for (i = 0; i < 8; i++)
+   {
+      if (children[i] == NULL)
+      {
+         continue;
+      }
+      children[i]->join(radius, visitor, data);
+      for (j = i + 1; j < 8; j++)
+      {
+         if (children[j] != NULL)
+         {
+            children[i]->join(children[j], radius, visitor, data);
+         }
+      }
+   }
+}
+
+
+// Join disjoint subtrees.
+// Objects of this subtree are passed first.
+void OctNode::join(OctNode *node, float radius, OCTPAIRVISITOR visitor, void *data)
+{
+   register int       i, j;
+   register OctObject *object;
+
+   std::list<OctObject *>::iterator itr, itr2;
+   float r2;
+
+   // Subtrees within radius?
+   r2 = radius * radius;
+   if (Octree::gapSquare(center, span, node->center, node->span) > r2)
+   {
+      return;
+   }
+
+   // Node objects against other node objects and descendants.
+   for (itr = objects.begin(); itr != objects.end(); itr++)
+   {
+      object = *itr;
+      for (itr2 = node->objects.begin(); itr2 != node->objects.end(); itr2++)
+      {
+         if (object->position.DistSquare((*itr2)->position) <= r2)
+         {
+            visitor(object, *itr2, data);
+         }
+      }
+      for (i = 0; i < 8; i++)
+      {
+         if (node->children[i] != NULL)
+         {
+            node->children[i]->joinObject(object, false, radius, visitor, data);
+         }
+      }
+   }
+
+   // Other node objects against descendants.
+   for (itr = node->objects.begin(); itr != node->objects.end(); itr++)
+   {
+      object = *itr;
+      for (i = 0; i < 8; i++)
+      {
+         if (children[i] != NULL)
+         {
+            children[i]->joinObject(object, true, radius, visitor, data);
+         }
+      }
+   }
+
+   // Child subtree pairs.
+   for (i = 0; i < 8; i++)
+   {
+      if (children[i] == NULL)
+      {
+         continue;
+      }
+      for (j = 0; j < 8; j++)
+      {
+         if (node->children[j] != NULL)
+         {
+            children[i]->join(node->children[j], radius, visitor, data);
+         }
+      }
+   }
+}
+
+
+// Join object with subtree.
+// The object is passed first unless swapped.
+void OctNode::joinObject(OctObject *object, bool swap, float radius,
+                         OCTPAIRVISITOR visitor, void *data)
+{
+   Octree::PAIR pair;
+
+   if (Octree::gapSquare(object->position, 0.0f, center, span) > (radius * radius))
+   {
+      return;
+   }
+   pair.object  = object;
+   pair.swap    = swap;
+   pair.visitor = visitor;
+   pair.data    = data;
+   search(object->position, radius, Octree::visitPair, &pair);
+}
+
+
+// Linear octree constructor.
+LinearOctree::LinearOctree(Octree *tree)
+{
+   this->tree = tree;
+   entries    = NULL;
+   size       = 0;
+   capacity   = 0;
+   sorted     = true;
+}
+
+
+// Destructor.
+LinearOctree::~LinearOctree()
+{
+   clear();
+   if (entries != NULL)
+   {
+      delete [] entries;
    }
 }
+
+
+// Clear: objects are freed to the owning tree's pool.
+void LinearOctree::clear()
+{
+   register int       i;
+   register OctObject *object;
+
+   for (i = 0; i < size; i++)
+   {
+      object        = entries[i].object;
+      object->tree  = NULL;
+      object->index = -1;
+      tree->deleteObject(object);
+   }
+   size   = 0;
+   sorted = true;
+}
+
+
+// Insert object.
+bool LinearOctree::insert(OctObject *object)
+{
+   ENTRY *e;
+
+#ifdef _DEBUG
+   assert(object != NULL);
+   assert(object->tree == NULL);
+#endif
+   if (size == capacity)
+   {
+      capacity = (capacity == 0) ? 64 : capacity * 2;
+      e        = new ENTRY[capacity];
+#ifdef _DEBUG
+      assert(e != NULL);
+#endif
+      if (entries != NULL)
+      {
+         memcpy(e, entries, size * sizeof(ENTRY));
+         delete [] entries;
+      }
+      entries = e;
+   }
+   e             = &entries[size];
+   e->code       = encode(object->position);
+   e->x          = object->position.m_x;
+   e->y          = object->position.m_y;
+   e->z          = object->position.m_z;
+   e->object     = object;
+   object->tree  = tree;
+   object->index = size;
+   if ((size > 0) && (entries[size - 1].code > e->code))
+   {
+      sorted = false;
+   }
+   size++;
+   return(true);
+}
+
+
+// Remove object.
+// The last entry fills the hole.
+void LinearOctree::remove(OctObject *object)
+{
+   register int i;
+
+#ifdef _DEBUG
+   assert(object != NULL);
+   assert(object->tree == tree);
+   assert(entries[object->index].object == object);
+#endif
+   i = object->index;
+   size--;
+   if (i < size)
+   {
+      entries[i]               = entries[size];
+      entries[i].object->index = i;
+      sorted                   = false;
+   }
+   object->tree  = NULL;
+   object->index = -1;
+}
+
+
+// Move object.
+bool LinearOctree::move(OctObject *object)
+{
+   register ENTRY     *e;
+   unsigned long long code;
+
+#ifdef _DEBUG
+   assert(object != NULL);
+   assert(object->tree == tree);
+#endif
+   // Object left tree space?
+   if ((object->position.m_x < (tree->center.m_x - tree->span)) ||
+       (object->position.m_x >= (tree->center.m_x + tree->span)) ||
+       (object->position.m_y < (tree->center.m_y - tree->span)) ||
+       (object->position.m_y >= (tree->center.m_y + tree->span)) ||
+       (object->position.m_z < (tree->center.m_z - tree->span)) ||
+       (object->position.m_z >= (tree->center.m_z + tree->span)))
+   {
+      remove(object);
+      return(false);
+   }
+
+   e    = &entries[object->index];
+   e->x = object->position.m_x;
+   e->y = object->position.m_y;
+   e->z = object->position.m_z;
+   code = encode(object->position);
+   if (code != e->code)
+   {
+      e->code = code;
+      sorted  = false;
+   }
+   return(true);
+}
+
+
+// Entry order by code.
+static bool entryBefore(const LinearOctree::ENTRY &a, const LinearOctree::ENTRY &b)
+{
+   return(a.code < b.code);
+}
+
+
+// Sort entries by code.
+// Moves leave the array nearly sorted, which insertion sort handles in
+// linear time. Inserts, migrations and re-indexing append codes in
+// random order, so after a bounded number of shifts the array is
+// sorted with std::sort instead.
+void LinearOctree::commit()
+{
+   register int i, j;
+   ENTRY        e;
+   long long    shifts;
+
+   if (sorted)
+   {
+      return;
+   }
+   for (i = 1, shifts = 0; i < size; i++)
+   {
+      e = entries[i];
+      for (j = i - 1; j >= 0 && entries[j].code > e.code; j--)
+      {
+         entries[j + 1] = entries[j];
+      }
+      entries[j + 1] = e;
+      shifts        += (i - 1) - j;
+      if (shifts > (4LL * (long long)size))
+      {
+         std::sort(entries, entries + size, entryBefore);
+         break;
+      }
+   }
+   for (i = 0; i < size; i++)
+   {
+      entries[i].object->index = i;
+   }
+   sorted = true;
+}
+
+
+// Morton code of position.
+unsigned long long LinearOctree::encode(Point3D point)
+{
+   unsigned long long x, y, z;
+   float              scale, q;
+   unsigned long long cells = 1ULL << MORTON_BITS;
+
+   scale = (float)cells / (tree->span * 2.0f);
+   q     = (point.m_x - (tree->center.m_x - tree->span)) * scale;
+   x     = (q <= 0.0f) ? 0 : ((q >= (float)cells) ? cells - 1 : (unsigned long long)q);
+   q     = (point.m_y - (tree->center.m_y - tree->span)) * scale;
+   y     = (q <= 0.0f) ? 0 : ((q >= (float)cells) ? cells - 1 : (unsigned long long)q);
+   q     = (point.m_z - (tree->center.m_z - tree->span)) * scale;
+   z     = (q <= 0.0f) ? 0 : ((q >= (float)cells) ? cells - 1 : (unsigned long long)q);
+   return(spread(x) | (spread(y) << 1) | (spread(z) << 2));
+}
+
+
+// Spread bits of a coordinate into every third bit.
+unsigned long long LinearOctree::spread(unsigned long long bits)
+{
+   bits &= 0x1fffffULL;
+   bits  = (bits | (bits << 32)) & 0x1f00000000ffffULL;
+   bits  = (bits | (bits << 16)) & 0x1f0000ff0000ffULL;
+   bits  = (bits | (bits << 8)) & 0x100f00f00f00f00fULL;
+   bits  = (bits | (bits << 4)) & 0x10c30c30c30c30c3ULL;
+   bits  = (bits | (bits << 2)) & 0x1249249249249249ULL;
+   return(bits);
+}
+
+
+// Gather every third bit of a code into a coordinate.
+unsigned long long LinearOctree::compact(unsigned long long bits)
+{
+   bits &= 0x1249249249249249ULL;
+   bits  = (bits | (bits >> 2)) & 0x10c30c30c30c30c3ULL;
+   bits  = (bits | (bits >> 4)) & 0x100f00f00f00f00fULL;
+   bits  = (bits | (bits >> 8)) & 0x1f0000ff0000ffULL;
+   bits  = (bits | (bits >> 16)) & 0x1f00000000ffffULL;
+   bits  = (bits | (bits >> 32)) & 0x1fffffULL;
+   return(bits);
+}
+
+
+// Find first entry in range at or above code.
+int LinearOctree::lowerBound(int lo, int hi, unsigned long long code)
+{
+   register int mid;
+
+   while (lo < hi)
+   {
+      mid = (lo + hi) / 2;
+      if (entries[mid].code < code)
+      {
+         lo = mid + 1;
+      }
+      else
+      {
+         hi = mid;
+      }
+   }
+   return(lo);
+}
+
+
+// Search.
+// Matching objects are passed to the visitor.
+void LinearOctree::search(Point3D point, float radius,
+                          OCTVISITOR visitor, void *data)
+{
+   commit();
+   if (size > 0)
+   {
+      searchRange(point, radius, radius * radius, 0, size, 0,
+                  tree->center, tree->span, visitor, data);
+   }
+}
+
+
+// Search around an object in the tree.
+// Climbs from the object's finest cell to the smallest implied node
+// containing the search cube, widened by a cell to absorb
+// quantization, then searches that node's range of entries.
+void LinearOctree::search(OctObject *object, float radius,
+                          OCTVISITOR visitor, void *data)
+{
+   register int       level, lo, hi, shift;
+   unsigned long long code, x, y, z, prefix;
+   float              span, slack, corner[3];
+   Point3D            point, center;
+
+   commit();
+#ifdef _DEBUG
+   assert(object->tree == tree);
+   assert(entries[object->index].object == object);
+#endif
+   point     = object->position;
+   code      = entries[object->index].code;
+   x         = compact(code);
+   y         = compact(code >> 1);
+   z         = compact(code >> 2);
+   slack     = (tree->span * 2.0f) / (float)(1ULL << MORTON_BITS);
+   corner[0] = tree->center.m_x - tree->span;
+   corner[1] = tree->center.m_y - tree->span;
+   corner[2] = tree->center.m_z - tree->span;
+   for (level = MORTON_BITS; level > 0; level--)
+   {
+      shift      = MORTON_BITS - level;
+      span       = tree->span / (float)(1ULL << level);
+      center.m_x = corner[0] + ((float)(((x >> shift) * 2) + 1) * span);
+      center.m_y = corner[1] + ((float)(((y >> shift) * 2) + 1) * span);
+      center.m_z = corner[2] + ((float)(((z >> shift) * 2) + 1) * span);
+      if (((point.m_x - radius - slack) >= (center.m_x - span)) &&
+          ((point.m_x + radius + slack) <= (center.m_x + span)) &&
+          ((point.m_y - radius - slack) >= (center.m_y - span)) &&
+          ((point.m_y + radius + slack) <= (center.m_y + span)) &&
+          ((point.m_z - radius - slack) >= (center.m_z - span)) &&
+          ((point.m_z + radius + slack) <= (center.m_z + span)))
+      {
+         break;
+      }
+   }
+   if (level == 0)
+   {
+      center = tree->center;
+      span   = tree->span;
+      lo     = 0;
+      hi     = size;
+   }
+   else
+   {
+      // Entries sharing the node's code prefix.
+      shift  = 3 * (MORTON_BITS - level);
+      prefix = code & ~((1ULL << shift) - 1);
+      lo     = lowerBound(0, size, prefix);
+      hi     = lowerBound(lo, size, prefix + (1ULL << shift));
+   }
+   searchRange(point, radius, radius * radius, lo, hi, level,
+               center, span, visitor, data);
+}
+
+
+// Search range of entries under implied node.
+void LinearOctree::searchRange(Point3D& point, float radius, float r2,
+                               int lo, int hi, int level, Point3D center, float span,
+                               OCTVISITOR visitor, void *data)
+{
+   register int       i, c, start, end;
+   register ENTRY     *e;
+   float              dx, dy, dz, span2, slack;
+   int                shift;
+   unsigned long long prefix;
+   Point3D            child;
+
+   // Scan small ranges.
+   if (((hi - lo) <= LINEAR_LEAF_SIZE) || (level == MORTON_BITS))
+   {
+      for (i = lo; i < hi; i++)
+      {
+         e  = &entries[i];
+         dx = e->x - point.m_x;
+         dy = e->y - point.m_y;
+         dz = e->z - point.m_z;
+         if (((dx * dx) + (dy * dy) + (dz * dz)) <= r2)
+         {
+            visitor(e->object, data);
+         }
+      }
+      return;
+   }
+
+   // Search matching children.
+   // Cube bounds are widened by a cell to absorb quantization.
+   shift  = 3 * (MORTON_BITS - 1 - level);
+   prefix = entries[lo].code & ~((8ULL << shift) - 1);
+   span2  = span / 2.0f;
+   slack  = (tree->span * 2.0f) / (float)(1ULL << MORTON_BITS);
+   for (c = 0, start = lo; c < 8 && start < hi; c++, start = end)
+   {
+      end = (c == 7) ? hi : lowerBound(start, hi, prefix | ((unsigned long long)(c + 1) << shift));
+      if (start == end)
+      {
+         continue;
+      }
+      child.m_x = center.m_x + ((c & 1) ? span2 : -span2);
+      child.m_y = center.m_y + ((c & 2) ? span2 : -span2);
+      child.m_z = center.m_z + ((c & 4) ? span2 : -span2);
+      if ((point.m_x + radius) < (child.m_x - span2 - slack))
+      {
+         continue;
+      }
+      if ((point.m_x - radius) > (child.m_x + span2 + slack))
+      {
+         continue;
+      }
+      if ((point.m_y + radius) < (child.m_y - span2 - slack))
+      {
+         continue;
+      }
+      if ((point.m_y - radius) > (child.m_y + span2 + slack))
+      {
+         continue;
+      }
+      if ((point.m_z + radius) < (child.m_z - span2 - slack))
+      {
+         continue;
+      }
+      if ((point.m_z - radius) > (child.m_z + span2 + slack))
+      {
+         continue;
+      }
+      searchRange(point, radius, r2, start, end, level + 1, child, span2, visitor, data);
+   }
+}
+
+
+// Search for visible objects.
+// Matching objects are passed to the visitor.
+void LinearOctree::searchVisible(Frustum *frustum,
+                                 OCTVISITOR visitor, void *data)
+{
+   commit();
+   if (size > 0)
+   {
+      searchVisibleRange(frustum, 0, size, 0, tree->center, tree->span, visitor, data);
+   }
+}
+
+
+// Search range of entries under implied node for visible objects.
+void LinearOctree::searchVisibleRange(Frustum *frustum, int lo, int hi,
+                                      int level, Point3D center, float span,
+                                      OCTVISITOR visitor, void *data)
+{
+   register int       i, c, start, end;
+   float              xmin, xmax, ymin, ymax, zmin, zmax, span2;
+   int                shift;
+   unsigned long long prefix;
+   Point3D            child;
+
+   // Node intersects frustum?
+   xmin = center.m_x - span;
+   if (xmin < tree->bounds.xmin)
+   {
+      xmin = tree->bounds.xmin;
+   }
+   xmax = center.m_x + span;
+   if (xmax > tree->bounds.xmax)
+   {
+      xmax = tree->bounds.xmax;
+   }
+   ymin = center.m_y - span;
+   if (ymin < tree->bounds.ymin)
+   {
+      ymin = tree->bounds.ymin;
+   }
+   ymax = center.m_y + span;
+   if (ymax > tree->bounds.ymax)
+   {
+      ymax = tree->bounds.ymax;
+   }
+   zmin = center.m_z - span;
+   if (zmin < tree->bounds.zmin)
+   {
+      zmin = tree->bounds.zmin;
+   }
+   zmax = center.m_z + span;
+   if (zmax > tree->bounds.zmax)
+   {
+      zmax = tree->bounds.zmax;
+   }
+   if (!frustum->intersects(xmin, xmax, ymin, ymax, zmin, zmax))
+   {
+      return;
+   }
+
+   // Scan small ranges.
+   if (((hi - lo) <= LINEAR_LEAF_SIZE) || (level == MORTON_BITS))
+   {
+      for (i = lo; i < hi; i++)
+      {
+         if (frustum->isInside(entries[i].object->position))
+         {
+            visitor(entries[i].object, data);
+         }
+      }
+      return;
+   }
+
+   // Search children.
+   shift  = 3 * (MORTON_BITS - 1 - level);
+   prefix = entries[lo].code & ~((8ULL << shift) - 1);
+   span2  = span / 2.0f;
+   for (c = 0, start = lo; c < 8 && start < hi; c++, start = end)
+   {
+      end = (c == 7) ? hi : lowerBound(start, hi, prefix | ((unsigned long long)(c + 1) << shift));
+      if (start == end)
+      {
+         continue;
+      }
+      child.m_x = center.m_x + ((c & 1) ? span2 : -span2);
+      child.m_y = center.m_y + ((c & 2) ? span2 : -span2);
+      child.m_z = center.m_z + ((c & 4) ? span2 : -span2);
+      searchVisibleRange(frustum, start, end, level + 1, child, span2, visitor, data);
+   }
+}
+
+
+// Join.
+// Pairs of objects within radius are passed to the visitor.
+void LinearOctree::join(float radius, OCTPAIRVISITOR visitor, void *data)
+{
+   RANGE range;
+
+   commit();
+   if (size > 0)
+   {
+      range.lo     = 0;
+      range.hi     = size;
+      range.level  = 0;
+      range.center = tree->center;
+      range.span   = tree->span;
+      joinRange(radius * radius, &range, visitor, data);
+   }
+}
+
+
+// Join against another tree.
+// Objects of this tree are passed first.
+void LinearOctree::join(LinearOctree *other, float radius,
+                        OCTPAIRVISITOR visitor, void *data)
+{
+   RANGE range, otherRange;
+
+   commit();
+   other->commit();
+   if ((size > 0) && (other->size > 0))
+   {
+      range.lo          = 0;
+      range.hi          = size;
+      range.level       = 0;
+      range.center      = tree->center;
+      range.span        = tree->span;
+      otherRange.lo     = 0;
+      otherRange.hi     = other->size;
+      otherRange.level  = 0;
+      otherRange.center = other->tree->center;
+      otherRange.span   = other->tree->span;
+      joinRanges(other, radius * radius, &range, &otherRange, visitor, data);
+   }
+}
+
+
+// Split range into non-empty child ranges.
+int LinearOctree::splitRange(RANGE *range, RANGE *children)
+{
+   register int       c, n, start, end;
+   float              span2;
+   int                shift;
+   unsigned long long prefix;
+
+   shift  = 3 * (MORTON_BITS - 1 - range->level);
+   prefix = entries[range->lo].code & ~((8ULL << shift) - 1);
+   span2  = range->span / 2.0f;
+   for (c = n = 0, start = range->lo; c < 8 && start < range->hi; c++, start = end)
+   {
+      end = (c == 7) ? range->hi : lowerBound(start, range->hi, prefix | ((unsigned long long)(c + 1) << shift));
+      if (start == end)
+      {
+         continue;
+      }
+      children[n].lo         = start;
+      children[n].hi         = end;
+      children[n].level      = range->level + 1;
+      children[n].center.m_x = range->center.m_x + ((c & 1) ? span2 : -span2);
+      children[n].center.m_y = range->center.m_y + ((c & 2) ? span2 : -span2);
+      children[n].center.m_z = range->center.m_z + ((c & 4) ? span2 : -span2);
+      children[n].span       = span2;
+      n++;
+   }
+   return(n);
+}
+
+
+// Join range with itself.
+void LinearOctree::joinRange(float r2, RANGE *range,
+                             OCTPAIRVISITOR visitor, void *data)
+{
+   register int   i, j, n;
+   register ENTRY *e, *e2;
+   float          dx, dy, dz;
+   RANGE          children[8];
+
+   // Scan small ranges.
+   if (isLeaf(range))
+   {
+      for (i = range->lo; i < range->hi; i++)
+      {
+         e = &entries[i];
+         for (j = i + 1; j < range->hi; j++)
+         {
+            e2 = &entries[j];
+            dx = e->x - e2->x;
+            dy = e->y - e2->y;
+            dz = e->z - e2->z;
+            if (((dx * dx) + (dy * dy) + (dz * dz)) <= r2)
+            {
+               visitor(e->object, e2->object, data);
+            }
+         }
+      }
+      return;
+   }
+
+   // Join children with themselves and each other.
+   n = splitRange(range, children);
+   for (i = 0; i < n; i++)
+   {
+      joinRange(r2, &children[i], visitor, data);
+      for (j = i + 1; j < n; j++)
+      {
+         joinRanges(this, r2, &children[i], &children[j], visitor, data);
+      }
+   }
+}
+
+
+// Join range with a disjoint range of another (or the same) tree.
+// The larger implied node is split first.
+// Cube bounds are widened by a cell to absorb quantization.
+void LinearOctree::joinRanges(LinearOctree *other, float r2,
+                              RANGE *range, RANGE *otherRange,
+                              OCTPAIRVISITOR visitor, void *data)
+{
+   register int   i, j, n;
+   register ENTRY *e, *e2;
+   float          dx, dy, dz, slack;
+   bool           leaf, otherLeaf;
+   RANGE          children[8];
+
+   slack  = (tree->span * 2.0f) / (float)(1ULL << MORTON_BITS);
+   slack += (other->tree->span * 2.0f) / (float)(1ULL << MORTON_BITS);
+   if (Octree::gapSquare(range->center, range->span + slack,
+                         otherRange->center, otherRange->span) > r2)
+   {
+      return;
+   }
+
+   // Scan small range pairs.
+   leaf      = isLeaf(range);
+   otherLeaf = other->isLeaf(otherRange);
+   if (leaf && otherLeaf)
+   {
+      for (i = range->lo; i < range->hi; i++)
+      {
+         e = &entries[i];
+         for (j = otherRange->lo; j < otherRange->hi; j++)
+         {
+            e2 = &other->entries[j];
+            dx = e->x - e2->x;
+            dy = e->y - e2->y;
+            dz = e->z - e2->z;
+            if (((dx * dx) + (dy * dy) + (dz * dz)) <= r2)
+            {
+               visitor(e->object, e2->object, data);
+            }
+         }
+      }
+      return;
+   }
+
+   // Split larger node.
+   if (otherLeaf || (!leaf && (range->span >= otherRange->span)))
+   {
+      n = splitRange(range, children);
+      for (i = 0; i < n; i++)
+      {
+         joinRanges(other, r2, &children[i], otherRange, visitor, data);
+      }
+   }
+   else
+   {
+      n = other->splitRange(otherRange, children);
+      for (i = 0; i < n; i++)
+      {
+         joinRanges(other, r2, range, &children[i], visitor, data);
+      }
+   }
+}
+
+
+#ifdef _DEBUG
+// Audit.
+void LinearOctree::audit()
+{
+   register int i;
+
+   for (i = 0; i < size; i++)
+   {
+      assert(entries[i].object->tree == tree);
+      assert(entries[i].object->index == i);
+      assert(entries[i].code == encode(entries[i].object->position));
+      if (sorted && (i > 0))
+      {
+         assert(entries[i - 1].code <= entries[i].code);
+      }
+   }
+}
+
+
+#endif
+
+
+// Spatial grid constructor.
+// Cells cover the tree's cube from its lower corner.
+SpatialGrid::SpatialGrid(Octree *tree, float cellSize)
+{
+   register int i;
+
+   this->tree     = tree;
+   this->cellSize = cellSize;
+   inverse        = 1.0f / cellSize;
+   cells          = (int)ceil((2.0f * tree->span) * inverse);
+   if (cells < 1)
+   {
+      cells = 1;
+   }
+   origin.m_x = tree->center.m_x - tree->span;
+   origin.m_y = tree->center.m_y - tree->span;
+   origin.m_z = tree->center.m_z - tree->span;
+   entries    = NULL;
+   scratch    = NULL;
+   size       = 0;
+   capacity   = 0;
+   numBuckets = GRID_MIN_BUCKETS;
+   starts     = new int[numBuckets + 1];
+#ifdef _DEBUG
+   assert(starts != NULL);
+#endif
+   for (i = 0; i <= numBuckets; i++)
+   {
+      starts[i] = 0;
+   }
+   sorted = true;
+}
+
+
+// Destructor.
+SpatialGrid::~SpatialGrid()
+{
+   clear();
+   if (entries != NULL)
+   {
+      delete [] entries;
+      delete [] scratch;
+   }
+   delete [] starts;
+}
+
+
+// Clear: objects are freed to the owning tree's pool.
+void SpatialGrid::clear()
+{
+   register int       i;
+   register OctObject *object;
+
+   for (i = 0; i < size; i++)
+   {
+      object        = entries[i].object;
+      object->tree  = NULL;
+      object->index = -1;
+      tree->deleteObject(object);
+   }
+   size = 0;
+   for (i = 0; i <= numBuckets; i++)
+   {
+      starts[i] = 0;
+   }
+   sorted = true;
+}
+
+
+// Insert object.
+bool SpatialGrid::insert(OctObject *object)
+{
+   ENTRY *e;
+
+#ifdef _DEBUG
+   assert(object != NULL);
+   assert(object->tree == NULL);
+#endif
+   if (size == capacity)
+   {
+      capacity = (capacity == 0) ? 64 : capacity * 2;
+      e        = new ENTRY[capacity];
+#ifdef _DEBUG
+      assert(e != NULL);
+#endif
+      if (entries != NULL)
+      {
+         memcpy(e, entries, size * sizeof(ENTRY));
+         delete [] entries;
+         delete [] scratch;
+      }
+      entries = e;
+      scratch = new ENTRY[capacity];
+#ifdef _DEBUG
+      assert(scratch != NULL);
+#endif
+   }
+   e         = &entries[size];
+   e->object = object;
+   locate(e, object->position);
+   object->tree  = tree;
+   object->index = size;
+   size++;
+   sorted = false;
+   return(true);
+}
+
+
+// Remove object.
+// The last entry fills the hole.
+void SpatialGrid::remove(OctObject *object)
+{
+   register int i;
+
+#ifdef _DEBUG
+   assert(object != NULL);
+   assert(object->tree == tree);
+   assert(entries[object->index].object == object);
+#endif
+   i = object->index;
+   size--;
+   if (i < size)
+   {
+      entries[i]               = entries[size];
+      entries[i].object->index = i;
+   }
+   sorted        = false;
+   object->tree  = NULL;
+   object->index = -1;
+}
+
+
+// Move object.
+bool SpatialGrid::move(OctObject *object)
+{
+   register ENTRY *e;
+   int            bucket;
+
+#ifdef _DEBUG
+   assert(object != NULL);
+   assert(object->tree == tree);
+#endif
+   // Object left tree space?
+   if ((object->position.m_x < (tree->center.m_x - tree->span)) ||
+       (object->position.m_x >= (tree->center.m_x + tree->span)) ||
+       (object->position.m_y < (tree->center.m_y - tree->span)) ||
+       (object->position.m_y >= (tree->center.m_y + tree->span)) ||
+       (object->position.m_z < (tree->center.m_z - tree->span)) ||
+       (object->position.m_z >= (tree->center.m_z + tree->span)))
+   {
+      remove(object);
+      return(false);
+   }
+
+   e      = &entries[object->index];
+   bucket = e->bucket;
+   locate(e, object->position);
+   if (e->bucket != bucket)
+   {
+      sorted = false;
+   }
+   return(true);
+}
+
+
+// Set entry position, cell and bucket.
+void SpatialGrid::locate(ENTRY *entry, Point3D& point)
+{
+   entry->x      = point.m_x;
+   entry->y      = point.m_y;
+   entry->z      = point.m_z;
+   entry->ix     = cell(point.m_x, origin.m_x);
+   entry->iy     = cell(point.m_y, origin.m_y);
+   entry->iz     = cell(point.m_z, origin.m_z);
+   entry->bucket = hash(entry->ix, entry->iy, entry->iz);
+}
+
+
+// Group entries by bucket.
+// Buckets double to keep at least one per entry, and entries are
+// counting sorted into the scratch array, which becomes the entries.
+void SpatialGrid::commit()
+{
+   register int i, b;
+   ENTRY        *e;
+
+   if (sorted)
+   {
+      return;
+   }
+   if (numBuckets < size)
+   {
+      while (numBuckets < size)
+      {
+         numBuckets *= 2;
+      }
+      delete [] starts;
+      starts = new int[numBuckets + 1];
+#ifdef _DEBUG
+      assert(starts != NULL);
+#endif
+      for (i = 0; i < size; i++)
+      {
+         entries[i].bucket = hash(entries[i].ix, entries[i].iy, entries[i].iz);
+      }
+   }
+
+   // Count bucket sizes and offsets.
+   for (b = 0; b <= numBuckets; b++)
+   {
+      starts[b] = 0;
+   }
+   for (i = 0; i < size; i++)
+   {
+      starts[entries[i].bucket + 1]++;
+   }
+   for (b = 0; b < numBuckets; b++)
+   {
+      starts[b + 1] += starts[b];
+   }
+
+   // Scatter, advancing each bucket's start to its end, then restore.
+   for (i = 0; i < size; i++)
+   {
+      b                        = entries[i].bucket;
+      scratch[starts[b]]       = entries[i];
+      entries[i].object->index = starts[b]++;
+   }
+   for (b = numBuckets; b > 0; b--)
+   {
+      starts[b] = starts[b - 1];
+   }
+   starts[0] = 0;
+   e         = entries;
+   entries   = scratch;
+   scratch   = e;
+   sorted    = true;
+}
+
+
+// Search.
+// Scans the buckets of the cells overlapping the search cube, or
+// every entry when there are more such cells than entries.
+void SpatialGrid::search(Point3D point, float radius,
+                         OCTVISITOR visitor, void *data)
+{
+   register int   i, ix, iy, iz, b;
+   register ENTRY *e;
+   int            xlo, xhi, ylo, yhi, zlo, zhi;
+   float          r2, dx, dy, dz;
+
+   commit();
+   if (size == 0)
+   {
+      return;
+   }
+   r2  = radius * radius;
+   xlo = cell(point.m_x - radius, origin.m_x);
+   xhi = cell(point.m_x + radius, origin.m_x);
+   ylo = cell(point.m_y - radius, origin.m_y);
+   yhi = cell(point.m_y + radius, origin.m_y);
+   zlo = cell(point.m_z - radius, origin.m_z);
+   zhi = cell(point.m_z + radius, origin.m_z);
+   if (((double)(xhi - xlo + 1) * (double)(yhi - ylo + 1) * (double)(zhi - zlo + 1)) >
+       (double)size)
+   {
+      for (i = 0; i < size; i++)
+      {
+         e  = &entries[i];
+         dx = e->x - point.m_x;
+         dy = e->y - point.m_y;
+         dz = e->z - point.m_z;
+         if (((dx * dx) + (dy * dy) + (dz * dz)) <= r2)
+         {
+            visitor(e->object, data);
+         }
+      }
+      return;
+   }
+   for (iz = zlo; iz <= zhi; iz++)
+   {
+      for (iy = ylo; iy <= yhi; iy++)
+      {
+         for (ix = xlo; ix <= xhi; ix++)
+         {
+            b = hash(ix, iy, iz);
+            for (i = starts[b]; i < starts[b + 1]; i++)
+            {
+               e = &entries[i];
+               if ((e->ix != ix) || (e->iy != iy) || (e->iz != iz))
+               {
+                  continue;
+               }
+               dx = e->x - point.m_x;
+               dy = e->y - point.m_y;
+               dz = e->z - point.m_z;
+               if (((dx * dx) + (dy * dy) + (dz * dz)) <= r2)
+               {
+                  visitor(e->object, data);
+               }
+            }
+         }
+      }
+   }
+}
+
+
+// Search for visible objects.
+// Cells are not culled: every entry is tested.
+void SpatialGrid::searchVisible(Frustum *frustum,
+                                OCTVISITOR visitor, void *data)
+{
+   register int i;
+
+   if (!frustum->intersects(tree->bounds.xmin, tree->bounds.xmax,
+                            tree->bounds.ymin, tree->bounds.ymax,
+                            tree->bounds.zmin, tree->bounds.zmax))
+   {
+      return;
+   }
+   for (i = 0; i < size; i++)
+   {
+      if (frustum->isInside(entries[i].object->position))
+      {
+         visitor(entries[i].object, data);
+      }
+   }
+}
+
+
+// Join.
+// Each entry is paired with later entries of the cells overlapping
+// its search cube, so each pair is found once.
+void SpatialGrid::join(float radius, OCTPAIRVISITOR visitor, void *data)
+{
+   register int   i, j, ix, iy, iz, b;
+   register ENTRY *e, *e2;
+   int            xlo, xhi, ylo, yhi, zlo, zhi;
+   float          r2, dx, dy, dz;
+
+   commit();
+   r2 = radius * radius;
+   for (i = 0; i < size; i++)
+   {
+      e   = &entries[i];
+      xlo = cell(e->x - radius, origin.m_x);
+      xhi = cell(e->x + radius, origin.m_x);
+      ylo = cell(e->y - radius, origin.m_y);
+      yhi = cell(e->y + radius, origin.m_y);
+      zlo = cell(e->z - radius, origin.m_z);
+      zhi = cell(e->z + radius, origin.m_z);
+      for (iz = zlo; iz <= zhi; iz++)
+      {
+         for (iy = ylo; iy <= yhi; iy++)
+         {
+            for (ix = xlo; ix <= xhi; ix++)
+            {
+               b = hash(ix, iy, iz);
+               for (j = (starts[b] > i ? starts[b] : i + 1); j < starts[b + 1]; j++)
+               {
+                  e2 = &entries[j];
+                  if ((e2->ix != ix) || (e2->iy != iy) || (e2->iz != iz))
+                  {
+                     continue;
+                  }
+                  dx = e2->x - e->x;
+                  dy = e2->y - e->y;
+                  dz = e2->z - e->z;
+                  if (((dx * dx) + (dy * dy) + (dz * dz)) <= r2)
+                  {
+                     visitor(e->object, e2->object, data);
+                  }
+               }
+            }
+         }
+      }
+   }
+}
+
+
+#ifdef _DEBUG
+// Audit.
+void SpatialGrid::audit()
+{
+   register int i, b;
+
+   for (i = 0; i < size; i++)
+   {
+      assert(entries[i].object->tree == tree);
+      assert(entries[i].object->index == i);
+      assert(entries[i].ix == cell(entries[i].object->position.m_x, origin.m_x));
+      assert(entries[i].iy == cell(entries[i].object->position.m_y, origin.m_y));
+      assert(entries[i].iz == cell(entries[i].object->position.m_z, origin.m_z));
+      assert(entries[i].bucket == hash(entries[i].ix, entries[i].iy, entries[i].iz));
+   }
+   if (sorted)
+   {
+      for (b = 0; b < numBuckets; b++)
+      {
+         for (i = starts[b]; i < starts[b + 1]; i++)
+         {
+            assert(entries[i].bucket == b);
+         }
+      }
+      assert(starts[numBuckets] == size);
+   }
+}
+
+
+#endif
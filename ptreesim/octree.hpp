@@ -17,9 +17,105 @@
 #include "point3d.h"
 #include "frustum.hpp"
 
+// Approximate median histogram depth: 2^depth bins per axis.
+#define MEDIAN_DEPTH    6
+
+// Pool blocks per slab and block alignment.
+#define POOL_SLAB_BLOCKS    256
+#define POOL_ALIGN          16
+
+// Linear octree Morton code bits per axis and leaf scan size.
+#define MORTON_BITS         21
+#define LINEAR_LEAF_SIZE    8
+
+// Spatial grid minimum hash buckets, and cells per tree axis when
+// no cell size is set.
+#define GRID_MIN_BUCKETS    64
+#define GRID_CELLS          16
+
 class OctObject;
 class Octree;
 class OctNode;
+class LinearOctree;
+class SpatialGrid;
+
+// Search result visitor.
+typedef void (*OCTVISITOR)(OctObject *object, void *data);
+
+// Join result visitor.
+typedef void (*OCTPAIRVISITOR)(OctObject *object, OctObject *other, void *data);
+
+// Aggregate search node visitor.
+typedef void (*OCTNODEVISITOR)(OctNode *node, void *data);
+
+// Search result buffer.
+// Caller-owned, reusable result storage for reentrant searches.
+class OctSearchBuffer
+{
+public:
+
+   // Constructor.
+   OctSearchBuffer(int capacity = 64);
+
+   // Destructor.
+   ~OctSearchBuffer();
+
+   // Clear results.
+   void clear() { size = 0; }
+
+   // Append result.
+   void append(OctObject *object)
+   {
+      if (size == capacity)
+      {
+         grow();
+      }
+      objects[size++] = object;
+   }
+
+   // Grow storage.
+   void grow();
+
+   // Visitor appending to buffer.
+   static void visit(OctObject *object, void *buffer);
+
+   // Data members.
+   OctObject **objects;
+   int       size;
+   int       capacity;
+};
+
+// Slab allocator for fixed-size blocks.
+// Released blocks are kept on a free list for reuse;
+// slabs are returned to the heap when the pool is destroyed.
+class OctPool
+{
+public:
+
+   // Constructors.
+   OctPool();
+   OctPool(int blockSize, int slabBlocks = POOL_SLAB_BLOCKS);
+   void init(int blockSize, int slabBlocks = POOL_SLAB_BLOCKS);
+
+   // Destructor.
+   ~OctPool();
+
+   // Allocate block.
+   void *allocate();
+
+   // Release block to free list.
+   void release(void *block);
+
+   // Data members.
+   int  blockSize;
+   int  slabBlocks;
+   char *slabs;
+   void *freeList;
+   int  numSlabs;
+   int  numLive;
+   int  numFree;
+   int  peakLive;
+};
 
 // Object in tree.
 class OctObject
@@ -39,6 +135,10 @@ public:
    bool move(float x, float y, float z);
    bool move(Point3D point);
 
+   // Move object with velocity.
+   // Velocities are only summed by aggregating trees.
+   bool move(Point3D point, Point3D velocity);
+
    // Remove object from tree.
    void remove();
 
@@ -53,8 +153,18 @@ public:
 
    // Data members.
    Point3D position;
+   Point3D velocity;
    OctNode *node;
    void    *client;
+
+   // Entries in the node and tree object lists, for constant time
+   // unlinking.
+   std::list<OctObject *>::iterator nodeEntry;
+   std::list<OctObject *>::iterator listEntry;
+
+   // Linear octree holding object and its entry index.
+   Octree  *tree;
+   int     index;
 };
 
 // Octree.
@@ -70,6 +180,10 @@ public:
       float zmin, zmax;
    } BOUNDS;
 
+   // Spatial index backends.
+   typedef enum { POINTER_BACKEND, LINEAR_BACKEND, GRID_BACKEND }
+   BACKEND;
+
    // Constructors.
    Octree();
    Octree(float x, float y, float z, float span, float precision);
@@ -80,12 +194,48 @@ public:
    ~Octree();
    void clear();
 
+   // Allocate and free objects from the tree pool.
+   // Objects must be freed by the tree that allocated them.
+   OctObject *newObject(float x, float y, float z, void *client);
+   OctObject *newObject(Point3D point, void *client);
+   void deleteObject(OctObject *object);
+
+   // Allocate and free nodes from the tree pool.
+   OctNode *newNode(float x, float y, float z, float span,
+                    OctNode *parent, OctObject *object);
+   OctNode *newNode(Point3D center, float span,
+                    OctNode *parent, OctObject *object);
+   void deleteNode(OctNode *node);
+
+   // Set spatial index backend.
+   // Objects already in the tree are re-indexed.
+   void setBackend(BACKEND backend);
+
+   // Set grid backend cell size (0 = span / GRID_CELLS).
+   // A grid in use is rebuilt.
+   void setCellSize(float size);
+
    // Insert object.
    bool insert(OctObject *object);
 
    // Remove object.
    void remove(OctObject *object);
 
+   // Set adaptive rebuild threshold (0 = always move incrementally).
+   // Each round of moves counts the objects leaving their nodes. While
+   // the fraction of the previous round exceeds the threshold, moves
+   // only update positions and the pointer tree is rebuilt in bulk
+   // when the round ends.
+   void setRebuildThreshold(float threshold) { rebuildThreshold = threshold; }
+
+   // Begin/end a round of object moves.
+   // beginMoves() returns true if the round will rebuild the tree.
+   bool beginMoves();
+   void endMoves();
+
+   // Rebuild pointer tree in bulk from object list.
+   void rebuild();
+
    // Search.
    // Returns list of matching objects.
    void search(float x, float y, float z, float radius,
@@ -93,9 +243,81 @@ public:
    void search(Point3D point, float radius,
                std::list<OctObject *>& searchList);
 
+   // Reentrant search.
+   // Matching objects are appended to the buffer or passed to the
+   // visitor; the tree is not modified. Call commit() before
+   // searching a tree from more than one thread.
+   void search(Point3D point, float radius, OctSearchBuffer *buffer);
+   void search(Point3D point, float radius, OCTVISITOR visitor, void *data);
+
+   // Search around an object in the tree.
+   // Starts from the object's node rather than the root, climbing only
+   // until the node contains the search cube. Objects of other trees
+   // are searched from the root. Results are as for a search around
+   // the object's position.
+   void search(OctObject *object, float radius, OctSearchBuffer *buffer);
+   void search(OctObject *object, float radius, OCTVISITOR visitor, void *data);
+
+   // Set aggregate mode.
+   // Aggregating pointer nodes keep sums of the positions and
+   // velocities of the objects below them, updated as objects move.
+   void setAggregate(bool mode);
+
+   // Aggregate search.
+   // As search, for a searcher that only sees objects within the cone
+   // about direction whose half-angle cosine squared is cos2. Subtrees
+   // entirely outside the cone are skipped, and a subtree of more than
+   // one object is passed whole to the node visitor when it lies
+   // entirely within radius and the cone, and is smaller than theta
+   // times its distance from point. Only aggregating pointer trees
+   // skip or pass subtrees; others search normally.
+   void searchAggregate(Point3D point, float radius, Point3D direction,
+                        float cos2, float theta, OCTVISITOR visitor,
+                        OCTNODEVISITOR nodeVisitor, void *data);
+
+   // Aggregate search cone: unit axis and half-angle.
+   typedef struct
+   {
+      Point3D axis;
+      float   cosine;
+      float   sine;
+   } CONE;
+
    // Search for visible objects.
    void searchVisible(Frustum                 *frustum,
                       std::list<OctObject *>& searchList);
+   void searchVisible(Frustum *frustum, OctSearchBuffer *buffer);
+   void searchVisible(Frustum *frustum, OCTVISITOR visitor, void *data);
+
+   // Join.
+   // Each pair of objects within radius of each other is passed to
+   // the visitor once, found by simultaneous traversal of node pairs.
+   // Joining another tree passes pairs of an object in this tree and
+   // an object in the other tree, in that order. The trees are not
+   // modified; call commit() on both before joining from more than one
+   // thread.
+   void join(float radius, OCTPAIRVISITOR visitor, void *data);
+   void join(Octree *tree, float radius, OCTPAIRVISITOR visitor, void *data);
+
+   // Search result to join result adapter.
+   typedef struct
+   {
+      OctObject      *object;
+      bool           swap;
+      OCTPAIRVISITOR visitor;
+      void           *data;
+   } PAIR;
+   static void visitPair(OctObject *object, void *pair);
+
+   // Squared distance between cubes.
+   static float gapSquare(Point3D& center, float span,
+                          Point3D& center2, float span2);
+
+   // Prepare index for concurrent searches.
+   void commit();
+
+   // Visitor appending results to a list.
+   static void append(OctObject *object, void *list);
 
    // Set bounds.
    void setBounds(BOUNDS bounds);
@@ -107,10 +329,24 @@ public:
    // Find median point of objects.
    void findMedian();
 
+   // Set approximate median mode.
+   // Approximate medians are found from node counts instead of positions.
+   void setApproximateMedian(bool mode) { approximateMedian = mode; }
+
+   // Find approximate median point of objects.
+   void findApproximateMedian();
+
    typedef enum { XSORT, YSORT, ZSORT }
    SORTTYPE;
    void sortObjects(SORTTYPE);
 
+   // Select median of values, reordering them.
+   static float selectMedian(float *values, int count);
+
+   // Median of histogram.
+   static float histogramMedian(int *bins, int numBins, float origin,
+                                float width, int count);
+
 #ifdef _DEBUG
    // Audit.
    void audit();
@@ -123,10 +359,229 @@ public:
    float                  precision;
    BOUNDS                 bounds;
    std::list<OctObject *> objects;
-   int     load;
-   Point3D median;
+   int                    load;
+   Point3D                median;
+   bool                   approximateMedian;
+   float                  *medianBuffer;
+   int                    medianBufferSize;
+   OctPool                nodePool;
+   OctPool                objectPool;
+   BACKEND                backend;
+   bool                   aggregate;
+   float                  rebuildThreshold;
+   bool                   rebuilding;
+   int                    relinks;                // objects leaving nodes this round
+   float                  relinkFraction;         // of objects, last round
+   OctObject              **rebuildBuffer;
+   int                    rebuildBufferSize;
+   LinearOctree           *linear;
+   SpatialGrid            *grid;
+   float                  cellSize;
+};
+
+// Linear octree.
+// Objects are kept in an array sorted by Morton code of their
+// quantized position; nodes are implied by code prefixes.
+// Moves only update codes, and the array is re-sorted lazily
+// before the next search.
+class LinearOctree
+{
+public:
+
+   // Entry.
+   typedef struct
+   {
+      unsigned long long code;
+      float              x, y, z;
+      OctObject          *object;
+   } ENTRY;
+
+   // Constructor.
+   LinearOctree(Octree *tree);
+
+   // Destructor.
+   ~LinearOctree();
+   void clear();
+
+   // Insert object.
+   bool insert(OctObject *object);
+
+   // Remove object.
+   void remove(OctObject *object);
+
+   // Move object.
+   // Returns false if migrating out of tree.
+   bool move(OctObject *object);
+
+   // Search.
+   // Matching objects are passed to the visitor.
+   void search(Point3D point, float radius,
+               OCTVISITOR visitor, void *data);
+
+   // Search around an object in the tree.
+   // Starts from the smallest implied node containing the search cube.
+   void search(OctObject *object, float radius,
+               OCTVISITOR visitor, void *data);
+
+   // Search for visible objects.
+   // Matching objects are passed to the visitor.
+   void searchVisible(Frustum *frustum,
+                      OCTVISITOR visitor, void *data);
+
+   // Join.
+   // Pairs of objects within radius are passed to the visitor.
+   void join(float radius, OCTPAIRVISITOR visitor, void *data);
+   void join(LinearOctree *other, float radius,
+             OCTPAIRVISITOR visitor, void *data);
+
+   // Sort entries by code.
+   void commit();
+
+   // Morton code of position.
+   unsigned long long encode(Point3D point);
+   static unsigned long long spread(unsigned long long bits);
+   static unsigned long long compact(unsigned long long bits);
+
+#ifdef _DEBUG
+   // Audit.
+   void audit();
+#endif
+
+   // Search range of entries under implied node.
+   void searchRange(Point3D& point, float radius, float r2, int lo, int hi,
+                    int level, Point3D center, float span,
+                    OCTVISITOR visitor, void *data);
+   void searchVisibleRange(Frustum *frustum, int lo, int hi,
+                           int level, Point3D center, float span,
+                           OCTVISITOR visitor, void *data);
+
+   // Range of entries under implied node.
+   typedef struct
+   {
+      int     lo, hi;
+      int     level;
+      Point3D center;
+      float   span;
+   } RANGE;
+
+   // Range is scanned rather than split?
+   bool isLeaf(RANGE *range)
+   {
+      return(((range->hi - range->lo) <= LINEAR_LEAF_SIZE) ||
+             (range->level == MORTON_BITS));
+   }
+
+   // Split range into non-empty child ranges; returns their number.
+   int splitRange(RANGE *range, RANGE *children);
+
+   // Join range with itself, and with a range of another tree.
+   void joinRange(float r2, RANGE *range, OCTPAIRVISITOR visitor, void *data);
+   void joinRanges(LinearOctree *other, float r2, RANGE *range, RANGE *otherRange,
+                   OCTPAIRVISITOR visitor, void *data);
+
+   // Find first entry in range at or above code.
+   int lowerBound(int lo, int hi, unsigned long long code);
+
+   // Data members.
+   Octree *tree;
+   ENTRY  *entries;
+   int    size;
+   int    capacity;
+   bool   sorted;
+};
+
+// Spatial hash grid.
+// Space is divided into cubic cells of one size, and objects are kept
+// in an array grouped by the hash bucket of their cell, found through
+// a table of bucket offsets. Moves only update cells, and the array
+// is regrouped by counting sort before the next search.
+class SpatialGrid
+{
+public:
+
+   // Entry.
+   typedef struct
+   {
+      int       ix, iy, iz;
+      int       bucket;
+      float     x, y, z;
+      OctObject *object;
+   } ENTRY;
+
+   // Constructor.
+   SpatialGrid(Octree *tree, float cellSize);
+
+   // Destructor.
+   ~SpatialGrid();
+   void clear();
+
+   // Insert object.
+   bool insert(OctObject *object);
+
+   // Remove object.
+   void remove(OctObject *object);
+
+   // Move object.
+   // Returns false if migrating out of tree.
+   bool move(OctObject *object);
+
+   // Search.
+   // Matching objects are passed to the visitor.
+   void search(Point3D point, float radius,
+               OCTVISITOR visitor, void *data);
+
+   // Search for visible objects.
+   // Matching objects are passed to the visitor.
+   void searchVisible(Frustum *frustum,
+                      OCTVISITOR visitor, void *data);
+
+   // Join.
+   // Pairs of objects within radius are passed to the visitor.
+   void join(float radius, OCTPAIRVISITOR visitor, void *data);
+
+   // Group entries by bucket.
+   void commit();
+
+   // Cell of coordinate on an axis, clamped to the tree.
+   // Truncation only differs from floor below zero, which clamps.
+   int cell(float coordinate, float origin)
+   {
+      register int c = (int)((coordinate - origin) * inverse);
+
+      return(c < 0 ? 0 : (c >= cells ? cells - 1 : c));
+   }
+
+   // Hash bucket of cell.
+   int hash(int ix, int iy, int iz)
+   {
+      return((int)((((unsigned int)ix * 73856093u) ^ ((unsigned int)iy * 19349663u) ^
+                    ((unsigned int)iz * 83492791u)) & (unsigned int)(numBuckets - 1)));
+   }
+
+   // Set entry position, cell and bucket.
+   void locate(ENTRY *entry, Point3D& point);
+
+#ifdef _DEBUG
+   // Audit.
+   void audit();
+#endif
+
+   // Data members.
+   Octree  *tree;
+   float   cellSize;
+   float   inverse;
+   int     cells;
+   Point3D origin;
+   ENTRY   *entries;
+   ENTRY   *scratch;
+   int     size;
+   int     capacity;
+   int     *starts;
+   int     numBuckets;
+   bool    sorted;
 };
 
+
 // Node.
 class OctNode
 {
@@ -152,19 +607,71 @@ public:
    // Contract node.
    void contract();
 
+   // Adjust object count and aggregates of node and ancestors.
+   void adjustCount(int delta, OctObject *object);
+
+   // Shift aggregates of node and ancestors for a moving object.
+   void shiftSums(OctObject *object, Point3D& point, Point3D& velocity);
+
+   // Recompute aggregates of subtree.
+   void sumObjects();
+
+   // Count objects into median histograms.
+   void countObjects(int depth, int *xbins, int *ybins, int *zbins);
+
    // Move object.
    // Returns false if migrating out of bounds.
    bool move(OctObject *object);
 
+   // Move object while tree awaits rebuild.
+   // Only objects leaving the tree are removed; returns false for them.
+   bool deferMove(OctObject *object);
+
+   // Build subtree in bulk from objects inside node.
+   // Objects close to the first are kept together, as by insert();
+   // otherwise they are partitioned into children through scratch.
+   void build(OctObject **array, int count, OctObject **scratch);
+
+   // Child octant of point.
+   int octant(Point3D& point)
+   {
+      return(((point.m_z < center.m_z) ? 0 : 4) + ((point.m_x < center.m_x) ? 0 : 2) +
+             ((point.m_y < center.m_y) ? 0 : 1));
+   }
+
    // Search.
-   // Returns list of matching objects.
+   // Matching objects are passed to the visitor.
    void search(Point3D point, float radius,
-               std::list<OctObject *>& searchList);
+               OCTVISITOR visitor, void *data);
+
+   // Node contains search cube?
+   bool contains(Point3D& point, float radius);
+
+   // Aggregate search.
+   void searchAggregate(Point3D& point, float radius, Octree::CONE *cone,
+                        float theta, OCTVISITOR visitor,
+                        OCTNODEVISITOR nodeVisitor, void *data);
+
+   // Subtree can be passed whole by an aggregate search?
+   bool isAggregate(Point3D& point, float radius, Octree::CONE *cone,
+                    float theta);
+
+   // Node entirely outside search cone?
+   bool isOutside(Point3D& point, Octree::CONE *cone);
 
    // Search for visible objects.
-   // Returns list of matching objects.
-   void searchVisible(Frustum                 *frustum,
-                      std::list<OctObject *>& searchList);
+   // Matching objects are passed to the visitor.
+   void searchVisible(Frustum *frustum,
+                      OCTVISITOR visitor, void *data);
+
+   // Join.
+   // Pairs of objects within radius are passed to the visitor:
+   // pairs within this subtree, pairs between this subtree and
+   // another, and pairs of an object and this subtree.
+   void join(float radius, OCTPAIRVISITOR visitor, void *data);
+   void join(OctNode *node, float radius, OCTPAIRVISITOR visitor, void *data);
+   void joinObject(OctObject *object, bool swap, float radius,
+                   OCTPAIRVISITOR visitor, void *data);
 
 #ifdef _DEBUG
    bool auditNode(Octree *);
@@ -176,8 +683,11 @@ public:
    std::list<OctObject *> objects;
    OctNode                *parent;
    OctNode                *children[8];
-   int     numChildren;
-   Point3D center;
-   float   span;
+   int                    numChildren;
+   int                    count;
+   double                 positionSum[3];
+   double                 velocitySum[3];
+   Point3D                center;
+   float                  span;
 };
 #endif
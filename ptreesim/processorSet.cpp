@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <time.h>
+#include <new>
 
 #define PRAND    ((float)(rand() % 1001) / 1000.0f)
 
@@ -102,7 +103,7 @@ ProcessorSet::ProcessorSet(int dimension, float span, int numBoids,
          }
       }
    }
-   delete assign;
+   delete [] assign;
 
    newBounds = new Octree::BOUNDS[numProcs];
 #ifdef _DEBUG
@@ -111,6 +112,139 @@ ProcessorSet::ProcessorSet(int dimension, float span, int numBoids,
 
    // Load-balancing off.
    loadBalance = false;
+
+   // Instrument partitions.
+   tickStats.init(numProcs);
+
+   // Search neighbors every update.
+   neighborSkin  = 0.0f;
+   neighborBuild = 0;
+   neighborJoin  = false;
+   joinBuild     = -1;
+   joinPairs     = 0;
+
+   // Exact aim.
+   aggregateAim   = false;
+   aggregateTheta = 0.0f;
+
+   // Boid navigator.
+   flockKernel = NULL;
+
+   // Single-threaded update.
+   numThreads    = 1;
+   pool          = NULL;
+   workerBuffers = NULL;
+   workerStats   = NULL;
+   workerViews   = NULL;
+   items         = NULL;
+   numItems      = 0;
+   itemCapacity  = 0;
+   aimed         = NULL;
+   itemStart     = new int[numProcs + 1];
+   cursors       = new std::atomic<int>[numProcs];
+   outboxes      = new std::vector<Boid *>[numProcs * numProcs];
+#ifdef _DEBUG
+   assert(itemStart != NULL && cursors != NULL && outboxes != NULL);
+#endif
+}
+
+
+// Set number of update threads.
+void ProcessorSet::setNumThreads(int numThreads)
+{
+   int i;
+
+   if (numThreads < 1)
+   {
+      numThreads = 1;
+   }
+   if (pool != NULL)
+   {
+      delete pool;
+      delete [] workerBuffers;
+      delete [] workerStats;
+      delete [] workerViews;
+      pool          = NULL;
+      workerBuffers = NULL;
+      workerStats   = NULL;
+      workerViews   = NULL;
+   }
+   this->numThreads = numThreads;
+   if ((numThreads > 1) || (flockKernel != NULL))
+   {
+      pool          = new ThreadPool(numThreads);
+      workerBuffers = new OctSearchBuffer[numThreads];
+      workerStats   = new TickStats[numThreads];
+      workerViews   = new std::vector<BoidNeighbor>[numThreads];
+#ifdef _DEBUG
+      assert(pool != NULL && workerBuffers != NULL &&
+             workerStats != NULL && workerViews != NULL);
+#endif
+      for (i = 0; i < numThreads; i++)
+      {
+         workerStats[i].init(numProcs);
+      }
+   }
+}
+
+
+// Set structure-of-arrays flocking kernel.
+void ProcessorSet::setFlockKernel(bool mode, FlockKernel::ISA isa)
+{
+   if (flockKernel != NULL)
+   {
+      delete flockKernel;
+      flockKernel = NULL;
+   }
+   if (mode)
+   {
+      flockKernel = new FlockKernel(isa);
+#ifdef _DEBUG
+      assert(flockKernel != NULL);
+#endif
+   }
+
+   // Kernel needs worker buffers.
+   setNumThreads(numThreads);
+}
+
+
+// Set approximate median mode for load-balancing.
+void ProcessorSet::setApproximateMedian(bool mode)
+{
+   register int i;
+
+   for (i = 0; i < numProcs; i++)
+   {
+      octrees[i]->setApproximateMedian(mode);
+   }
+}
+
+
+// Set octree spatial index backend.
+// Grid cells are the size of the visibility range, so a neighbor
+// search scans at most 27 cells.
+void ProcessorSet::setOctreeBackend(Octree::BACKEND backend)
+{
+   register int i;
+
+   for (i = 0; i < numProcs; i++)
+   {
+      octrees[i]->setCellSize((float)Boid::visibilityRange);
+      octrees[i]->setBackend(backend);
+   }
+}
+
+
+// Set adaptive octree rebuild threshold (0 = always move incrementally).
+void ProcessorSet::setRebuildThreshold(float threshold)
+{
+   register int i;
+
+   for (i = 0; i < numProcs; i++)
+   {
+      octrees[i]->setRebuildThreshold(threshold);
+   }
 }
 
 
@@ -123,10 +257,29 @@ ProcessorSet::~ProcessorSet()
    {
       delete octrees[i];
    }
-   delete octrees;
-   delete migrations;
-   delete ptypes;
-   delete newBounds;
+   delete [] octrees;
+   delete [] migrations;
+   delete [] ptypes;
+   delete [] newBounds;
+   if (pool != NULL)
+   {
+      delete pool;
+      delete [] workerBuffers;
+      delete [] workerStats;
+      delete [] workerViews;
+   }
+   if (items != NULL)
+   {
+      delete [] items;
+      ::operator delete(aimed);
+   }
+   delete [] itemStart;
+   delete [] cursors;
+   delete [] outboxes;
+   if (flockKernel != NULL)
+   {
+      delete flockKernel;
+   }
 }
 
 
@@ -155,8 +308,8 @@ void ProcessorSet::makeBoids(int proc, int quantity)
 #ifdef _DEBUG
       assert(boid != NULL);
 #endif
-      object = new OctObject((float)position.x, (float)position.y,
-                             (float)position.z, (void *)boid);
+      object = octrees[proc]->newObject((float)position.x, (float)position.y,
+                                        (float)position.z, (void *)boid);
 #ifdef _DEBUG
       assert(object != NULL);
 #endif
@@ -173,18 +326,19 @@ void ProcessorSet::update(float simRate)
    register int       i, proc;
    register OctObject *object;
 
-   std::list<OctObject *>           tmpList;
    std::list<OctObject *>::iterator itr;
    Octree::BOUNDS    bounds;
    register CENTROID *centroids, *centroid;
    int               *parray;
-   std::list<Boid>   boidList;
    register Boid     *boid;
-   Vector            position;
+   Vector            position, velocity;
+   Point3D           point, heading;
+   TIME              phaseStart, start;
 
    // Load-balance?
    if (loadBalance)
    {
+      phaseStart  = tickStats.start();
       bounds.xmax = bounds.ymax = bounds.zmax = span;
       bounds.xmin = bounds.ymin = bounds.zmin = -span;
       centroids   = NULL;
@@ -200,7 +354,9 @@ void ProcessorSet::update(float simRate)
 #ifdef _DEBUG
          assert(ptypes[proc] == LOCAL);
 #endif
+         start = tickStats.start();
          octrees[proc]->findMedian();
+         tickStats.stop(TickStats::MEDIAN_PHASE, start);
          centroid->position = octrees[proc]->median;
       }
       parray = new int[numProcs];
@@ -218,13 +374,15 @@ void ProcessorSet::update(float simRate)
          centroids = centroids->next;
          delete centroid;
       }
-      delete parray;
+      delete [] parray;
       for (proc = 0; proc < numProcs; proc++)
       {
          octrees[proc]->setBounds(newBounds[proc]);
       }
+      invalidateNeighbors();
 
       // Cull and migrate boids to revised octrees.
+      start = tickStats.start();
       for (proc = 0; proc < numProcs; proc++)
       {
          if (ptypes[proc] == LOCAL)
@@ -238,6 +396,7 @@ void ProcessorSet::update(float simRate)
               itr != migrations[proc].end(); itr++)
          {
             object = *itr;
+            tickStats.count(proc, TickStats::MIGRATIONS_COUNT);
             for (i = 0; i < numProcs; i++)
             {
                if (i == proc)
@@ -253,13 +412,31 @@ void ProcessorSet::update(float simRate)
 #ifdef _DEBUG
             assert(i < numProcs);
 #endif
-            delete object;
+            octrees[proc]->deleteObject(object);
          }
          migrations[proc].clear();
       }
+      tickStats.stop(TickStats::MIGRATE_PHASE, start);
+      tickStats.stop(TickStats::BALANCE_PHASE, phaseStart);
+   }
+
+   // Rebuild neighbor lists?
+   checkNeighbors();
+
+   // Threaded update?
+   if (pool != NULL)
+   {
+      updateThreaded(simRate);
+      tickStats.tick();
+      return;
    }
 
    // Update phase 1: update boid velocity and acceleration and determine new position.
+   phaseStart = tickStats.start();
+   if (neighborJoin && (joinBuild != neighborBuild))
+   {
+      joinNeighbors();
+   }
    for (proc = 0; proc < numProcs; proc++)
    {
       // Update local objects.
@@ -273,32 +450,28 @@ void ProcessorSet::update(float simRate)
       {
          object = *itr;
 
-         // Do cross-processor search.
-         boidList.clear();
-         float range = (float)Boid::visibilityRange;
-         bounds.xmin = object->position.m_x - range;
-         bounds.xmax = object->position.m_x + range;
-         bounds.ymin = object->position.m_y - range;
-         bounds.ymax = object->position.m_y + range;
-         bounds.zmin = object->position.m_z - range;
-         bounds.zmax = object->position.m_z + range;
-         for (i = 0; i < numProcs; i++)
+         boid = (Boid *)object->client;
+         if (aggregateAim)
          {
-            // Search intersects processor space?
-            if (intersects(octrees[i]->bounds, bounds))
-            {
-               // Accumulate search results.
-               search(i, object->position, range, boidList);
-            }
+            // Aggregate against the field of view after flying.
+            boid->fly(simRate);
+            searchNeighbors(object, neighborViews, &searchBuffer, &tickStats, boid);
+            boid->navigate(neighborViews.data(), (int)neighborViews.size());
          }
+         else
+         {
+            // Do cross-processor search.
+            searchNeighbors(object, neighborViews, &searchBuffer, &tickStats);
 
-         // Update boid based on search results.
-         boid = (Boid *)object->client;
-         boid->aim(boidList, simRate);
+            // Update boid based on search results.
+            boid->aim(neighborViews.data(), (int)neighborViews.size(), simRate);
+         }
       }
    }
+   tickStats.stop(TickStats::AIM_PHASE, phaseStart);
 
    // Update phase 2: Move and migrate boids.
+   phaseStart = tickStats.start();
    for (proc = 0; proc < numProcs; proc++)
    {
       // Update local objects.
@@ -307,18 +480,22 @@ void ProcessorSet::update(float simRate)
          continue;
       }
 
-      tmpList.clear();
+      octrees[proc]->beginMoves();
       for (itr = octrees[proc]->objects.begin();
-           itr != octrees[proc]->objects.end(); itr++)
+           itr != octrees[proc]->objects.end(); )
       {
          object = *itr;
          boid   = (Boid *)object->client;
          boid->move();
          position = boid->getPosition();
-         if (!object->move((float)position.x, (float)position.y, (float)position.z))
+         velocity = boid->getVelocity();
+         point.set((float)position.x, (float)position.y, (float)position.z);
+         heading.set((float)velocity.x, (float)velocity.y, (float)velocity.z);
+         if (!object->move(point, heading))
          {
             // Boid migrating processors.
             octrees[proc]->load--;
+            tickStats.count(proc, TickStats::MIGRATIONS_COUNT);
             for (i = 0; i < numProcs; i++)
             {
                if (i == proc)
@@ -327,25 +504,307 @@ void ProcessorSet::update(float simRate)
                }
                if (object->isInside(octrees[i]))
                {
+                  start = tickStats.start();
                   insert(i, boid);
+                  tickStats.stop(TickStats::INSERT_PHASE, start);
                   break;
                }
             }
 #ifdef _DEBUG
             assert(i < numProcs);
 #endif
-            delete object;
+            itr = octrees[proc]->objects.erase(itr);
+            octrees[proc]->deleteObject(object);
          }
          else
          {
-            tmpList.push_back(object);
+            itr++;
+         }
+      }
+      endMoves(proc, &tickStats);
+   }
+   tickStats.stop(TickStats::MOVE_PHASE, phaseStart);
+   tickStats.tick();
+}
+
+
+// Threaded update.
+// Phase 1 aims copies of the boids with workers stealing chunks
+// across partitions, then stores the copies back. Phase 2 moves each
+// partition on one worker, queueing migrants by destination, then
+// inserts each destination's migrants on one worker.
+void ProcessorSet::updateThreaded(float simRate)
+{
+   register int       i, proc;
+   register OctObject *object;
+   TIME               phaseStart;
+
+   std::list<OctObject *>::iterator itr;
+
+   // Snapshot local objects by partition.
+   numItems = 0;
+   for (proc = 0; proc < numProcs; proc++)
+   {
+      if (ptypes[proc] == LOCAL)
+      {
+         numItems += octrees[proc]->load;
+      }
+   }
+   if (numItems > itemCapacity)
+   {
+      if (items != NULL)
+      {
+         delete [] items;
+         ::operator delete(aimed);
+      }
+      itemCapacity = numItems * 2;
+      items        = new OctObject *[itemCapacity];
+      aimed        = (Boid *)::operator new(itemCapacity * sizeof(Boid));
+#ifdef _DEBUG
+      assert(items != NULL && aimed != NULL);
+#endif
+   }
+   numItems = 0;
+   for (proc = 0; proc < numProcs; proc++)
+   {
+      itemStart[proc] = numItems;
+      cursors[proc]   = numItems;
+      if (ptypes[proc] != LOCAL)
+      {
+         continue;
+      }
+      for (itr = octrees[proc]->objects.begin();
+           itr != octrees[proc]->objects.end(); itr++)
+      {
+         object            = *itr;
+         items[numItems++] = object;
+      }
+
+      // Searches must not modify trees.
+      octrees[proc]->commit();
+   }
+   itemStart[numProcs] = numItems;
+   taskRate            = simRate;
+
+   // Snapshot boid state for the flocking kernel.
+   if (flockKernel != NULL)
+   {
+      flockKernel->load(numItems);
+      for (i = 0; i < numItems; i++)
+      {
+         flockKernel->setBoid(i, (Boid *)items[i]->client);
+      }
+   }
+
+   // Update phase 1: aim boids, then store aimed boids.
+   phaseStart = tickStats.start();
+   if (neighborJoin && (joinBuild != neighborBuild))
+   {
+      joinNeighbors();
+   }
+   pool->run(aimTask, this);
+   cursor = 0;
+   pool->run(storeTask, this);
+   tickStats.stop(TickStats::AIM_PHASE, phaseStart);
+
+   // Update phase 2: move boids, then insert migrating boids.
+   phaseStart = tickStats.start();
+   cursor     = 0;
+   pool->run(moveTask, this);
+   cursor = 0;
+   pool->run(insertTask, this);
+   tickStats.stop(TickStats::MOVE_PHASE, phaseStart);
+
+   // Collect worker statistics.
+   // Worker phase times are summed over workers.
+   for (i = 0; i < numThreads; i++)
+   {
+      tickStats.merge(&workerStats[i]);
+      workerStats[i].reset();
+   }
+}
+
+
+// Aim task.
+// Workers start on their own partitions and steal from the others.
+void ProcessorSet::aimTask(int worker, void *pset)
+{
+   ProcessorSet *set = (ProcessorSet *)pset;
+   int          i, n, proc, item, end;
+
+   for (i = 0; i < set->numProcs; i++)
+   {
+      proc = (((worker * set->numProcs) / set->numThreads) + i) % set->numProcs;
+      end  = set->itemStart[proc + 1];
+      while ((item = set->cursors[proc].fetch_add(AIM_CHUNK)) < end)
+      {
+         for (n = 0; n < AIM_CHUNK && item < end; n++, item++)
+         {
+            set->aimItem(worker, item);
          }
       }
-      octrees[proc]->objects.clear();
-      for (itr = tmpList.begin(); itr != tmpList.end(); itr++)
+   }
+}
+
+
+// Aim a copy of an item's boid.
+void ProcessorSet::aimItem(int worker, int item)
+{
+   OctObject *object;
+
+   std::vector<BoidNeighbor>& views = workerViews[worker];
+
+   object = items[item];
+   new(&aimed[item])Boid(*(Boid *)object->client);
+   if (aggregateAim && (flockKernel == NULL))
+   {
+      // Aggregate against the field of view after flying.
+      aimed[item].fly(taskRate);
+      searchNeighbors(object, views, &workerBuffers[worker], &workerStats[worker],
+                      &aimed[item]);
+      aimed[item].navigate(views.data(), (int)views.size());
+      return;
+   }
+
+   // Do cross-processor search.
+   searchNeighbors(object, views, &workerBuffers[worker], &workerStats[worker]);
+
+   // Aim copy based on search results.
+   if (flockKernel != NULL)
+   {
+      aimed[item].fly(taskRate);
+      aimed[item].steer(flockKernel->navigate(item, &aimed[item],
+                                              views.data(), (int)views.size()));
+   }
+   else
+   {
+      aimed[item].aim(views.data(), (int)views.size(), taskRate);
+   }
+}
+
+
+// Store task: copy aimed boids back.
+void ProcessorSet::storeTask(int worker, void *pset)
+{
+   ProcessorSet *set = (ProcessorSet *)pset;
+   int          n, item;
+
+   while ((item = set->cursor.fetch_add(AIM_CHUNK)) < set->numItems)
+   {
+      for (n = 0; n < AIM_CHUNK && item < set->numItems; n++, item++)
+      {
+         *(Boid *)set->items[item]->client = set->aimed[item];
+         set->aimed[item].~Boid();
+      }
+   }
+}
+
+
+// Move task: move partitions, queueing migrants by destination.
+void ProcessorSet::moveTask(int worker, void *pset)
+{
+   ProcessorSet       *set = (ProcessorSet *)pset;
+   register int       i, proc;
+   register OctObject *object;
+   register Boid      *boid;
+   Vector             position, velocity;
+   Point3D            point, heading;
+   Octree             *tree;
+
+   std::list<OctObject *>::iterator itr;
+
+   while ((proc = set->cursor.fetch_add(1)) < set->numProcs)
+   {
+      if (set->ptypes[proc] != LOCAL)
+      {
+         continue;
+      }
+      tree = set->octrees[proc];
+      tree->beginMoves();
+      for (itr = tree->objects.begin(); itr != tree->objects.end(); )
       {
          object = *itr;
-         octrees[proc]->objects.push_back(object);
+         boid   = (Boid *)object->client;
+         boid->move();
+         position = boid->getPosition();
+         velocity = boid->getVelocity();
+         point.set((float)position.x, (float)position.y, (float)position.z);
+         heading.set((float)velocity.x, (float)velocity.y, (float)velocity.z);
+         if (!object->move(point, heading))
+         {
+            // Boid migrating processors.
+            tree->load--;
+            set->workerStats[worker].count(proc, TickStats::MIGRATIONS_COUNT);
+            for (i = 0; i < set->numProcs; i++)
+            {
+               if (i == proc)
+               {
+                  continue;
+               }
+               if (object->isInside(set->octrees[i]))
+               {
+                  set->outboxes[(proc * set->numProcs) + i].push_back(boid);
+                  break;
+               }
+            }
+#ifdef _DEBUG
+            assert(i < set->numProcs);
+#endif
+            itr = tree->objects.erase(itr);
+            tree->deleteObject(object);
+         }
+         else
+         {
+            itr++;
+         }
+      }
+      set->endMoves(proc, &set->workerStats[worker]);
+   }
+}
+
+
+// End a round of moves of a partition.
+// A bulk rebuild is charged to its own phase.
+void ProcessorSet::endMoves(int proc, TickStats *stats)
+{
+   Octree *tree = octrees[proc];
+   TIME   start;
+
+   if (tree->rebuilding)
+   {
+      start = stats->start();
+      tree->endMoves();
+      stats->stop(TickStats::REBUILD_PHASE, start);
+      stats->count(proc, TickStats::REBUILDS_COUNT);
+   }
+   else
+   {
+      tree->endMoves();
+   }
+   stats->count(proc, TickStats::RELINKS_COUNT, tree->relinks);
+}
+
+
+// Insert task: insert queued migrants by destination.
+void ProcessorSet::insertTask(int worker, void *pset)
+{
+   ProcessorSet *set   = (ProcessorSet *)pset;
+   TickStats    *stats = &set->workerStats[worker];
+   int          i, proc, src;
+   TIME         start;
+
+   while ((proc = set->cursor.fetch_add(1)) < set->numProcs)
+   {
+      for (src = 0; src < set->numProcs; src++)
+      {
+         std::vector<Boid *>& outbox = set->outboxes[(src * set->numProcs) + proc];
+         for (i = 0; i < (int)outbox.size(); i++)
+         {
+            start = stats->start();
+            set->insert(proc, outbox[i]);
+            stats->stop(TickStats::INSERT_PHASE, start);
+         }
+         outbox.clear();
       }
    }
 }
@@ -355,13 +814,26 @@ void ProcessorSet::update(float simRate)
 bool ProcessorSet::insert(int proc, Boid *boid)
 {
    Vector    position = boid->getPosition();
-   OctObject *object  = new OctObject((float)position.x,
-                                      (float)position.y, (float)position.z, (void *)boid);
+   Vector    velocity = boid->getVelocity();
+   OctObject *object;
 
    if (ptypes[proc] == LOCAL)
    {
       // Local insert.
-      return(octrees[proc]->insert(object));
+      object = octrees[proc]->newObject((float)position.x,
+                                        (float)position.y, (float)position.z, (void *)boid);
+      object->velocity.set((float)velocity.x, (float)velocity.y, (float)velocity.z);
+      if (!octrees[proc]->insert(object))
+      {
+         // Lost boid must leave neighbor lists.
+         octrees[proc]->deleteObject(object);
+         invalidateNeighbors();
+         return(false);
+      }
+
+      // Each partition is inserted into by one worker at a time.
+      tickStats.count(proc, TickStats::ALLOCATIONS_COUNT);
+      return(true);
    }
    else
    {
@@ -372,6 +844,359 @@ bool ProcessorSet::insert(int proc, Boid *boid)
 }
 
 
+// Search neighbors of an object across processors.
+// With a neighbor skin, candidates come from the boid's Verlet list,
+// which is rebuilt with the skin added to the search radius when
+// stale, and are filtered by current distance. The lists hold boids
+// rather than tree objects, so they stay valid across migration.
+// Aggregates replace only direct searches by the boid navigator.
+void ProcessorSet::searchNeighbors(OctObject *object, std::vector<BoidNeighbor>& views,
+                                   OctSearchBuffer *buffer, TickStats *stats,
+                                   Boid *flown)
+{
+   register int   i, j;
+   register Boid  *boid;
+   Octree::BOUNDS bounds;
+   float          range, r2;
+   Vector         position;
+   Point3D        point;
+   NEIGHBORS      *neighbors;
+   TIME           start;
+
+   views.clear();
+   range = (float)Boid::visibilityRange;
+   if ((neighborSkin <= 0.0f) && !neighborJoin)
+   {
+      bounds.xmin = object->position.m_x - range;
+      bounds.xmax = object->position.m_x + range;
+      bounds.ymin = object->position.m_y - range;
+      bounds.ymax = object->position.m_y + range;
+      bounds.zmin = object->position.m_z - range;
+      bounds.zmax = object->position.m_z + range;
+      if ((flown != NULL) && (!aggregateAim || (flockKernel != NULL) ||
+                              flown->getFlockSelectively()))
+      {
+         flown = NULL;
+      }
+      for (i = 0; i < numProcs; i++)
+      {
+         // Search intersects processor space?
+         if (intersects(octrees[i]->bounds, bounds))
+         {
+            // Accumulate search results.
+            if (flown != NULL)
+            {
+               searchAggregate(i, object, range, flown, views, stats);
+            }
+            else
+            {
+               search(i, object->position, range, views, buffer, stats, object);
+            }
+         }
+      }
+      return;
+   }
+
+   // Rebuild stale list.
+   // Joined lists are built before aiming.
+   neighbors = &neighborLists[((Boid *)object->client)->getBoidNumber()];
+#ifdef _DEBUG
+   assert(!neighborJoin || (neighbors->build == neighborBuild));
+#endif
+   if (neighbors->build != neighborBuild)
+   {
+      neighbors->boids.clear();
+      neighbors->origin = object->position;
+      neighbors->build  = neighborBuild;
+      range            += neighborSkin;
+      bounds.xmin       = object->position.m_x - range;
+      bounds.xmax       = object->position.m_x + range;
+      bounds.ymin       = object->position.m_y - range;
+      bounds.ymax       = object->position.m_y + range;
+      bounds.zmin       = object->position.m_z - range;
+      bounds.zmax       = object->position.m_z + range;
+      for (i = 0; i < numProcs; i++)
+      {
+         if ((ptypes[i] == LOCAL) && intersects(octrees[i]->bounds, bounds))
+         {
+            start = stats->start();
+            buffer->clear();
+            octrees[i]->search(object, range, buffer);
+            for (j = 0; j < buffer->size; j++)
+            {
+               neighbors->boids.push_back((Boid *)buffer->objects[j]->client);
+            }
+            stats->stop(TickStats::SEARCH_PHASE, start);
+            stats->count(i, TickStats::QUERIES_COUNT);
+            stats->count(i, TickStats::NEIGHBORS_COUNT, buffer->size);
+         }
+      }
+      range = (float)Boid::visibilityRange;
+   }
+
+   // Filter candidates by current distance.
+   r2 = range * range;
+   for (i = 0; i < (int)neighbors->boids.size(); i++)
+   {
+      boid      = neighbors->boids[i];
+      position  = boid->getPosition();
+      point.m_x = (float)position.x;
+      point.m_y = (float)position.y;
+      point.m_z = (float)position.z;
+      if (point.DistSquare(object->position) <= r2)
+      {
+         views.resize(views.size() + 1);
+         boid->getNeighbor(&views.back());
+      }
+   }
+}
+
+
+// Set Verlet neighbor list skin (0 = search every update).
+void ProcessorSet::setNeighborSkin(float skin)
+{
+   if (skin < 0.0f)
+   {
+      skin = 0.0f;
+   }
+   neighborSkin = skin;
+   invalidateNeighbors();
+}
+
+
+// Check Verlet neighbor lists.
+// A list holds every boid that can come within visibility range
+// until some boid has moved more than half the skin since the build,
+// so all lists are invalidated at that point.
+void ProcessorSet::checkNeighbors()
+{
+   register int       i, proc, number;
+   register OctObject *object;
+   float              limit;
+   bool               stale;
+
+   std::list<OctObject *>::iterator itr;
+
+   if (neighborSkin <= 0.0f)
+   {
+      // Joined lists without skin hold for one update.
+      if (neighborJoin)
+      {
+         invalidateNeighbors();
+      }
+      return;
+   }
+   limit = (neighborSkin * 0.5f) * (neighborSkin * 0.5f);
+   stale = false;
+   for (proc = 0; proc < numProcs; proc++)
+   {
+      if (ptypes[proc] != LOCAL)
+      {
+         continue;
+      }
+      for (itr = octrees[proc]->objects.begin();
+           itr != octrees[proc]->objects.end(); itr++)
+      {
+         object = *itr;
+         number = ((Boid *)object->client)->getBoidNumber();
+         if (number >= (int)neighborLists.size())
+         {
+            i = (int)neighborLists.size();
+            neighborLists.resize(number + 1);
+            for ( ; i <= number; i++)
+            {
+               neighborLists[i].build = neighborBuild - 1;
+            }
+         }
+         if ((neighborLists[number].build != neighborBuild) ||
+             (object->position.DistSquare(neighborLists[number].origin) > limit))
+         {
+            stale = true;
+         }
+      }
+   }
+   if (stale)
+   {
+      invalidateNeighbors();
+   }
+}
+
+
+// Set aggregate aim mode.
+void ProcessorSet::setAggregateAim(bool mode, float theta)
+{
+   int i;
+
+   aggregateAim   = mode;
+   aggregateTheta = theta;
+   for (i = 0; i < numProcs; i++)
+   {
+      octrees[i]->setAggregate(mode);
+   }
+}
+
+
+// Search a processor, aggregating groups in a flown boid's field of view.
+void ProcessorSet::searchAggregate(int proc, OctObject *object, float radius, Boid *flown,
+                                   std::vector<BoidNeighbor>& views, TickStats *stats)
+{
+   int     n;
+   size_t  capacity;
+   Vector  velocity;
+   Point3D direction;
+   TIME    start;
+
+   if (ptypes[proc] == LOCAL)
+   {
+      // Local search.
+      start    = stats->start();
+      capacity = views.capacity();
+      n        = (int)views.size();
+      velocity = flown->getVelocity();
+      direction.set((float)velocity.x, (float)velocity.y, (float)velocity.z);
+      octrees[proc]->searchAggregate(object->position, radius, direction,
+                                     (float)FIELD_OF_VIEW_COS2, aggregateTheta,
+                                     aggregateObject, aggregateNode, (void *)&views);
+      stats->stop(TickStats::SEARCH_PHASE, start);
+      stats->count(proc, TickStats::QUERIES_COUNT);
+      stats->count(proc, TickStats::NEIGHBORS_COUNT, (int)views.size() - n);
+      if (views.capacity() != capacity)
+      {
+         stats->count(proc, TickStats::ALLOCATIONS_COUNT);
+      }
+   }
+   else
+   {
+      // Remote search.
+      assert(false);
+   }
+}
+
+
+// Aggregate search object visitor.
+void ProcessorSet::aggregateObject(OctObject *object, void *views)
+{
+   std::vector<BoidNeighbor> *neighbors = (std::vector<BoidNeighbor> *)views;
+
+   neighbors->resize(neighbors->size() + 1);
+   ((Boid *)object->client)->getNeighbor(&neighbors->back());
+}
+
+
+// Aggregate search node visitor.
+// The node's boids are viewed as one at their centroid.
+void ProcessorSet::aggregateNode(OctNode *node, void *views)
+{
+   std::vector<BoidNeighbor> *neighbors = (std::vector<BoidNeighbor> *)views;
+   BoidNeighbor              *neighbor;
+   double                    count = (double)node->count;
+
+   neighbors->resize(neighbors->size() + 1);
+   neighbor = &neighbors->back();
+   neighbor->position.Set(node->positionSum[0] / count, node->positionSum[1] / count,
+                          node->positionSum[2] / count);
+   neighbor->velocity.Set(node->velocitySum[0] / count, node->velocitySum[1] / count,
+                          node->velocitySum[2] / count);
+   neighbor->boidType   = -1;
+   neighbor->boidNumber = -1;
+   neighbor->count      = node->count;
+}
+
+
+// Set neighbor join mode.
+void ProcessorSet::setNeighborJoin(bool mode)
+{
+   neighborJoin = mode;
+   invalidateNeighbors();
+}
+
+
+// Build neighbor lists by joining partitions.
+// Each list starts with its own boid, as a search would find it.
+// Each partition is joined with itself and with each later partition
+// whose bounds come within range, so every pair is found once and
+// added to both lists.
+void ProcessorSet::joinNeighbors()
+{
+   register int       i, proc, proc2, number;
+   register OctObject *object;
+   Octree::BOUNDS     bounds;
+   float              range;
+   NEIGHBORS          *neighbors;
+   TIME               start;
+
+   std::list<OctObject *>::iterator itr;
+
+   start = tickStats.start();
+   for (proc = 0; proc < numProcs; proc++)
+   {
+      if (ptypes[proc] != LOCAL)
+      {
+         continue;
+      }
+      for (itr = octrees[proc]->objects.begin();
+           itr != octrees[proc]->objects.end(); itr++)
+      {
+         object = *itr;
+         number = ((Boid *)object->client)->getBoidNumber();
+         if (number >= (int)neighborLists.size())
+         {
+            neighborLists.resize(number + 1);
+         }
+         neighbors         = &neighborLists[number];
+         neighbors->origin = object->position;
+         neighbors->build  = neighborBuild;
+         neighbors->boids.clear();
+         neighbors->boids.push_back((Boid *)object->client);
+      }
+   }
+
+   range = (float)Boid::visibilityRange + neighborSkin;
+   for (proc = 0; proc < numProcs; proc++)
+   {
+      if (ptypes[proc] != LOCAL)
+      {
+         continue;
+      }
+      joinPairs = 0;
+      octrees[proc]->join(range, joinPair, this);
+      bounds       = octrees[proc]->bounds;
+      bounds.xmin -= range;
+      bounds.xmax += range;
+      bounds.ymin -= range;
+      bounds.ymax += range;
+      bounds.zmin -= range;
+      bounds.zmax += range;
+      for (proc2 = proc + 1, i = 1; proc2 < numProcs; proc2++)
+      {
+         if ((ptypes[proc2] == LOCAL) && intersects(octrees[proc2]->bounds, bounds))
+         {
+            octrees[proc]->join(octrees[proc2], range, joinPair, this);
+            i++;
+         }
+      }
+      tickStats.count(proc, TickStats::QUERIES_COUNT, i);
+      tickStats.count(proc, TickStats::NEIGHBORS_COUNT, joinPairs);
+   }
+   joinBuild = neighborBuild;
+   tickStats.stop(TickStats::SEARCH_PHASE, start);
+}
+
+
+// Join pair visitor: add boids to each other's lists.
+void ProcessorSet::joinPair(OctObject *object, OctObject *other, void *pset)
+{
+   ProcessorSet *set = (ProcessorSet *)pset;
+   Boid         *boid, *boid2;
+
+   boid  = (Boid *)object->client;
+   boid2 = (Boid *)other->client;
+   set->neighborLists[boid->getBoidNumber()].boids.push_back(boid2);
+   set->neighborLists[boid2->getBoidNumber()].boids.push_back(boid);
+   set->joinPairs++;
+}
+
+
 // List all boids.
 void ProcessorSet::listBoids(std::list<Boid *>& boidList)
 {
@@ -394,25 +1219,52 @@ void ProcessorSet::listBoids(std::list<Boid *>& boidList)
 
 
 // Search a processor.
-// Returns list of matching boids.
-void ProcessorSet::search(int proc, Point3D point, float radius, std::list<Boid>& boidList)
+// Appends views of matching boids.
+void ProcessorSet::search(int proc, Point3D point, float radius,
+                          std::vector<BoidNeighbor>& views)
 {
-   register OctObject *object;
+   search(proc, point, radius, views, &searchBuffer, &tickStats);
+}
 
-   std::list<OctObject *>           searchList;
-   std::list<OctObject *>::iterator itr;
+
+// Search a processor into a caller's result buffer.
+// Search statistics are recorded in the caller's stats.
+void ProcessorSet::search(int proc, Point3D point, float radius,
+                          std::vector<BoidNeighbor>& views,
+                          OctSearchBuffer *buffer, TickStats *stats, OctObject *anchor)
+{
+   register int  i, n;
    register Boid *boid;
+   size_t        capacity;
+   TIME          start;
 
    if (ptypes[proc] == LOCAL)
    {
       // Local search.
-      octrees[proc]->search(point, radius, searchList);
-      for (itr = searchList.begin();
-           itr != searchList.end(); itr++)
+      start = stats->start();
+      buffer->clear();
+      if (anchor != NULL)
       {
-         object = *itr;
-         boid   = (Boid *)object->client;
-         boidList.push_front(*boid);
+         octrees[proc]->search(anchor, radius, buffer);
+      }
+      else
+      {
+         octrees[proc]->search(point, radius, buffer);
+      }
+      capacity = views.capacity();
+      n        = (int)views.size();
+      views.resize(n + buffer->size);
+      for (i = 0; i < buffer->size; i++)
+      {
+         boid = (Boid *)buffer->objects[i]->client;
+         boid->getNeighbor(&views[n + i]);
+      }
+      stats->stop(TickStats::SEARCH_PHASE, start);
+      stats->count(proc, TickStats::QUERIES_COUNT);
+      stats->count(proc, TickStats::NEIGHBORS_COUNT, buffer->size);
+      if (views.capacity() != capacity)
+      {
+         stats->count(proc, TickStats::ALLOCATIONS_COUNT);
       }
    }
    else
@@ -434,7 +1286,9 @@ ProcessorSet::VISIBLE *ProcessorSet::searchVisible(Frustum *frustum)
    register Boid    *boid;
    register VISIBLE *visible, *visibleList;
    Vector           velocity;
+   TIME             start;
 
+   start       = tickStats.start();
    visibleList = NULL;
    for (proc = 0; proc < numProcs; proc++)
    {
@@ -461,6 +1315,7 @@ ProcessorSet::VISIBLE *ProcessorSet::searchVisible(Frustum *frustum)
          }
       }
    }
+   tickStats.stop(TickStats::VISIBLE_PHASE, start);
    return(visibleList);
 }
 
@@ -862,7 +1717,7 @@ void ProcessorSet::balance(int *parray, int rows, int columns, int ranks,
       balance(subParray, rows, columns, ranks / 2, XCUT, subBounds, subCentroids);
       break;
    }
-   delete subParray;
+   delete [] subParray;
    while (subCentroids != NULL)
    {
       centroid     = subCentroids;
@@ -1003,9 +1858,9 @@ void ProcessorSet::partition(int *assign, int numMachines, int dimension)
    }
    subPartition(assign, marray, numMachines, parray,
                 dimension, dimension, dimension, XCUT, bounds, procBounds);
-   delete marray;
-   delete parray;
-   delete procBounds;
+   delete [] marray;
+   delete [] parray;
+   delete [] procBounds;
 }
 
 
@@ -1166,6 +2021,6 @@ void ProcessorSet::subPartition(int *assign, int *marray, int msize, int *parray
                    XCUT, subBounds, procBounds);
       break;
    }
-   delete subMarray;
-   delete subParray;
+   delete [] subMarray;
+   delete [] subParray;
 }
@@ -14,10 +14,18 @@
 #include "Boid.h"
 #include "octree.hpp"
 #include "frustum.hpp"
+#include "threadPool.hpp"
+#include "tickStats.hpp"
+#include "flockKernel.hpp"
 #include <list>
+#include <vector>
+#include <atomic>
 
 #define PRECISION    100.0
 
+// Boids aimed per work-stealing grab.
+#define AIM_CHUNK    16
+
 class ProcessorSet
 {
 public:
@@ -41,6 +49,16 @@ public:
       struct Centroid *next;
    } CENTROID;
 
+   // Verlet neighbor list.
+   // Candidate neighbors within visibility range plus skin, and the
+   // position of the boid when the list was built.
+   typedef struct
+   {
+      std::vector<Boid *> boids;
+      Point3D             origin;
+      int                 build;
+   } NEIGHBORS;
+
    // Visible element.
    typedef struct Visible
    {
@@ -63,15 +81,85 @@ public:
    // Update.
    void update(float simRate = 1.0f);
 
+   // Set number of update threads.
+   void setNumThreads(int numThreads);
+
+   // Set structure-of-arrays flocking kernel.
+   // The kernel runs in the threaded update, with one or more threads.
+   void setFlockKernel(bool mode, FlockKernel::ISA isa = FlockKernel::AUTO_ISA);
+
+   // Threaded update.
+   // Boids are aimed from the state at the start of the update,
+   // so results do not depend on thread scheduling.
+   void updateThreaded(float simRate);
+
+   // Threaded update tasks.
+   static void aimTask(int worker, void *pset);
+   static void storeTask(int worker, void *pset);
+   static void moveTask(int worker, void *pset);
+   static void insertTask(int worker, void *pset);
+
+   // End a round of moves of a partition, recording relinks and
+   // any bulk rebuild of its octree.
+   void endMoves(int proc, TickStats *stats);
+   void aimItem(int worker, int item);
+
    // Insert boid into a processor.
    bool insert(int proc, Boid *boid);
 
+   // Search neighbors of an object across processors.
+   // A boid flown this update may be passed to aggregate distant
+   // groups of neighbors in its field of view.
+   void searchNeighbors(OctObject *object, std::vector<BoidNeighbor>& views,
+                        OctSearchBuffer *buffer, TickStats *stats,
+                        Boid *flown = NULL);
+
+   // Set Verlet neighbor list skin (0 = search every update).
+   void setNeighborSkin(float skin);
+
+   // Check Verlet neighbor lists, invalidating them if stale.
+   void checkNeighbors();
+
+   // Invalidate Verlet neighbor lists.
+   void invalidateNeighbors() { neighborBuild++; }
+
+   // Set neighbor join mode.
+   // Neighbor lists of all boids are built together by joining each
+   // partition with itself and its neighboring partitions, rather than
+   // by searching for each boid.
+   void setNeighborJoin(bool mode);
+
+   // Build neighbor lists by joining partitions.
+   void joinNeighbors();
+
+   // Join pair visitor.
+   static void joinPair(OctObject *object, OctObject *other, void *pset);
+
+   // Set aggregate aim mode.
+   // Boids searching directly are aimed with distant groups of
+   // neighbors in their field of view replaced by one view at the
+   // group's centroid, with its mean velocity. theta bounds the size
+   // of a group relative to its distance (0 = exact).
+   void setAggregateAim(bool mode, float theta);
+
+   // Search a processor, aggregating groups in a flown boid's field
+   // of view.
+   void searchAggregate(int proc, OctObject *object, float radius, Boid *flown,
+                        std::vector<BoidNeighbor>& views, TickStats *stats);
+
+   // Aggregate search visitors.
+   static void aggregateObject(OctObject *object, void *views);
+   static void aggregateNode(OctNode *node, void *views);
+
    // List boids.
    void listBoids(std::list<Boid *>& boidList);
 
    // Search a processor.
-   // Returns list of matching boids.
-   void search(int proc, Point3D point, float radius, std::list<Boid>& boidList);
+   // Appends views of matching boids. A search around an object of
+   // the processor starts from the object's node.
+   void search(int proc, Point3D point, float radius, std::vector<BoidNeighbor>& views);
+   void search(int proc, Point3D point, float radius, std::vector<BoidNeighbor>& views,
+               OctSearchBuffer *buffer, TickStats *stats, OctObject *anchor = NULL);
 
    // Search for visible local objects.
    VISIBLE *searchVisible(Frustum *frustum);
@@ -79,6 +167,18 @@ public:
    // Set load-balance.
    void setLoadBalance(bool mode) { loadBalance = mode; }
 
+   // Set approximate median mode for load-balancing.
+   void setApproximateMedian(bool mode);
+
+   // Set octree spatial index backend.
+   void setOctreeBackend(Octree::BACKEND backend);
+
+   // Set adaptive octree rebuild threshold.
+   // While more than this fraction of a partition's boids left their
+   // octree nodes in the last update, its octree is rebuilt in bulk
+   // after moving instead of relinking each boid (0 = never).
+   void setRebuildThreshold(float threshold);
+
    // Load-balance.
    void balance(int *parray, int rows, int columns, int ranks,
                 CUT cut, Octree::BOUNDS bounds, CENTROID *centroids);
@@ -104,6 +204,44 @@ public:
    std::list<OctObject *> *migrations;
    PROCTYPE               *ptypes;
    Octree::BOUNDS         *newBounds;
+   OctSearchBuffer        searchBuffer;
+   std::vector<BoidNeighbor> neighborViews;
    bool loadBalance;
+
+   // Update instrumentation.
+   TickStats tickStats;
+
+   // Verlet neighbor lists, indexed by boid number.
+   float                  neighborSkin;
+   int                    neighborBuild;
+   std::vector<NEIGHBORS> neighborLists;
+
+   // Neighbor join mode, lists build joined, and pairs joined.
+   bool neighborJoin;
+   int  joinBuild;
+   int  joinPairs;
+
+   // Aggregate aim mode and opening angle.
+   bool  aggregateAim;
+   float aggregateTheta;
+
+   // Threaded update.
+   int                 numThreads;
+   ThreadPool          *pool;
+   OctSearchBuffer     *workerBuffers;
+   TickStats           *workerStats;
+   std::vector<BoidNeighbor> *workerViews;
+   OctObject           **items;
+   int                 numItems;
+   int                 itemCapacity;
+   int                 *itemStart;
+   Boid                *aimed;
+   std::atomic<int>    *cursors;
+   std::atomic<int>    cursor;
+   std::vector<Boid *> *outboxes;
+   float               taskRate;
+
+   // Flocking kernel (NULL = Boid navigator).
+   FlockKernel *flockKernel;
 };
 #endif
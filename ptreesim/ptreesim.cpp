@@ -54,16 +54,33 @@ int BoidDelay = 0;
 
 // Processor set.
 #define NUM_MACHINES    2
-#define DIMENSION       2                         // (power of 2)
-#define NUM_PROCS       (DIMENSION * DIMENSION * DIMENSION)
+int                    Dimension = 2;             // (power of 2)
+int                    NumProcs;
 ProcessorSet           *Set;
-ProcessorSet::PROCTYPE Ptypes[NUM_PROCS];
+ProcessorSet::PROCTYPE *Ptypes;
 struct SetColor
 {
    float r, g, b;
 }
      *SetColors;
-bool LoadBalance = false;
+bool             LoadBalance       = false;
+bool             ApproximateMedian = false;
+bool             LinearBackend     = false;
+bool             GridBackend       = false;
+float            RebuildThreshold  = 0.0f;
+int              NumThreads        = 1;
+float            NeighborSkin      = 0.0f;
+bool             NeighborJoin      = false;
+float            AggregateTheta    = 0.0f;
+bool             UseFlockKernel    = false;
+FlockKernel::ISA FlockISA          = FlockKernel::AUTO_ISA;
+
+// Headless benchmark: update without display for a number of steps.
+bool Headless = false;
+int  Steps    = 1000;
+
+// Tick statistics file written at exit.
+char *TickStatsFile = NULL;
 
 // Camera.
 #define CAMERA_BEHIND    0.25f
@@ -127,6 +144,7 @@ FrameRate frameRate(TARGET_FRAME_RATE);
 // Functions.
 void modeInfo(), runInfo(), helpInfo();
 void setInfoProjection(), resetInfoProjection();
+void quit();
 
 void renderBitmapString(GLfloat, GLfloat, void *, char *);
 
@@ -303,7 +321,7 @@ void drawSet()
    // Draw octrees.
    if (DisplayOctrees)
    {
-      for (i = 0; i < NUM_PROCS; i++)
+      for (i = 0; i < NumProcs; i++)
       {
          glColor3f(SetColors[i].r, SetColors[i].g, SetColors[i].b);
          tree = Set->octrees[i];
@@ -330,7 +348,7 @@ void drawSet()
    // Draw bounds.
    glColor3f(1.0f, 1.0f, 1.0f);
    glLineWidth(2.0);
-   for (i = 0; i < NUM_PROCS; i++)
+   for (i = 0; i < NumProcs; i++)
    {
       tree = Set->octrees[i];
       drawBox(tree->bounds.xmin, tree->bounds.xmax, tree->bounds.ymin,
@@ -622,7 +640,7 @@ void keyboard(unsigned char key, int x, int y)
          break;
 
       case 'q':                                   // Quit.
-         exit(0);
+         quit();
       }
       break;
    }
@@ -691,16 +709,82 @@ void menu(int value)
       break;
 
    case 2:
-      exit(0);
+      quit();
    }
    glutPostRedisplay();
 }
 
 
+// Run headless benchmark and print results.
+void benchmark()
+{
+   int    i;
+   TIME   start, elapsed;
+   double seconds;
+
+   Set->update(1.0f);
+   Set->tickStats.reset();
+   start = getmicrotime();
+   for (i = 0; i < Steps; i++)
+   {
+      Set->update(1.0f);
+   }
+   elapsed = getmicrotime() - start;
+   seconds = (double)elapsed / 1000000.0;
+   if (seconds <= 0.0)
+   {
+      seconds = 1.0e-6;
+   }
+
+   printf("boids=%d dimension=%d loadBalance=%d approximateMedian=%d linearOctree=%d spatialGrid=%d rebuildThreshold=%g threads=%d neighborJoin=%d aggregateAim=%g flockKernel=%s steps=%d\n",
+          NUM_BOIDS, Dimension, LoadBalance, ApproximateMedian, LinearBackend, GridBackend,
+          RebuildThreshold, NumThreads, NeighborJoin, AggregateTheta,
+          Set->flockKernel != NULL ? FlockKernel::isaName(Set->flockKernel->isa) : "none", Steps);
+   printf("ticks/sec=%.2f boids/sec=%.0f\n",
+          (double)Steps / seconds, ((double)Steps * (double)NUM_BOIDS) / seconds);
+   printf("usec/tick: balance=%.1f aim=%.1f move=%.1f rebuild=%.1f total=%.1f\n",
+          (double)Set->tickStats.getTime(TickStats::BALANCE_PHASE) / (double)Steps,
+          (double)Set->tickStats.getTime(TickStats::AIM_PHASE) / (double)Steps,
+          (double)Set->tickStats.getTime(TickStats::MOVE_PHASE) / (double)Steps,
+          (double)Set->tickStats.getTime(TickStats::REBUILD_PHASE) / (double)Steps,
+          (double)elapsed / (double)Steps);
+}
+
+
+// Write tick statistics, delete the processor set and exit.
+void quit()
+{
+   FILE *fp;
+
+   if (TickStatsFile != NULL)
+   {
+      if ((fp = fopen(TickStatsFile, "w")) == NULL)
+      {
+         fprintf(stderr, "Cannot open tick statistics file %s\n", TickStatsFile);
+      }
+      else
+      {
+         Set->tickStats.dump(fp);
+         fclose(fp);
+      }
+   }
+   delete Set;
+   exit(0);
+}
+
+
+// Print usage and exit.
+void usage(char *program)
+{
+   fprintf(stderr, "Usage %s [-numBoids <number of boids>] [-randomSeed <random number seed>] [-dimension <processors per axis (power of 2)>] [-loadBalance] [-approximateMedian] [-linearOctree] [-spatialGrid] [-rebuildThreshold <fraction of boids changing octree nodes>] [-numThreads <number of update threads>] [-neighborSkin <neighbor list skin distance>] [-neighborJoin] [-aggregateAim <aggregate size to distance ratio>] [-flockKernel <scalar | avx2 | avx512 | auto>] [-headless [-steps <number of steps>]] [-tickStats <statistics file>]\n", program);
+   exit(1);
+}
+
+
 int main(int argc, char **argv)
 {
    int   i, j, seed;
-   int   assign[DIMENSION * DIMENSION * DIMENSION];
+   int   *assign;
    float r, g, b;
 
 #ifdef WIN32
@@ -722,13 +806,11 @@ int main(int argc, char **argv)
          i++;
          if (i >= argc)
          {
-            fprintf(stderr, "Usage %s [-numBoids <number of boids>] [-randomSeed <random number seed>]\n", argv[0]);
-            exit(1);
+            usage(argv[0]);
          }
          if ((NUM_BOIDS = atoi(argv[i])) < 0)
          {
-            fprintf(stderr, "Usage %s [-numBoids <number of boids>] [-randomSeed <random number seed>]\n", argv[0]);
-            exit(1);
+            usage(argv[0]);
          }
          continue;
       }
@@ -738,15 +820,219 @@ int main(int argc, char **argv)
          i++;
          if (i >= argc)
          {
-            fprintf(stderr, "Usage %s [-numBoids <number of boids>] [-randomSeed <random number seed>]\n", argv[0]);
-            exit(1);
+            usage(argv[0]);
          }
          seed = atoi(argv[i]);
          continue;
       }
 
-      fprintf(stderr, "Usage %s [-numBoids <number of boids>] [-randomSeed <random number seed>]\n", argv[0]);
-      exit(1);
+      if (strcmp(argv[i], "-dimension") == 0)
+      {
+         i++;
+         if (i >= argc)
+         {
+            usage(argv[0]);
+         }
+         if ((Dimension = atoi(argv[i])) < 1)
+         {
+            usage(argv[0]);
+         }
+         for (j = 1; j < Dimension; j = 2 * j)
+         {
+         }
+         if (j != Dimension)
+         {
+            usage(argv[0]);
+         }
+         continue;
+      }
+
+      if (strcmp(argv[i], "-loadBalance") == 0)
+      {
+         LoadBalance = true;
+         continue;
+      }
+
+      if (strcmp(argv[i], "-approximateMedian") == 0)
+      {
+         ApproximateMedian = true;
+         continue;
+      }
+
+      if (strcmp(argv[i], "-linearOctree") == 0)
+      {
+         LinearBackend = true;
+         continue;
+      }
+
+      if (strcmp(argv[i], "-spatialGrid") == 0)
+      {
+         GridBackend = true;
+         continue;
+      }
+
+      if (strcmp(argv[i], "-rebuildThreshold") == 0)
+      {
+         i++;
+         if (i >= argc)
+         {
+            usage(argv[0]);
+         }
+         if ((RebuildThreshold = (float)atof(argv[i])) < 0.0f)
+         {
+            usage(argv[0]);
+         }
+         continue;
+      }
+
+      if (strcmp(argv[i], "-numThreads") == 0)
+      {
+         i++;
+         if (i >= argc)
+         {
+            usage(argv[0]);
+         }
+         if ((NumThreads = atoi(argv[i])) < 1)
+         {
+            usage(argv[0]);
+         }
+         continue;
+      }
+
+      if (strcmp(argv[i], "-neighborSkin") == 0)
+      {
+         i++;
+         if (i >= argc)
+         {
+            usage(argv[0]);
+         }
+         if ((NeighborSkin = (float)atof(argv[i])) < 0.0f)
+         {
+            usage(argv[0]);
+         }
+         continue;
+      }
+
+      if (strcmp(argv[i], "-neighborJoin") == 0)
+      {
+         NeighborJoin = true;
+         continue;
+      }
+
+      if (strcmp(argv[i], "-aggregateAim") == 0)
+      {
+         i++;
+         if (i >= argc)
+         {
+            usage(argv[0]);
+         }
+         if ((AggregateTheta = (float)atof(argv[i])) < 0.0f)
+         {
+            usage(argv[0]);
+         }
+         continue;
+      }
+
+      if (strcmp(argv[i], "-flockKernel") == 0)
+      {
+         i++;
+         if (i >= argc)
+         {
+            usage(argv[0]);
+         }
+         UseFlockKernel = true;
+         if (strcmp(argv[i], "scalar") == 0)
+         {
+            FlockISA = FlockKernel::SCALAR_ISA;
+         }
+         else if (strcmp(argv[i], "avx2") == 0)
+         {
+            FlockISA = FlockKernel::AVX2_ISA;
+         }
+         else if (strcmp(argv[i], "avx512") == 0)
+         {
+            FlockISA = FlockKernel::AVX512_ISA;
+         }
+         else if (strcmp(argv[i], "auto") == 0)
+         {
+            FlockISA = FlockKernel::AUTO_ISA;
+         }
+         else
+         {
+            usage(argv[0]);
+         }
+         continue;
+      }
+
+      if (strcmp(argv[i], "-tickStats") == 0)
+      {
+         i++;
+         if (i >= argc)
+         {
+            usage(argv[0]);
+         }
+         TickStatsFile = argv[i];
+         continue;
+      }
+
+      if (strcmp(argv[i], "-headless") == 0)
+      {
+         Headless = true;
+         continue;
+      }
+
+      if (strcmp(argv[i], "-steps") == 0)
+      {
+         i++;
+         if (i >= argc)
+         {
+            usage(argv[0]);
+         }
+         if ((Steps = atoi(argv[i])) < 1)
+         {
+            usage(argv[0]);
+         }
+         continue;
+      }
+
+      usage(argv[0]);
+   }
+
+   // Create processor set.
+   NumProcs = Dimension * Dimension * Dimension;
+   Ptypes   = new ProcessorSet::PROCTYPE[NumProcs];
+   assert(Ptypes != NULL);
+   for (i = 0; i < NumProcs; i++)
+   {
+      Ptypes[i] = ProcessorSet::LOCAL;
+   }
+   Set = new ProcessorSet(Dimension, SPAN, NUM_BOIDS, Ptypes, seed);
+   assert(Set != NULL);
+   Set->setLoadBalance(LoadBalance);
+   Set->setApproximateMedian(ApproximateMedian);
+   if (LinearBackend)
+   {
+      Set->setOctreeBackend(Octree::LINEAR_BACKEND);
+   }
+   else if (GridBackend)
+   {
+      Set->setOctreeBackend(Octree::GRID_BACKEND);
+   }
+   Set->setRebuildThreshold(RebuildThreshold);
+   Set->setNumThreads(NumThreads);
+   Set->setNeighborSkin(NeighborSkin);
+   Set->setNeighborJoin(NeighborJoin);
+   if (AggregateTheta > 0.0f)
+   {
+      Set->setAggregateAim(true, AggregateTheta);
+   }
+   Set->setFlockKernel(UseFlockKernel, FlockISA);
+
+   // Headless benchmark?
+   if (Headless)
+   {
+      benchmark();
+      quit();
    }
 
    GLUTWrapper glObj;
@@ -774,24 +1060,18 @@ int main(int argc, char **argv)
    glutAddMenuEntry("Exit", 2);
    glutAttachMenu(GLUT_RIGHT_BUTTON);
 
-   // Create processor set.
-   for (i = 0; i < NUM_PROCS; i++)
-   {
-      Ptypes[i] = ProcessorSet::LOCAL;
-   }
-   Set = new ProcessorSet(DIMENSION, SPAN, NUM_BOIDS, Ptypes, seed);
-   assert(Set != NULL);
-
    // Partition processors among machines and color-code by machine.
-   SetColors = new struct SetColor[NUM_PROCS];
+   SetColors = new struct SetColor[NumProcs];
    assert(SetColors != NULL);
-   ProcessorSet::partition(assign, NUM_MACHINES, DIMENSION);
+   assign = new int[NumProcs];
+   assert(assign != NULL);
+   ProcessorSet::partition(assign, NUM_MACHINES, Dimension);
    for (i = 0; i < NUM_MACHINES; i++)
    {
       r = (PRAND * 0.5f) + 0.5f;
       g = (PRAND * 0.5f) + 0.5f;
       b = (PRAND * 0.5f) + 0.5f;
-      for (j = 0; j < NUM_PROCS; j++)
+      for (j = 0; j < NumProcs; j++)
       {
          if (assign[j] == i)
          {
@@ -801,6 +1081,7 @@ int main(int argc, char **argv)
          }
       }
    }
+   delete [] assign;
 
    // Create camera guide and frustum.
    Guide = new CameraGuide();
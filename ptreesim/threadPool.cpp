@@ -0,0 +1,117 @@
+/*
+ * File Name : threadPool.cpp
+ *
+ * Description : Fixed pool of worker threads running a task in lock step.
+ */
+
+#include "threadPool.hpp"
+#include <assert.h>
+
+// Constructor.
+ThreadPool::ThreadPool(int numThreads)
+{
+   int i;
+
+   if (numThreads < 1)
+   {
+      numThreads = 1;
+   }
+   this->numThreads = numThreads;
+   m_task           = NULL;
+   m_data           = NULL;
+   m_generation     = 0;
+   m_pending        = 0;
+   m_quit           = false;
+   for (i = 1; i < numThreads; i++)
+   {
+      m_threads.push_back(std::thread(&ThreadPool::work, this, i));
+   }
+}
+
+
+// Destructor.
+ThreadPool::~ThreadPool()
+{
+   int i;
+
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_quit = true;
+      m_generation++;
+   }
+   m_start.notify_all();
+   for (i = 0; i < (int)m_threads.size(); i++)
+   {
+      m_threads[i].join();
+   }
+}
+
+
+// Run task on all workers and wait for completion.
+void ThreadPool::run(TASK task, void *data)
+{
+   if (numThreads == 1)
+   {
+      task(0, data);
+      return;
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+#ifdef _DEBUG
+      assert(m_pending == 0);
+#endif
+      m_task    = task;
+      m_data    = data;
+      m_pending = numThreads - 1;
+      m_generation++;
+   }
+   m_start.notify_all();
+
+   // Caller is worker 0.
+   task(0, data);
+
+   std::unique_lock<std::mutex> lock(m_mutex);
+   while (m_pending > 0)
+   {
+      m_done.wait(lock);
+   }
+}
+
+
+// Worker thread loop.
+void ThreadPool::work(int worker)
+{
+   int  generation = 0;
+   TASK task;
+   void *data;
+
+   for ( ; ; )
+   {
+      {
+         std::unique_lock<std::mutex> lock(m_mutex);
+         while (m_generation == generation)
+         {
+            m_start.wait(lock);
+         }
+         generation = m_generation;
+         if (m_quit)
+         {
+            return;
+         }
+         task = m_task;
+         data = m_data;
+      }
+
+      task(worker, data);
+
+      {
+         std::lock_guard<std::mutex> lock(m_mutex);
+         m_pending--;
+         if (m_pending == 0)
+         {
+            m_done.notify_one();
+         }
+      }
+   }
+}
@@ -0,0 +1,52 @@
+/*
+ * File Name : threadPool.hpp
+ *
+ * Description : Fixed pool of worker threads running a task in lock step.
+ *               The calling thread takes part as worker 0, and run()
+ *               returns when every worker has finished the task,
+ *               so each call acts as a barrier.
+ */
+
+#ifndef __THREADPOOL_HPP__
+#define __THREADPOOL_HPP__
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class ThreadPool
+{
+public:
+
+   // Task: called once per worker.
+   typedef void (*TASK)(int worker, void *data);
+
+   // Constructor.
+   ThreadPool(int numThreads);
+
+   // Destructor.
+   ~ThreadPool();
+
+   // Run task on all workers and wait for completion.
+   void run(TASK task, void *data);
+
+   // Number of workers, including caller.
+   int numThreads;
+
+private:
+
+   // Worker thread loop.
+   void work(int worker);
+
+   std::vector<std::thread> m_threads;
+   std::mutex               m_mutex;
+   std::condition_variable  m_start;
+   std::condition_variable  m_done;
+   TASK                     m_task;
+   void                     *m_data;
+   int                      m_generation;
+   int                      m_pending;
+   bool                     m_quit;
+};
+#endif
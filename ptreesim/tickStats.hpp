@@ -0,0 +1,113 @@
+/*
+ * File Name : tickStats.hpp
+ *
+ * Description : Update tick instrumentation.
+ *               Wall-time phase timers with latency histograms, and
+ *               per-partition event counters. A timed interval costs
+ *               two clock reads; nothing is recorded while disabled.
+ */
+
+#ifndef __TICKSTATS_HPP__
+#define __TICKSTATS_HPP__
+
+#include <stdio.h>
+#include "gettime.h"
+
+// Latency histogram buckets.
+// Bucket i counts intervals shorter than 2^i microseconds;
+// the last bucket also holds all longer intervals.
+#define TICKSTATS_BUCKETS    24
+
+class TickStats
+{
+public:
+
+   // Timed phases.
+   // Nested phases are also included in their enclosing phase:
+   // median and migrate in balance, search in aim, insert and rebuild
+   // in move.
+   typedef enum
+   {
+      BALANCE_PHASE, MEDIAN_PHASE, AIM_PHASE, SEARCH_PHASE, MOVE_PHASE,
+      MIGRATE_PHASE, INSERT_PHASE, REBUILD_PHASE, VISIBLE_PHASE, NUM_PHASES
+   }
+   PHASE;
+
+   // Partition counters.
+   // Relinks are objects leaving their octree nodes; rebuilds are
+   // moves done by bulk octree rebuild instead of relinking.
+   typedef enum
+   {
+      QUERIES_COUNT, NEIGHBORS_COUNT, MIGRATIONS_COUNT, ALLOCATIONS_COUNT,
+      RELINKS_COUNT, REBUILDS_COUNT, NUM_COUNTERS
+   }
+   COUNTER;
+
+   // Constructors.
+   TickStats();
+   TickStats(int numPartitions);
+   void init(int numPartitions);
+
+   // Destructor.
+   ~TickStats();
+
+   // Clear statistics.
+   void reset();
+
+   // Enable/disable recording.
+   void setEnabled(bool mode) { enabled = mode; }
+
+   // Start interval: returns start time.
+   TIME start() { return(enabled ? getmicrotime() : 0); }
+
+   // Stop interval and charge it to phase.
+   void stop(PHASE phase, TIME start);
+
+   // Count partition event.
+   void count(int partition, COUNTER counter, int amount = 1)
+   {
+      if (enabled)
+      {
+         counters[(partition * NUM_COUNTERS) + counter] += amount;
+      }
+   }
+
+   // End tick.
+   void tick() { ticks++; }
+
+   // Add statistics into these.
+   void merge(TickStats *stats);
+
+   // Total phase time (microseconds) and intervals.
+   TIME getTime(PHASE phase) { return(times[phase]); }
+   int getCalls(PHASE phase) { return(calls[phase]); }
+
+   // Phase latency percentile (microseconds).
+   // Returns the upper bound of the histogram bucket holding the
+   // given fraction of intervals.
+   TIME getPercentile(PHASE phase, float fraction);
+
+   // Partition and total counts.
+   long long getCount(int partition, COUNTER counter)
+   {
+      return(counters[(partition * NUM_COUNTERS) + counter]);
+   }
+   long long getTotal(COUNTER counter);
+
+   // Names.
+   static const char *phaseName(PHASE phase);
+   static const char *counterName(COUNTER counter);
+
+   // Print statistics.
+   void dump(FILE *fp);
+
+   // Data members.
+   bool      enabled;
+   int       numPartitions;
+   int       ticks;
+   TIME      times[NUM_PHASES];
+   int       calls[NUM_PHASES];
+   int       histograms[NUM_PHASES][TICKSTATS_BUCKETS];
+   long long *counters;
+};
+#endif